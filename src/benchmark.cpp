@@ -0,0 +1,608 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include "misc/getopt.h" // getopt for windows
+#else
+#include <getopt.h>
+#include <unistd.h>
+#endif
+#include <vector>
+
+#include "CGL/CGL.h"
+#include "cloth.h"
+#include "collision/capsule.h"
+#include "collision/geometry.h"
+#include "collision/plane.h"
+#include "collision/sphere.h"
+#include "collision/triangleMesh.h"
+#include "misc/thread_utils.h"
+#include "vertexNormals.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+void usageError(const char *binaryName) {
+  printf("Usage: %s [options]\n", binaryName);
+  printf("Program options:\n");
+  printf("  -n     <INT>       Point masses along each side of the cloth (default 500)\n");
+  printf("  -s     <INT>       Timed steps per measurement (default 20)\n");
+  printf("  -t     <INT>       Largest thread count to measure (default all cores)\n");
+  printf("  -a     <INT>       Substeps of the float/double accuracy comparison (default 900)\n");
+  printf("\n");
+  exit(-1);
+}
+
+double elapsed_ms(Clock::time_point start) {
+  return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+double max_difference(const vector<Vector3D> &a, const vector<Vector3D> &b) {
+  double diff = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    diff = max(diff, (a[i] - b[i]).norm());
+  }
+  return diff;
+}
+
+// Positions and forces of a store as doubles, whatever its precision
+vector<Vector3D> positions(const ParticleStore &p) {
+  vector<Vector3D> v(p.size());
+  for (size_t i = 0; i < p.size(); i++) v[i] = p.get_position(i);
+  return v;
+}
+
+vector<Vector3D> forces(const ParticleStore &p) {
+  vector<Vector3D> v(p.size());
+  for (size_t i = 0; i < p.size(); i++) v[i] = p.get_forces(i);
+  return v;
+}
+
+const char *precision_name(e_precision precision) {
+  return precision == SINGLE_PRECISION ? "float" : "double";
+}
+
+// Compares the scalar and SIMD step kernels on a single thread. Every kernel
+// runs one full force / Verlet / clamp sequence from the same starting state,
+// so the results can be checked against the scalar ones of the same
+// precision. Speedups are relative to the scalar double kernels.
+void bench_kernels(Cloth &cloth, ClothParameters &cp,
+                   const vector<Vector3D> &external_accelerations,
+                   const ParticleStore &start, int num_steps,
+                   double &base_forces, double &base_verlet,
+                   double &base_strain) {
+  e_precision precision = start.precision;
+  printf("%8s %14s %8s %14s %8s %14s %8s %14s\n", precision_name(precision),
+         "forces ms",
+         "speedup", "verlet ms", "speedup", "strain ms", "speedup",
+         "max error");
+
+  ParticleStore reference;
+
+  for (int i = 0; i < Kernels::NUM_ISAS; i++) {
+    Kernels::e_isa isa = (Kernels::e_isa)i;
+    if (!Kernels::is_supported(isa)) {
+      printf("%8s %14s\n", Kernels::isa_name(isa), "unsupported");
+      continue;
+    }
+    cp.simd = isa;
+
+    // Best of num_steps runs, which is less sensitive to other load on the
+    // machine than the mean
+    double forces_ms = 1e30, verlet_ms = 1e30, strain_ms = 1e30;
+    for (int k = 0; k < num_steps; k++) {
+      cloth.particles = start;
+      Clock::time_point t0 = Clock::now();
+      cloth.accumulate_forces(&cp, external_accelerations, 1);
+      forces_ms = min(forces_ms, elapsed_ms(t0));
+
+      Clock::time_point t1 = Clock::now();
+      cloth.integrate(&cp, 1.0 / 90 / 30, 1);
+      verlet_ms = min(verlet_ms, elapsed_ms(t1));
+
+      Clock::time_point t2 = Clock::now();
+      cloth.limit_strain(&cp, 1);
+      strain_ms = min(strain_ms, elapsed_ms(t2));
+    }
+
+    if (isa == Kernels::ISA_SCALAR) {
+      if (precision == DOUBLE_PRECISION) {
+        base_forces = forces_ms;
+        base_verlet = verlet_ms;
+        base_strain = strain_ms;
+      }
+      reference = cloth.particles;
+    }
+    double error = max(max_difference(forces(reference), forces(cloth.particles)),
+                       max_difference(positions(reference), positions(cloth.particles)));
+
+    printf("%8s %14.3f %7.2fx %14.3f %7.2fx %14.3f %7.2fx %14g\n",
+           Kernels::select(isa).name, forces_ms, base_forces / forces_ms,
+           verlet_ms, base_verlet / verlet_ms, strain_ms,
+           base_strain / strain_ms, error);
+  }
+
+  cp.simd = Kernels::ISA_AVX512;
+  cloth.particles = start;
+}
+
+// Measures how the parallel passes of Cloth::simulate scale with the number of
+// threads, using the widest available kernels.
+void bench_threads(Cloth &cloth, ClothParameters &cp,
+                   const vector<Vector3D> &external_accelerations,
+                   const ParticleStore &start, int num_steps, int max_threads) {
+  double frames_per_sec = 90;
+  double simulation_steps = 30;
+  vector<CollisionObject *> collision_objects;
+
+  printf("%8s %14s %8s %14s %8s %14s %8s %14s\n", "threads", "forces ms",
+         "speedup", "strain ms", "speedup", "simulate ms", "speedup",
+         "deterministic");
+
+  vector<Vector3D> reference_forces;
+  vector<Vector3D> reference_positions;
+  double base_forces = 0, base_strain = 0, base_simulate = 0;
+
+  vector<int> thread_counts;
+  for (int t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+  thread_counts.push_back(max_threads);
+
+  for (int threads : thread_counts) {
+    cp.num_threads = threads;
+
+    cloth.particles = start;
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < num_steps; i++) {
+      cloth.accumulate_forces(&cp, external_accelerations, threads);
+    }
+    double forces_ms = elapsed_ms(t0) / num_steps;
+
+    double strain_ms = 0;
+    for (int i = 0; i < num_steps; i++) {
+      cloth.particles.position = start.position;
+      cloth.particles.position_f = start.position_f;
+      Clock::time_point t = Clock::now();
+      cloth.limit_strain(&cp, threads);
+      strain_ms += elapsed_ms(t) / num_steps;
+    }
+
+    if (reference_forces.empty()) {
+      reference_forces = forces(cloth.particles);
+      reference_positions = positions(cloth.particles);
+    }
+    bool deterministic = reference_forces == forces(cloth.particles) &&
+                         reference_positions == positions(cloth.particles);
+
+    cloth.particles = start;
+
+    Clock::time_point t1 = Clock::now();
+    for (int i = 0; i < num_steps; i++) {
+      cloth.simulate(frames_per_sec, simulation_steps, &cp, external_accelerations, &collision_objects);
+    }
+    double simulate_ms = elapsed_ms(t1) / num_steps;
+
+    if (threads == 1) {
+      base_forces = forces_ms;
+      base_strain = strain_ms;
+      base_simulate = simulate_ms;
+    }
+
+    printf("%8d %14.3f %7.2fx %14.3f %7.2fx %14.3f %7.2fx %14s\n", threads,
+           forces_ms, base_forces / forces_ms, strain_ms,
+           base_strain / strain_ms, simulate_ms, base_simulate / simulate_ms,
+           deterministic ? "yes" : "NO");
+  }
+}
+
+// Simulates the sheet with double and with single-precision storage from the
+// same starting state and reports the cost of a full substep, together with
+// how far the float run drifts from the double one.
+void bench_precision(Cloth &cloth, ClothParameters &cp,
+                     const vector<Vector3D> &external_accelerations,
+                     const ParticleStore &start, int num_steps) {
+  double frames_per_sec = 90;
+  double simulation_steps = 30;
+  vector<CollisionObject *> collision_objects;
+
+  printf("%8s %14s %8s %14s %14s %14s\n", "storage", "simulate ms",
+         "speedup", "max drift", "rms drift", "lowest y");
+
+  vector<Vector3D> reference;
+  double base_simulate = 0;
+  for (int p = DOUBLE_PRECISION; p <= SINGLE_PRECISION; p++) {
+    cloth.particles = start;
+    cloth.particles.set_precision((e_precision)p);
+
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < num_steps; i++) {
+      cloth.simulate(frames_per_sec, simulation_steps, &cp, external_accelerations, &collision_objects);
+    }
+    double simulate_ms = elapsed_ms(t0) / num_steps;
+
+    vector<Vector3D> result = positions(cloth.particles);
+    if (p == DOUBLE_PRECISION) {
+      base_simulate = simulate_ms;
+      reference = result;
+    }
+    double max_drift = 0, sum_squares = 0, lowest = 1e30;
+    for (size_t i = 0; i < result.size(); i++) {
+      double d = (result[i] - reference[i]).norm();
+      max_drift = max(max_drift, d);
+      sum_squares += d * d;
+      lowest = min(lowest, result[i].y);
+    }
+
+    printf("%8s %14.3f %7.2fx %14g %14g %14.6f\n",
+           precision_name((e_precision)p), simulate_ms,
+           base_simulate / simulate_ms, max_drift,
+           sqrt(sum_squares / result.size()), lowest);
+  }
+
+  cloth.particles = start;
+}
+
+// Times the vertex normals of a frame as the renderer used to get them (a
+// halfedge fan walk for every triangle corner) against the normal cache, for
+// growing thread counts, and reports how far apart they are. The cache sums
+// exactly the triangles around each vertex; the fan walk follows the twin
+// links of the mesh, which stray off that ring for some vertices, so the two
+// differ slightly on a curved sheet.
+void bench_normals(Cloth &cloth, const ParticleStore &start, int num_steps, int max_threads) {
+  cloth.particles = start;
+  int num_triangles = cloth.clothMesh->triangles.size();
+  vector<Vector3D> corners(3 * num_triangles);
+
+  Clock::time_point t0 = Clock::now();
+  for (int k = 0; k < num_steps; k++) {
+    for (int i = 0; i < num_triangles; i++) {
+      Triangle *tri = cloth.clothMesh->triangles[i];
+      corners[3 * i] = tri->pm1->normal();
+      corners[3 * i + 1] = tri->pm2->normal();
+      corners[3 * i + 2] = tri->pm3->normal();
+    }
+  }
+  double fan_ms = elapsed_ms(t0) / num_steps;
+  VertexNormals normals;
+  normals.build(cloth.clothMesh, cloth.particles.size());
+  printf("%8s %14s %8s %14s\n", "threads", "normals ms", "speedup", "max difference");
+  printf("%8s %14.3f %7.2fx %14s\n", "fan walk", fan_ms, 1.0, "-");
+
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    t0 = Clock::now();
+    for (int k = 0; k < num_steps; k++) {
+      normals.update(cloth.particles, threads);
+    }
+    double cache_ms = elapsed_ms(t0) / num_steps;
+
+    double difference = 0;
+    for (int i = 0; i < num_triangles; i++) {
+      Triangle *tri = cloth.clothMesh->triangles[i];
+      const PointMass *pms[3] = {tri->pm1, tri->pm2, tri->pm3};
+      for (int k = 0; k < 3; k++) {
+        Vector3D d = corners[3 * i + k] - normals.normals[pms[k]->index];
+        difference = max(difference, d.norm());
+      }
+    }
+    printf("%8d %14.3f %7.2fx %14g\n", threads, cache_ms, fan_ms / cache_ms, difference);
+  }
+}
+
+// Times the spatial hash rebuild on its own, then the whole collision pass
+// (rebuild, Jacobi self-collision and collision objects) for growing thread
+// counts, and reports the number of candidate neighbors whose distance is
+// tested per point.
+void bench_self_collision(Cloth &cloth, const ParticleStore &start,
+                          int num_steps, int max_threads) {
+  double simulation_steps = 30;
+  vector<CollisionObject *> collision_objects;
+
+  cloth.particles = start;
+  double hash_ms = 0;
+  for (int k = 0; k < num_steps; k++) {
+    Clock::time_point t0 = Clock::now();
+    cloth.build_spatial_map();
+    hash_ms += elapsed_ms(t0) / num_steps;
+  }
+
+  long tests = 0;
+  for (int i = 0; i < (int)cloth.particles.size(); i++) {
+    cloth.spatial_hash.for_each_neighbor(cloth.particles.get_position(i),
+                                         [&](int j) { tests += j != i; });
+  }
+  printf("hash rebuild %.3f ms, %.2f distance tests per point\n", hash_ms,
+         (double)tests / cloth.particles.size());
+
+  printf("%8s %14s %8s %14s\n", "threads", "collide ms", "speedup",
+         "deterministic");
+
+  vector<Vector3D> reference;
+  double base_collide = 0;
+
+  vector<int> thread_counts;
+  for (int t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+  thread_counts.push_back(max_threads);
+
+  for (int threads : thread_counts) {
+    cloth.particles = start;
+    double collide_ms = 0;
+    for (int k = 0; k < num_steps; k++) {
+      Clock::time_point t0 = Clock::now();
+      cloth.collide(simulation_steps, &collision_objects, threads);
+      collide_ms += elapsed_ms(t0) / num_steps;
+    }
+
+    if (reference.empty()) {
+      reference = positions(cloth.particles);
+      base_collide = collide_ms;
+    }
+    bool deterministic = reference == positions(cloth.particles);
+
+    printf("%8d %14.3f %7.2fx %14s\n", threads, collide_ms,
+           base_collide / collide_ms, deterministic ? "yes" : "NO");
+  }
+
+  cloth.particles = start;
+}
+
+// Collides every point with a sphere that only touches a corner of the sheet
+// and a plane under it, once through the single-point collide and once
+// through the batched one, and checks that both give the same positions.
+void bench_collision_objects(const ParticleStore &start, int num_steps) {
+  vector<Vector3D> last = positions(start);
+  vector<Vector3D> moved = last;
+  for (Vector3D &p : moved) { p.y -= 0.01; }
+
+  Sphere sphere(Vector3D(0, start.get_position(0).y, 0), 0.1, 0.3, 4, 4);
+  Plane plane(Vector3D(0, -1, 0), Vector3D(0, 1, 0), 0.5);
+  vector<CollisionObject *> collision_objects = {&sphere, &plane};
+  long num_points = moved.size();
+
+  vector<Vector3D> single, batched;
+  double single_ms = 0, batched_ms = 0;
+  for (int k = 0; k < num_steps; k++) {
+    single = moved;
+    Clock::time_point t0 = Clock::now();
+    for (long i = 0; i < num_points; i++) {
+      for (auto &primitive : collision_objects) { primitive->collide(single[i], last[i]); }
+    }
+    single_ms += elapsed_ms(t0) / num_steps;
+
+    batched = moved;
+    t0 = Clock::now();
+    for (long i = 0; i < num_points; i += Kernels::BLOCK_SIZE) {
+      long count = min(Kernels::BLOCK_SIZE, num_points - i);
+      for (auto &primitive : collision_objects) {
+        primitive->collide(&batched[i], &last[i], count);
+      }
+    }
+    batched_ms += elapsed_ms(t0) / num_steps;
+  }
+
+  printf("collision objects: single point %.3f ms, batched %.3f ms (%.2fx), %s\n",
+         single_ms, batched_ms, single_ms / batched_ms,
+         single == batched ? "identical" : "DIFFERENT");
+}
+
+// Collides the sheet with many small objects scattered around it, testing
+// every object against every block of points and then only the objects the
+// broadphase grid finds near each batch.
+void bench_broadphase(const ParticleStore &start, const char *name,
+                      const vector<CollisionObject *> &collision_objects, int num_steps) {
+  vector<Vector3D> last = positions(start);
+  vector<Vector3D> moved = last;
+  for (Vector3D &p : moved) { p.y -= 0.01; }
+  long num_points = moved.size();
+
+  CollisionGrid grid;
+  vector<int> candidates;
+  vector<Vector3D> brute, culled;
+  double brute_ms = 0, update_ms = 0, culled_ms = 0;
+  for (int k = 0; k < num_steps; k++) {
+    brute = moved;
+    Clock::time_point t0 = Clock::now();
+    for (long i = 0; i < num_points; i += Kernels::BLOCK_SIZE) {
+      long count = min(Kernels::BLOCK_SIZE, num_points - i);
+      for (auto &primitive : collision_objects) {
+        primitive->collide(&brute[i], &last[i], count);
+      }
+    }
+    brute_ms += elapsed_ms(t0) / num_steps;
+
+    culled = moved;
+    t0 = Clock::now();
+    grid.update(collision_objects);
+    update_ms += elapsed_ms(t0) / num_steps;
+    t0 = Clock::now();
+    for (long i = 0; i < num_points; i += Kernels::BLOCK_SIZE) {
+      long count = min(Kernels::BLOCK_SIZE, num_points - i);
+      grid.collide(collision_objects, &culled[i], &last[i], count, candidates);
+    }
+    culled_ms += elapsed_ms(t0) / num_steps;
+  }
+
+  // A point pushed by one object into another that was not near its batch
+  // is only caught on the next substep, so a few points may differ
+  long differ = 0;
+  for (long i = 0; i < num_points; i++) { differ += !(brute[i] == culled[i]); }
+  printf("%d %s: all objects %.3f ms, broadphase %.3f ms + %.3f ms update "
+         "(%d builds, %.2fx), %ld of %ld points differ\n",
+         (int)collision_objects.size(), name, brute_ms, culled_ms, update_ms, grid.builds,
+         brute_ms / (culled_ms + update_ms), differ, num_points);
+}
+
+// Builds the hierarchy of a terrain of about a million triangles that
+// touches the sheet, writes it to disk and reads it back, then collides the
+// sheet with the mesh and checks that no path goes through it.
+void bench_triangle_mesh(const ParticleStore &start, int num_steps) {
+  vector<Vector3D> last = positions(start);
+  vector<Vector3D> moved = last;
+  for (Vector3D &p : moved) { p.y -= 0.01; }
+  long num_points = moved.size();
+  double height = start.get_position(0).y;
+
+  const int n = 708;
+  vector<Vector3D> vertices;
+  vector<int> indices;
+  for (int j = 0; j <= n; j++) {
+    for (int i = 0; i <= n; i++) {
+      double x = 1.2 * i / n - 0.1, z = 1.2 * j / n - 0.1;
+      vertices.push_back(Vector3D(x, height - 0.03 + 0.03 * sin(13 * x) * cos(9 * z), z));
+    }
+  }
+  for (int j = 0; j < n; j++) {
+    for (int i = 0; i < n; i++) {
+      int a = j * (n + 1) + i, b = a + 1, c = a + n + 1, d = c + 1;
+      int quad[6] = {a, c, d, a, d, b};
+      indices.insert(indices.end(), quad, quad + 6);
+    }
+  }
+
+  Clock::time_point t0 = Clock::now();
+  TriangleMesh mesh(vertices, indices, 0.3, 0.002);
+  double build_ms = elapsed_ms(t0);
+
+  const char *cache = "clothsim_bench.bvh";
+  mesh.bvh.save(cache, 184);
+  MeshBVH loaded;
+  t0 = Clock::now();
+  bool ok = loaded.load(cache, 184);
+  double load_ms = elapsed_ms(t0);
+  remove(cache);
+  ok = ok && loaded.nodes.size() == mesh.bvh.nodes.size() &&
+       loaded.triangles.size() == mesh.bvh.triangles.size();
+
+  vector<Vector3D> collided;
+  double collide_ms = 0;
+  for (int k = 0; k < num_steps; k++) {
+    collided = moved;
+    t0 = Clock::now();
+    for (long i = 0; i < num_points; i += Kernels::BLOCK_SIZE) {
+      long count = min(Kernels::BLOCK_SIZE, num_points - i);
+      mesh.collide(&collided[i], &last[i], count);
+    }
+    collide_ms += elapsed_ms(t0) / num_steps;
+  }
+
+  // Paths through the surface left after the collision, found with a ray
+  // test against every triangle under the point
+  long through = 0;
+  for (long i = 0; i < num_points; i++) {
+    BBox path(last[i]);
+    path.expand(collided[i]);
+    mesh.bvh.query(path, [&](int t) {
+      const MeshBVH::Triangle &tri = mesh.bvh.triangles[t];
+      double s;
+      through += ray_triangle(last[i], collided[i] - last[i], tri.a, tri.b, tri.c, s) && s <= 1;
+    });
+  }
+
+  printf("%zu triangle mesh: build %.1f ms, load %.1f ms (%s), collide %.3f ms, "
+         "%ld of %ld paths through it\n",
+         mesh.bvh.triangles.size(), build_ms, load_ms, ok ? "identical" : "DIFFERENT",
+         collide_ms, through, num_points);
+}
+
+// Benchmarks the mass-spring step on a large hanging sheet: first the scalar
+// and SIMD kernels against each other in both precisions, then the scaling of
+// the parallel passes with the number of threads, then full substeps with
+// double and float storage, and finally the collision passes.
+int main(int argc, char **argv) {
+  int num_points = 500;
+  int num_steps = 20;
+  int max_threads = ThreadUtils::max_threads();
+  int accuracy_steps = 900;
+
+  int c;
+  while ((c = getopt(argc, argv, "n:s:t:a:")) != -1) {
+    switch (c) {
+      case 'n':
+        num_points = max(3, atoi(optarg));
+        break;
+      case 's':
+        num_steps = max(1, atoi(optarg));
+        break;
+      case 't':
+        max_threads = max(1, atoi(optarg));
+        break;
+      case 'a':
+        accuracy_steps = max(1, atoi(optarg));
+        break;
+      default:
+        usageError(argv[0]);
+        break;
+    }
+  }
+
+  Cloth cloth;
+  cloth.width = 1;
+  cloth.height = 1;
+  cloth.num_width_points = num_points;
+  cloth.num_height_points = num_points;
+  // Same thickness relative to the grid spacing as the 50x50 scenes, so that
+  // self-collision sees a realistic number of neighbors at any resolution
+  cloth.thickness = 0.0095 * 49 / (num_points - 1);
+  cloth.orientation = HORIZONTAL;
+  cloth.pinned = {{0, 0}, {num_points - 1, 0}};
+  cloth.buildGrid();
+  cloth.buildClothMesh();
+
+  ClothParameters cp(true, true, true, 0.2, 150.0, 5000.0);
+  vector<Vector3D> external_accelerations = {Vector3D(0, -9.8, 0)};
+  vector<CollisionObject *> collision_objects;
+
+  // Let the sheet sag a little so that the springs are actually stretched
+  for (int i = 0; i < 10; i++) {
+    cloth.simulate(90, 30, &cp, external_accelerations, &collision_objects);
+  }
+  ParticleStore start = cloth.particles;
+
+  cout << "[ClothSim] " << cloth.particles.size() << " point masses, "
+       << cloth.springs.size() << " springs, " << num_steps << " steps" << endl;
+
+  double base_forces = 0, base_verlet = 0, base_strain = 0;
+  bench_kernels(cloth, cp, external_accelerations, start, num_steps,
+                base_forces, base_verlet, base_strain);
+  printf("\n");
+  ParticleStore start_f = start;
+  start_f.set_precision(SINGLE_PRECISION);
+  bench_kernels(cloth, cp, external_accelerations, start_f, num_steps,
+                base_forces, base_verlet, base_strain);
+  printf("\n");
+  bench_threads(cloth, cp, external_accelerations, start, num_steps, max_threads);
+  printf("\n");
+  bench_precision(cloth, cp, external_accelerations, start, accuracy_steps);
+  printf("\n");
+  bench_self_collision(cloth, start, num_steps, max_threads);
+  printf("\n");
+  bench_normals(cloth, start, num_steps, max_threads);
+  printf("\n");
+  bench_collision_objects(start, num_steps);
+
+  // Hailstones, and the capsules of a branch skeleton
+  srand(184);
+  vector<Sphere> spheres;
+  for (int k = 0; k < 4000; k++) {
+    Vector3D origin(1.2 * rand() / RAND_MAX - 0.1, 0.9 + 0.2 * rand() / RAND_MAX,
+                    1.2 * rand() / RAND_MAX - 0.1);
+    spheres.push_back(Sphere(origin, 0.005 + 0.01 * rand() / RAND_MAX, 0.3, 4, 4));
+  }
+  vector<Capsule> capsules;
+  for (int k = 0; k < 500; k++) {
+    Vector3D a(1.2 * rand() / RAND_MAX - 0.1, 0.9 + 0.2 * rand() / RAND_MAX,
+               1.2 * rand() / RAND_MAX - 0.1);
+    Vector3D d(rand() - RAND_MAX / 2.0, 0.2 * (rand() - RAND_MAX / 2.0), rand() - RAND_MAX / 2.0);
+    capsules.push_back(Capsule(a, a + 0.1 * d.unit(), 0.01, 0.4, 4, 4));
+  }
+  vector<CollisionObject *> sphere_objects, capsule_objects;
+  for (Sphere &s : spheres) { sphere_objects.push_back(&s); }
+  for (Capsule &c : capsules) { capsule_objects.push_back(&c); }
+  bench_broadphase(start, "spheres", sphere_objects, num_steps);
+  bench_broadphase(start, "capsules", capsule_objects, num_steps);
+  printf("\n");
+  bench_triangle_mesh(start, num_steps);
+
+  return 0;
+}
@@ -6,6 +6,7 @@
 #include "cloth.h"
 #include "collision/plane.h"
 #include "collision/sphere.h"
+#include "misc/thread_utils.h"
 
 using namespace std;
 
@@ -23,6 +24,7 @@ Cloth::Cloth(double width, double height, int num_width_points,
 
 Cloth::~Cloth() {
   point_masses.clear();
+  particles.clear();
   springs.clear();
 
   if (clothMesh) {
@@ -40,12 +42,15 @@ void Cloth::buildGrid() {
     }
     double xSpace = static_cast<double>(width) / (num_width_points - 1);
     double otherSpace = static_cast<double>(height) / (num_height_points - 1);
+    particles.reserve(num_width_points * num_height_points);
+    point_masses.reserve(num_width_points * num_height_points);
     //Set the y coordinate for all point masses to 1 while varying positions over the xz plane
     if (this->orientation == HORIZONTAL) {
         for (int z = 0; z < num_height_points; z++) {
             for (int x = 0; x < num_width_points; x++) {
                 Vector3D position = Vector3D(x * xSpace, 1, z * otherSpace);
-                point_masses.emplace_back(PointMass(position, pin[x][z]));
+                int index = particles.add(position, pin[x][z]);
+                point_masses.emplace_back(PointMass(&particles, index));
             }
         }
     }
@@ -55,156 +60,296 @@ void Cloth::buildGrid() {
             for (int x = 0; x < num_width_points; x++) {
                 double zOffSet = -0.001 + static_cast<double>(rand()) / (static_cast<double>(RAND_MAX) / 0.002);
                 Vector3D position = Vector3D(x * xSpace, y * otherSpace, zOffSet);
-                point_masses.emplace_back(PointMass(position, pin[x][y]));
+                int index = particles.add(position, pin[x][y]);
+                point_masses.emplace_back(PointMass(&particles, index));
             }
         }
     }
     // add springs
+    auto add_spring = [this](int a, int b, e_spring_type type) {
+        float rest_length = (particles.get_position(a) - particles.get_position(b)).norm();
+        springs.add(a, b, rest_length, type);
+    };
     for (int j = 0; j < num_height_points; j++) {
         for (int i = 0; i < num_width_points; i++) {
-            PointMass *p = &point_masses[j * num_width_points + i];
+            int p = j * num_width_points + i;
 
             // Structural Constraint with point mass to left ( i - 1) and above (j - 1)
-            if (i - 1 >= 0) { springs.emplace_back(Spring(p, &point_masses[j * num_width_points + (i-1)], STRUCTURAL)); }
-            if (j - 1 >= 0) { springs.emplace_back(Spring(p, &point_masses[(j - 1) * num_width_points + i], STRUCTURAL)); }
+            if (i - 1 >= 0) { add_spring(p, j * num_width_points + (i-1), STRUCTURAL); }
+            if (j - 1 >= 0) { add_spring(p, (j - 1) * num_width_points + i, STRUCTURAL); }
 
             // Shearing Constraint with point mass to diagonal upper left and upper right (i-1, j-1), (i+1, j-1)
-            if (i - 1 >= 0 && j - 1 >= 0) { springs.emplace_back(Spring(p, &point_masses[(j - 1) * num_width_points + (i - 1)], SHEARING)); }
-            if (i + 1 < num_width_points && j - 1 >= 0) { springs.emplace_back(Spring(p, &point_masses[(j - 1) * num_width_points + (i + 1)], SHEARING)); }
+            if (i - 1 >= 0 && j - 1 >= 0) { add_spring(p, (j - 1) * num_width_points + (i - 1), SHEARING); }
+            if (i + 1 < num_width_points && j - 1 >= 0) { add_spring(p, (j - 1) * num_width_points + (i + 1), SHEARING); }
 
             // Bending Constraint with point mass two to left and two above ( i - 2) (j - 2)
-            if (i - 2 >= 0) { springs.emplace_back(Spring(p, &point_masses[j * num_width_points + (i - 2)], BENDING)); }
-            if (j - 2 >= 0) { springs.emplace_back(Spring(p, &point_masses[(j - 2) * num_width_points + i], BENDING)); }
+            if (i - 2 >= 0) { add_spring(p, j * num_width_points + (i - 2), BENDING); }
+            if (j - 2 >= 0) { add_spring(p, (j - 2) * num_width_points + i, BENDING); }
 
         }
         
     }
+    // Group springs by type and order them by endpoint
+    springs.build(particles.size());
+    projective.invalidate();
 
 
 }
 
+void Cloth::buildGrid(ClothParameters *cp, double frames_per_sec, double simulation_steps) {
+  buildGrid();
+  prepare(cp, frames_per_sec, simulation_steps);
+}
+
+double Cloth::point_mass(const ClothParameters *cp) const {
+  return width * height * cp->density / num_width_points / num_height_points;
+}
+
+void Cloth::prepare(ClothParameters *cp, double frames_per_sec, double simulation_steps) {
+  double mass = point_mass(cp);
+  if (mass != particles.mass) { particles.set_mass(mass); }
+  if (cp->integrator == PROJECTIVE_DYNAMICS) {
+    projective.factor(this, cp, 1.0f / frames_per_sec / simulation_steps);
+  }
+}
+
 void Cloth::simulate(double frames_per_sec, double simulation_steps, ClothParameters *cp,
                      vector<Vector3D> external_accelerations,
                      vector<CollisionObject *> *collision_objects) {
-  double mass = width * height * cp->density / num_width_points / num_height_points;
+  double mass = point_mass(cp);
   double delta_t = 1.0f / frames_per_sec / simulation_steps;
+  if (mass != particles.mass) { particles.set_mass(mass); }
+  int num_threads = ThreadUtils::resolve_num_threads(cp->num_threads);
+
   // TODO (Part 2): Compute total force acting on each point mass.
-  Vector3D totalForce = Vector3D();
-  for (auto &a: external_accelerations) {  totalForce += mass * a;  }
-  
-  for (auto &p : point_masses) {
-      p.forces = totalForce; 
+  accumulate_forces(cp, external_accelerations, num_threads);
+
+  // TODO (Part 2): Use Verlet integration to compute new point mass positions
+  if (cp->integrator == IMPLICIT_EULER) {
+    implicit.step(this, cp, delta_t, num_threads);
+  } else {
+    integrate(cp, delta_t, num_threads);
   }
 
-  // Calculate Forces for Point Masses Connected By Springs
-  for (auto &s : springs) {
-      double springForceMagnitude = 0.0;
-      if (s.spring_type == STRUCTURAL && cp->enable_structural_constraints == true || (s.spring_type == SHEARING && cp->enable_shearing_constraints == true)) {
-          springForceMagnitude = cp->ks * ((s.pm_a->position - s.pm_b->position).norm() - s.rest_length);
-      }
-      else if (s.spring_type == BENDING && cp->enable_bending_constraints == true) {
-          springForceMagnitude = (cp->ks * 0.2) * ((s.pm_a->position - s.pm_b->position).norm() - s.rest_length);
-      }
-      Vector3D springForce = springForceMagnitude * (s.pm_a->position - s.pm_b->position).unit();
-      // apply b -> a force
-      s.pm_b->forces += springForce;
-      // apply a -> b force
-      s.pm_a->forces += springForce * (-1);
+  // TODO (Part 2): Constrain the changes to be such that the spring does not change
+  // in length more than 10% per timestep [Provot 1995].
+  if (cp->integrator == POSITION_BASED) {
+    xpbd.project(this, cp, delta_t, num_threads);
+  } else if (cp->integrator == PROJECTIVE_DYNAMICS) {
+    projective.solve(this, cp, delta_t, num_threads);
+  } else {
+    limit_strain(cp, num_threads);
   }
-  // TODO (Part 2): Use Verlet integration to compute new point mass positions
-  for (auto &p : point_masses) {
-     //printf("Force: (%f, %f, %f )\n", p.forces.x, p.forces.y, p.forces.z);
-      if (p.pinned == true) {  continue;  }
-      Vector3D newPos = p.position + (1.0 - (cp->damping / 100.0)) * (p.position - p.last_position) + (p.forces / mass) * delta_t * delta_t;
-      p.last_position = p.position;
-      p.position = newPos;
-      
 
+  // TODO (Part 3): Handle collisions with other primitives.
+  // TODO (Part 4): Handle self-collisions.
+  time += delta_t;
+  for (CollisionObject *co : *collision_objects) {
+    co->move_to(time);
   }
-  for (auto& s : springs) {
-
-      double dist = (s.pm_a->position - s.pm_b->position).norm();
-      if (dist <= s.rest_length * 1.10) { continue; }
-      double clamp = dist - (s.rest_length * 1.10);
-      // a pinned => apply full clamp to b
-      if (s.pm_a->pinned == true && s.pm_b->pinned == false) {
-          s.pm_b->position += (s.pm_a->position - s.pm_b->position).unit() * clamp;
-      }
-      // b pinned => apply full clamp to a
-      else if (s.pm_b->pinned == true && s.pm_a->pinned == false) {
-          s.pm_a->position += (s.pm_b->position - s.pm_a->position).unit() * clamp;
-      }
-      // neither pinned => apply half the clamp to each 
-      else if (s.pm_b->pinned == false && s.pm_a->pinned == false) {
-          s.pm_a->position += (s.pm_b->position - s.pm_a->position).unit() * 0.5 * clamp;
-          s.pm_b->position += (s.pm_a->position - s.pm_b->position).unit() * 0.5 * clamp;
+  collide(simulation_steps, collision_objects, num_threads);
+  if (cp->continuous_collision) { ccd.resolve(this, cp, num_threads); }
+}
+
+// The step passes are written once for both storage precisions; the Cloth
+// methods below pick the instantiation matching particles.precision.
+
+template <typename Real>
+static void accumulate_forces_pass(const SpringBuffer &springs, ClothParameters *cp,
+                                   const Kernels::KernelSet<Real> &kernels,
+                                   const Vector3D &totalForce, const Real *position,
+                                   double *forces, int num_points, int num_threads) {
+  // Under XPBD and projective dynamics the springs are constraints or
+  // energies of the solver, and only external forces act
+  bool spring_forces = cp->integrator != POSITION_BASED &&
+                       cp->integrator != PROJECTIVE_DYNAMICS;
+
+  #pragma omp parallel num_threads(num_threads)
+  {
+    #pragma omp for schedule(static)
+    for (int i = 0; i < num_points; i++) {
+        forces[3 * i] = totalForce.x;
+        forces[3 * i + 1] = totalForce.y;
+        forces[3 * i + 2] = totalForce.z;
+    }
+
+    // Calculate Forces for Point Masses Connected By Springs. Springs of one
+    // color never share a point mass, so each color is scattered in parallel
+    // blocks; colors always run in the same order, which keeps every
+    // per-point sum (and therefore the result) independent of the thread count.
+    for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+        e_spring_type type = (e_spring_type)t;
+        if (!spring_forces || !cp->is_enabled(type)) { continue; }
+        double ks = (type == BENDING) ? cp->ks * 0.2 : cp->ks;
+        for (int c = 0; c < springs.num_colors(type); c++) {
+            long begin = springs.color_begin(type, c);
+            long end = springs.color_end(type, c);
+            #pragma omp for schedule(static)
+            for (long k = begin; k < end; k += Kernels::BLOCK_SIZE) {
+                long count = min(Kernels::BLOCK_SIZE, end - k);
+                kernels.spring_forces(&springs[k], count, ks, position, forces);
+            }
+        }
+    }
+  }
+}
+
+template <typename Real>
+static void integrate_pass(const Kernels::KernelSet<Real> &kernels, double damping,
+                           double dt2, const double *inv_mass, const double *forces,
+                           Real *position, Real *last_position, long num_points,
+                           int num_threads) {
+  // pinned point masses have zero inverse mass and are skipped by the kernel
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long i = 0; i < num_points; i += Kernels::BLOCK_SIZE) {
+      long end = min(i + Kernels::BLOCK_SIZE, num_points);
+      kernels.verlet(i, end, damping, dt2, inv_mass, forces, position, last_position);
+  }
+}
+
+template <typename Real>
+static void limit_strain_pass(const SpringBuffer &springs, ClothParameters *cp,
+                              const Kernels::KernelSet<Real> &kernels,
+                              const double *inv_mass, Real *position, int num_threads) {
+  double max_stretch = 1.0 + cp->max_strain;
+
+  // Colored Gauss-Seidel: springs of one color share no point mass, so each
+  // color is clamped in parallel and the sweep gives the same result as a
+  // serial pass over the spring buffer, whatever the thread count. The clamp
+  // is split between the endpoints by inverse mass, so a pinned endpoint
+  // stays put and the other one takes the full clamp.
+  #pragma omp parallel num_threads(num_threads)
+  for (int iter = 0; iter < cp->strain_limit_iterations; iter++) {
+    for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+      e_spring_type type = (e_spring_type)t;
+      for (int c = 0; c < springs.num_colors(type); c++) {
+        long begin = springs.color_begin(type, c);
+        long end = springs.color_end(type, c);
+        #pragma omp for schedule(static)
+        for (long k = begin; k < end; k += Kernels::BLOCK_SIZE) {
+            long count = min(Kernels::BLOCK_SIZE, end - k);
+            kernels.limit_strain(&springs[k], count, max_stretch, inv_mass, position);
+        }
       }
+    }
   }
-  
-  // TODO (Part 3): Handle collisions with other primitives.
-  build_spatial_map();
-  for (auto& p : point_masses) { 
-      this->self_collide(p, simulation_steps); 
-      for (auto& primitive : *collision_objects) { primitive->collide(p); }
+}
+
+void Cloth::accumulate_forces(ClothParameters *cp,
+                              const vector<Vector3D> &external_accelerations,
+                              int num_threads) {
+  const Kernels::KernelTable &kernels = Kernels::select(cp->simd);
+  int num_points = (int)particles.size();
+
+  // Forces are summed in double whatever the storage precision
+  Vector3D totalForce = Vector3D();
+  for (auto &a: external_accelerations) {  totalForce += particles.mass * a;  }
+
+  if (particles.precision == SINGLE_PRECISION) {
+    accumulate_forces_pass(springs, cp, kernels.get<float>(), totalForce,
+                           particles.position_f.data(), Kernels::coords(particles.forces),
+                           num_points, num_threads);
+  } else {
+    accumulate_forces_pass(springs, cp, kernels.get<double>(), totalForce,
+                           Kernels::coords(particles.position),
+                           Kernels::coords(particles.forces), num_points, num_threads);
   }
- 
-  // TODO (Part 4): Handle self-collisions.
+}
 
+void Cloth::integrate(ClothParameters *cp, double delta_t, int num_threads) {
+  const Kernels::KernelTable &kernels = Kernels::select(cp->simd);
+  const double *inv_mass = particles.inv_mass.data();
+  long num_points = particles.size();
+
+  double damping = 1.0 - (cp->damping / 100.0);
+  double dt2 = delta_t * delta_t;
+  if (particles.precision == SINGLE_PRECISION) {
+    integrate_pass(kernels.get<float>(), damping, dt2, inv_mass,
+                   Kernels::coords(particles.forces), particles.position_f.data(),
+                   particles.last_position_f.data(), num_points, num_threads);
+  } else {
+    integrate_pass(kernels.get<double>(), damping, dt2, inv_mass,
+                   Kernels::coords(particles.forces), Kernels::coords(particles.position),
+                   Kernels::coords(particles.last_position), num_points, num_threads);
+  }
+}
 
-  
-  // TODO (Part 2): Constrain the changes to be such that the spring does not change
-  // in length more than 10% per timestep [Provot 1995].
-  
+void Cloth::limit_strain(ClothParameters *cp, int num_threads) {
+  const Kernels::KernelTable &kernels = Kernels::select(cp->simd);
+  const double *inv_mass = particles.inv_mass.data();
+  if (particles.precision == SINGLE_PRECISION) {
+    limit_strain_pass(springs, cp, kernels.get<float>(), inv_mass,
+                      particles.position_f.data(), num_threads);
+  } else {
+    limit_strain_pass(springs, cp, kernels.get<double>(), inv_mass,
+                      Kernels::coords(particles.position), num_threads);
+  }
 }
 
-void Cloth::build_spatial_map() {
-  for (const auto &entry : map) {
-    delete(entry.second);
+void Cloth::collide(double simulation_steps,
+                    vector<CollisionObject *> *collision_objects, int num_threads) {
+  long num_points = particles.size();
+  build_spatial_map();
+  collision_grid.update(*collision_objects);
+  self_corrections.resize(num_points);
+
+  // Jacobi self-collision: every correction is computed from the positions
+  // before any of them is applied, so the result does not depend on the
+  // order (or the number of threads) in which the points are visited. Each
+  // point only writes its own entry of self_corrections. Collision responses
+  // are computed in double whatever the storage precision.
+  #pragma omp parallel num_threads(num_threads)
+  {
+    #pragma omp for schedule(static)
+    for (long i = 0; i < num_points; i++) {
+        self_corrections[i] = self_collide(i, simulation_steps);
+    }
+
+    // Collision objects see batches of points gathered in double precision,
+    // and only the objects near a batch are called
+    vector<Vector3D> position(Kernels::BLOCK_SIZE), last_position(Kernels::BLOCK_SIZE);
+    vector<int> candidates;
+
+    #pragma omp for schedule(static)
+    for (long begin = 0; begin < num_points; begin += Kernels::BLOCK_SIZE) {
+        long count = min(Kernels::BLOCK_SIZE, num_points - begin);
+        for (long k = 0; k < count; k++) {
+            position[k] = particles.get_position(begin + k) + self_corrections[begin + k];
+            last_position[k] = particles.get_last_position(begin + k);
+        }
+        collision_grid.collide(*collision_objects, position.data(), last_position.data(),
+                               count, candidates);
+        for (long k = 0; k < count; k++) { particles.set_position(begin + k, position[k]); }
+    }
   }
-  map.clear();
+}
 
+void Cloth::build_spatial_map() {
   // TODO (Part 4): Build a spatial map out of all of the point masses.
-  for (auto &p : point_masses ) { 
-      float key = hash_position(p.position);
-      vector<PointMass*>* ptr = new vector<PointMass*>;
-      map.try_emplace(key, new vector<PointMass*>);
-      if (map[key] != ptr) { delete(ptr); }
-      map[key]->push_back(&p);
-  }
+  // Points interact within 2 * thickness, so with cells of that size every
+  // contact of a point lies in its 27-cell neighborhood
+  spatial_hash.build(particles, 2 * thickness);
 }
 
-void Cloth::self_collide(PointMass &pm, double simulation_steps) {
+Vector3D Cloth::self_collide(int i, double simulation_steps) const {
   // TODO (Part 4): Handle self-collision for a given point mass.
-    float key = hash_position(pm.position);
-    vector<PointMass*> neighbors = *map[key];
+    Vector3D position = particles.get_position(i);
     Vector3D correction = Vector3D(0, 0, 0);
     int count = 0;
-    for (auto neighbor : neighbors) {
-        double dist = (pm.position - neighbor->position).norm();
-        if (neighbor == &pm || dist >= 2 * thickness)  { continue; }
-        correction +=  ((2 * thickness - dist) * (pm.position - neighbor->position).unit());
+    spatial_hash.for_each_neighbor(position, [&](int j) {
+        Vector3D d = position - particles.get_position(j);
+        double dist = d.norm();
+        if (j == i || dist >= 2 * thickness)  { return; }
+        correction +=  ((2 * thickness - dist) * d.unit());
         count += 1;
-    }
-    if (count == 0) { return; }
-    correction = (correction) / (count * simulation_steps);
-    pm.position += correction;
+    });
+    if (count == 0) { return Vector3D(0, 0, 0); }
+    return correction / (count * simulation_steps);
 }
 
-float Cloth::hash_position(Vector3D pos) {
+uint64_t Cloth::hash_position(Vector3D pos) {
   // TODO (Part 4): Hash a 3D position into a unique float identifier that represents membership in some 3D box volume.
-    double w = 3 * width / num_width_points;
-    double h = 3 * height / num_height_points;
-    double t = max(w, h);
-    
-    double x = pos.x / w;
-    double y = pos.y / h;
-    double z = pos.z / t;
-
-    if (isnan(x) || isinf(x)) { x = 0; }
-    if (isnan(y) || isinf(y)) { y = 0; }
-    if (isnan(z) || isinf(z)){ z = 0; }
-
-    return  (floor(x) * 157.0) + (floor(y) * 63.0) + (floor(z) * 1201);
+  return spatial_hash.key(pos);
 }
 
 ///////////////////////////////////////////////////////
@@ -212,12 +357,8 @@ float Cloth::hash_position(Vector3D pos) {
 ///////////////////////////////////////////////////////
 
 void Cloth::reset() {
-  PointMass *pm = &point_masses[0];
-  for (int i = 0; i < point_masses.size(); i++) {
-    pm->position = pm->start_position;
-    pm->last_position = pm->start_position;
-    pm++;
-  }
+  particles.reset();
+  time = 0;
 }
 
 void Cloth::buildClothMesh() {
@@ -370,4 +511,5 @@ void Cloth::buildClothMesh() {
 
   clothMesh->triangles = triangles;
   this->clothMesh = clothMesh;
+  ccd.invalidate();
 }
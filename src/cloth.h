@@ -9,7 +9,16 @@
 #include "CGL/CGL.h"
 #include "CGL/misc.h"
 #include "clothMesh.h"
+#include "collision/collisionGrid.h"
 #include "collision/collisionObject.h"
+#include "collision/continuousCollision.h"
+#include "kernels/kernels.h"
+#include "particleStore.h"
+#include "solvers/implicitEuler.h"
+#include "solvers/projectiveDynamics.h"
+#include "solvers/substepController.h"
+#include "solvers/xpbd.h"
+#include "spatialHash.h"
 #include "spring.h"
 
 using namespace CGL;
@@ -17,6 +26,13 @@ using namespace std;
 
 enum e_orientation { HORIZONTAL = 0, VERTICAL = 1 };
 
+enum e_integrator {
+  EXPLICIT_VERLET = 0,
+  IMPLICIT_EULER = 1,
+  POSITION_BASED = 2,
+  PROJECTIVE_DYNAMICS = 3
+};
+
 struct ClothParameters {
   ClothParameters() {}
   ClothParameters(bool enable_structural_constraints,
@@ -29,6 +45,15 @@ struct ClothParameters {
         damping(damping), density(density), ks(ks) {}
   ~ClothParameters() {}
 
+  bool is_enabled(e_spring_type type) const {
+    switch (type) {
+    case STRUCTURAL: return enable_structural_constraints;
+    case SHEARING: return enable_shearing_constraints;
+    case BENDING: return enable_bending_constraints;
+    }
+    return false;
+  }
+
   // Global simulation parameters
 
   bool enable_structural_constraints;
@@ -40,6 +65,45 @@ struct ClothParameters {
   // Mass-spring parameters
   double density;
   double ks;
+
+  // Provot strain limiting: springs are clamped to (1 + max_strain) times
+  // their rest length, strain_limit_iterations times per substep
+  double max_strain = 0.1;
+  int strain_limit_iterations = 1;
+
+  // Threads used by the parallel passes of Cloth::simulate; 0 uses all cores
+  int num_threads = 0;
+
+  // Widest SIMD instruction set the step kernels may use; the widest one the
+  // CPU supports up to this is picked at runtime
+  Kernels::e_isa simd = Kernels::ISA_AVX512;
+
+  // Time integration of the spring forces. The implicit integrator stays
+  // stable for stiff springs at 1-2 substeps per frame; its conjugate
+  // gradient solve stops after cg_max_iterations or once the residual drops
+  // below cg_tolerance times the right-hand side. POSITION_BASED treats the
+  // springs as XPBD constraints instead of forces, and PROJECTIVE_DYNAMICS
+  // as energies minimized with pd_iterations local/global iterations.
+  e_integrator integrator = EXPLICIT_VERLET;
+  int cg_max_iterations = 100;
+  double cg_tolerance = 1e-5;
+  int pd_iterations = 10;
+
+  // Adaptive substepping (see SubstepController): the substep count of each
+  // frame is chosen within [min_substeps, max_substeps] so that particles
+  // move at most cfl grid spacings and springs change their strain by at
+  // most max_strain_step per substep. Ignored by projective dynamics, which
+  // keeps simulation_steps.
+  bool adaptive_substeps = false;
+  int min_substeps = 2;
+  int max_substeps = 60;
+  double cfl = 0.5;
+  double max_strain_step = 0.02;
+
+  // Continuous triangle self-collision (see ContinuousCollision), repeated
+  // up to ccd_iterations times per substep, on top of the point repulsion
+  bool continuous_collision = false;
+  int ccd_iterations = 4;
 };
 
 struct Cloth {
@@ -49,17 +113,37 @@ struct Cloth {
   ~Cloth();
 
   void buildGrid();
+  // Builds the grid, then prepares the integrator for the parameters and
+  // substep count it will be simulated with, so that projective dynamics
+  // factors its system here rather than inside the first frame
+  void buildGrid(ClothParameters *cp, double frames_per_sec, double simulation_steps);
+
+  // Mass of each point mass under the given parameters
+  double point_mass(const ClothParameters *cp) const;
+  // Brings the state that depends on the parameters and the substep length
+  // up to date, e.g. after they were edited: the point mass and the
+  // projective dynamics factorization
+  void prepare(ClothParameters *cp, double frames_per_sec, double simulation_steps);
 
   void simulate(double frames_per_sec, double simulation_steps, ClothParameters *cp,
                 vector<Vector3D> external_accelerations,
                 vector<CollisionObject *> *collision_objects);
 
+  // Individual passes of simulate()
+  void accumulate_forces(ClothParameters *cp,
+                         const vector<Vector3D> &external_accelerations,
+                         int num_threads);
+  void integrate(ClothParameters *cp, double delta_t, int num_threads);
+  void limit_strain(ClothParameters *cp, int num_threads);
+  void collide(double simulation_steps,
+               vector<CollisionObject *> *collision_objects, int num_threads);
+
   void reset();
   void buildClothMesh();
 
   void build_spatial_map();
-  void self_collide(PointMass &pm, double simulation_steps);
-  float hash_position(Vector3D pos);
+  Vector3D self_collide(int i, double simulation_steps) const;
+  uint64_t hash_position(Vector3D pos);
 
   // Cloth properties
   double width;
@@ -70,13 +154,30 @@ struct Cloth {
   e_orientation orientation;
 
   // Cloth components
+  ParticleStore particles;
   vector<PointMass> point_masses;
   vector<vector<int>> pinned;
-  vector<Spring> springs;
-  ClothMesh *clothMesh;
+  SpringBuffer springs;
+  ClothMesh *clothMesh = nullptr;
+
+  // Integrator state
+  ImplicitEuler implicit;
+  XPBD xpbd;
+  ProjectiveDynamics projective;
+  SubstepController substep_controller;
+
+  // Spatial hashing, and the self-collision correction of every point
+  SpatialHash spatial_hash;
+  vector<Vector3D> self_corrections;
+
+  // Continuous self-collision
+  ContinuousCollision ccd;
+
+  // Broadphase over the collision objects
+  CollisionGrid collision_grid;
 
-  // Spatial hashing
-  unordered_map<float, vector<PointMass *> *> map;
+  // Simulated time since the last reset, which poses the moving colliders
+  double time = 0;
 };
 
 #endif /* CLOTH_H */
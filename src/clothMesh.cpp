@@ -12,7 +12,7 @@ Vector3D PointMass::normal() {
 
   // Loop CCW
   do {
-    n = n + cross(iter->next->pm->position - position, iter->next->next->pm->position - position);
+    n = n + cross(iter->next->pm->position() - position(), iter->next->next->pm->position() - position());
     if (iter->next->next->twin) {
       iter = iter->next->next->twin;
     } else {
@@ -26,7 +26,7 @@ Vector3D PointMass::normal() {
     iter = start;
     if (iter->twin) {
       do {
-        n = n + cross(iter->twin->next->next->pm->position - position, iter->twin->pm->position - position);
+        n = n + cross(iter->twin->next->next->pm->position() - position(), iter->twin->pm->position() - position());
         if (iter->twin->next->twin) {
           iter = iter->twin->next;
         } else {
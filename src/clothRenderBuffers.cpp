@@ -0,0 +1,194 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <vector>
+
+#include "clothRenderBuffers.h"
+#include "clothMesh.h"
+
+using namespace std;
+
+// Orphans the buffer and maps it for writing, or returns null if the driver
+// cannot map it
+static float *map_stream(GLuint buffer, size_t size) {
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  return (float *)glMapBufferRange(GL_ARRAY_BUFFER, 0, size,
+                                   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+void ClothRenderBuffers::build(const Cloth *cloth) {
+  free();
+  mesh = cloth->clothMesh;
+  num_vertices = cloth->point_masses.size();
+  num_triangles = mesh->triangles.size();
+  vertex_normals.build(mesh, num_vertices);
+
+  // A vertex is a point mass; its UV is the same in every triangle it is in
+  vector<uint32_t> indices(3 * num_triangles);
+  vector<float> vertex_uvs(2 * num_vertices, 0.0f);
+  for (int i = 0; i < num_triangles; i++) {
+    const Triangle *tri = mesh->triangles[i];
+    const PointMass *corners[3] = {tri->pm1, tri->pm2, tri->pm3};
+    const Vector3D *corner_uvs[3] = {&tri->uv1, &tri->uv2, &tri->uv3};
+    for (int k = 0; k < 3; k++) {
+      int v = corners[k]->index;
+      indices[3 * i + k] = v;
+      vertex_uvs[2 * v] = corner_uvs[k]->x;
+      vertex_uvs[2 * v + 1] = corner_uvs[k]->y;
+    }
+  }
+  vector<float> vertex_tangents(4 * num_vertices);
+  for (int v = 0; v < num_vertices; v++) {
+    float tangent[4] = {1.0f, 0.0f, 0.0f, 1.0f};
+    copy(tangent, tangent + 4, &vertex_tangents[4 * v]);
+  }
+
+  // Index buffers are filled through GL_ARRAY_BUFFER: the element array
+  // binding belongs to the vertex array bound at the time, and is only set
+  // when drawing
+  glGenBuffers(1, &triangle_indices);
+  glBindBuffer(GL_ARRAY_BUFFER, triangle_indices);
+  glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(),
+               GL_STATIC_DRAW);
+
+  glGenBuffers(1, &uvs);
+  glBindBuffer(GL_ARRAY_BUFFER, uvs);
+  glBufferData(GL_ARRAY_BUFFER, vertex_uvs.size() * sizeof(float), vertex_uvs.data(),
+               GL_STATIC_DRAW);
+
+  glGenBuffers(1, &tangents);
+  glBindBuffer(GL_ARRAY_BUFFER, tangents);
+  glBufferData(GL_ARRAY_BUFFER, vertex_tangents.size() * sizeof(float),
+               vertex_tangents.data(), GL_STATIC_DRAW);
+
+  glGenBuffers(2, positions);
+  glGenBuffers(2, normals);
+}
+
+void ClothRenderBuffers::update(const Cloth *cloth, const vector<Vector3D> &vertex_positions,
+                                bool with_normals, int num_threads) {
+  if (cloth->clothMesh != mesh || (int)cloth->point_masses.size() != num_vertices) {
+    build(cloth);
+  }
+  current = 1 - current;
+  long n = num_vertices;
+
+  size_t position_size = 3 * n * sizeof(float);
+  float *p = map_stream(positions[current], position_size);
+  vector<float> fallback;
+  if (!p) {
+    fallback.resize(3 * n);
+    p = fallback.data();
+  }
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long i = 0; i < n; i++) {
+    const Vector3D &x = vertex_positions[i];
+    p[3 * i] = x.x;
+    p[3 * i + 1] = x.y;
+    p[3 * i + 2] = x.z;
+  }
+  if (fallback.empty()) {
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  } else {
+    glBufferSubData(GL_ARRAY_BUFFER, 0, position_size, fallback.data());
+  }
+
+  if (!with_normals) { return; }
+
+  size_t normal_size = 4 * n * sizeof(float);
+  float *q = map_stream(normals[current], normal_size);
+  fallback.clear();
+  if (!q) {
+    fallback.resize(4 * n);
+    q = fallback.data();
+  }
+  vertex_normals.update(vertex_positions, num_threads);
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long i = 0; i < n; i++) {
+    const Vector3D &normal = vertex_normals.normals[i];
+    q[4 * i] = normal.x;
+    q[4 * i + 1] = normal.y;
+    q[4 * i + 2] = normal.z;
+    q[4 * i + 3] = 0.0f;
+  }
+  if (fallback.empty()) {
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  } else {
+    glBufferSubData(GL_ARRAY_BUFFER, 0, normal_size, fallback.data());
+  }
+}
+
+void ClothRenderBuffers::attach(GLShader &shader, const char *name, GLuint buffer, int size) {
+  GLint location = shader.attrib(name, false);
+  if (location < 0) { return; }
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  glEnableVertexAttribArray(location);
+  glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, 0, 0);
+}
+
+void ClothRenderBuffers::detach(GLShader &shader, const char *name) {
+  GLint location = shader.attrib(name, false);
+  if (location >= 0) { glDisableVertexAttribArray(location); }
+}
+
+void ClothRenderBuffers::draw_triangles(GLShader &shader) {
+  if (num_triangles == 0) { return; }
+  attach(shader, "in_position", positions[current], 3);
+  attach(shader, "in_normal", normals[current], 4);
+  attach(shader, "in_uv", uvs, 2);
+  attach(shader, "in_tangent", tangents, 4);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, triangle_indices);
+
+  shader.drawIndexed(GL_TRIANGLES, 0, num_triangles);
+
+  // Collision objects upload their own positions and normals, but not UVs
+  // or tangents, which must not point past the end of these buffers
+  detach(shader, "in_uv");
+  detach(shader, "in_tangent");
+}
+
+void ClothRenderBuffers::draw_springs(GLShader &shader, const Cloth *cloth,
+                                      const ClothParameters *cp) {
+  if (num_vertices == 0) { return; }
+
+  int types = 0;
+  for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+    types |= cp->is_enabled((e_spring_type)t) << t;
+  }
+  if (types != spring_types) {
+    const SpringBuffer &springs = cloth->springs;
+    vector<uint32_t> indices;
+    for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+      e_spring_type type = (e_spring_type)t;
+      if (!(types >> t & 1)) { continue; }
+      for (size_t i = springs.begin(type); i < springs.end(type); i++) {
+        indices.push_back(springs[i].a);
+        indices.push_back(springs[i].b);
+      }
+    }
+    if (!spring_indices) { glGenBuffers(1, &spring_indices); }
+    glBindBuffer(GL_ARRAY_BUFFER, spring_indices);
+    glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(),
+                 GL_STATIC_DRAW);
+    spring_types = types;
+    num_spring_indices = indices.size();
+  }
+
+  attach(shader, "in_position", positions[current], 3);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, spring_indices);
+  shader.drawIndexed(GL_LINES, 0, num_spring_indices / 2);
+}
+
+void ClothRenderBuffers::free() {
+  GLuint buffers[] = {triangle_indices, uvs, tangents, spring_indices,
+                      positions[0], positions[1], normals[0], normals[1]};
+  for (GLuint buffer : buffers) {
+    if (buffer) { glDeleteBuffers(1, &buffer); }
+  }
+  triangle_indices = uvs = tangents = spring_indices = 0;
+  positions[0] = positions[1] = normals[0] = normals[1] = 0;
+  mesh = nullptr;
+  num_vertices = num_triangles = 0;
+  spring_types = -1;
+  num_spring_indices = 0;
+}
@@ -0,0 +1,68 @@
+#ifndef CLOTH_RENDER_BUFFERS_H
+#define CLOTH_RENDER_BUFFERS_H
+
+#include <nanogui/nanogui.h>
+
+#include "cloth.h"
+#include "vertexNormals.h"
+
+using namespace nanogui;
+
+// GPU buffers for drawing the cloth with its vertices shared between
+// triangles. The triangle and spring indices, UVs and tangents only depend
+// on the mesh and are uploaded once. Positions and normals are streamed every
+// frame into one of two pairs of buffers, orphaned before they are mapped,
+// so that the driver never waits for the GPU to finish drawing the previous
+// frame.
+//
+// The buffers are attached to the vertex array of whichever shader is bound
+// when drawing, and the UV and tangent arrays are disabled afterwards, so
+// collision objects can keep drawing through GLShader::uploadAttrib.
+class ClothRenderBuffers {
+public:
+  ClothRenderBuffers() {}
+  ~ClothRenderBuffers() { free(); }
+
+  // Streams the given positions of the point masses of the cloth, such as
+  // those of a published frame, and if requested the normals computed from
+  // them. Only the mesh of the cloth is read, so the cloth may be simulated
+  // meanwhile. The static buffers are (re)built if the mesh changed.
+  void update(const Cloth *cloth, const vector<Vector3D> &vertex_positions,
+              bool with_normals, int num_threads);
+
+  // Draws the triangles of the cloth, which needs the normals to have been
+  // streamed; UVs and tangents are attached if the shader has them
+  void draw_triangles(GLShader &shader);
+
+  // Draws the springs of the enabled types as lines; only the positions
+  // need to be up to date
+  void draw_springs(GLShader &shader, const Cloth *cloth, const ClothParameters *cp);
+
+  void free();
+
+private:
+  ClothRenderBuffers(const ClothRenderBuffers &) = delete;
+  ClothRenderBuffers &operator=(const ClothRenderBuffers &) = delete;
+
+  void build(const Cloth *cloth);
+  void attach(GLShader &shader, const char *name, GLuint buffer, int size);
+  void detach(GLShader &shader, const char *name);
+
+  // Mesh the static buffers were built for
+  const ClothMesh *mesh = nullptr;
+  int num_vertices = 0;
+  int num_triangles = 0;
+  VertexNormals vertex_normals;
+
+  GLuint triangle_indices = 0, uvs = 0, tangents = 0;
+  // Streamed xyz positions, and normals with w = 0, of the last two frames
+  GLuint positions[2] = {0, 0}, normals[2] = {0, 0};
+  int current = 0;
+
+  // Spring line indices, rebuilt when the enabled spring types change
+  GLuint spring_indices = 0;
+  int spring_types = -1;
+  int num_spring_indices = 0;
+};
+
+#endif /* CLOTH_RENDER_BUFFERS_H */
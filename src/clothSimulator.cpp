@@ -12,6 +12,7 @@
 #include "collision/sphere.h"
 #include "misc/camera_info.h"
 #include "misc/file_utils.h"
+#include "misc/thread_utils.h"
 // Needed to generate stb_image binaries. Should only define in exactly one source file importing stb_image.h.
 #define STB_IMAGE_IMPLEMENTATION
 #include "misc/stb_image.h"
@@ -168,6 +169,8 @@ ClothSimulator::ClothSimulator(std::string project_root, Screen *screen)
 }
 
 ClothSimulator::~ClothSimulator() {
+  simulation.stop();
+
   for (auto shader : shaders) {
     shader.nanogui_shader->free();
   }
@@ -189,8 +192,9 @@ void ClothSimulator::loadClothParameters(ClothParameters *cp) { this->cp = cp; }
 void ClothSimulator::loadCollisionObjects(vector<CollisionObject *> *objects) { this->collision_objects = objects; }
 
 /**
- * Initializes the cloth simulation and spawns a new thread to separate
- * rendering from simulation.
+ * Initializes the GUI and the camera, then starts the simulation thread,
+ * which owns the cloth, its parameters and the collision objects from then
+ * on.
  */
 void ClothSimulator::init() {
 
@@ -210,8 +214,8 @@ void ClothSimulator::init() {
 
   Vector3D avg_pm_position(0, 0, 0);
 
-  for (auto &pm : cloth->point_masses) {
-    avg_pm_position += pm.position / cloth->point_masses.size();
+  for (size_t i = 0; i < cloth->particles.size(); i++) {
+    avg_pm_position += cloth->particles.get_position(i) / cloth->particles.size();
   }
 
   CGL::Vector3D target(avg_pm_position.x, avg_pm_position.y / 2,
@@ -236,6 +240,8 @@ void ClothSimulator::init() {
 
   camera.configure(camera_info, screen_w, screen_h);
   canonicalCamera.configure(camera_info, screen_w, screen_h);
+
+  simulation.start(cloth, cp, collision_objects);
 }
 
 bool ClothSimulator::isAlive() { return is_alive; }
@@ -243,12 +249,31 @@ bool ClothSimulator::isAlive() { return is_alive; }
 void ClothSimulator::drawContents() {
   glEnable(GL_DEPTH_TEST);
 
-  if (!is_paused) {
-    vector<Vector3D> external_accelerations = {gravity};
-
-    for (int i = 0; i < simulation_steps; i++) {
-      cloth->simulate(frames_per_sec, simulation_steps, cp, external_accelerations, collision_objects);
+  // The simulation runs on its own thread; draw the latest frame it
+  // finished, whatever it is working on now
+  const SimulationThread::Frame &frame = simulation.latest_frame();
+  if (frame.number > 0) {
+    std::string substeps = "substeps : " + std::to_string(frame.substeps);
+    if (frame.shed_substeps > 0) {
+      substeps += " (" + std::to_string(frame.shed_substeps) + " shed)";
     }
+    substeps_label->setCaption(substeps);
+    char timing[64];
+    snprintf(timing, sizeof(timing), "frame : %.1f ms, over : %.1f ms, dropped : %.0f ms",
+             frame.step_ms, frame.deficit_ms, frame.dropped_ms);
+    timing_label->setCaption(timing);
+  }
+
+  // Clock-driven stepping draws the cloth one frame late, blended between
+  // the last two frames for the time now
+  int num_threads = ThreadUtils::resolve_num_threads(frame.cp.num_threads);
+  double alpha = frame.blend(SimulationThread::Clock::now());
+  const vector<Vector3D> *positions = &frame.positions;
+  double time = frame.time;
+  if (alpha < 1) {
+    frame.interpolate(alpha, blended_positions, num_threads);
+    positions = &blended_positions;
+    time = frame.previous_time + alpha * (frame.time - frame.previous_time);
   }
 
   // Bind the active shader
@@ -274,10 +299,10 @@ void ClothSimulator::drawContents() {
   switch (active_shader.type_hint) {
   case WIREFRAME:
     shader.setUniform("u_color", color, false);
-    drawWireframe(shader);
+    drawWireframe(shader, *positions, frame.cp);
     break;
   case NORMALS:
-    drawNormals(shader);
+    drawNormals(shader, *positions, num_threads);
     break;
   case PHONG:
   
@@ -301,142 +326,34 @@ void ClothSimulator::drawContents() {
     shader.setUniform("u_height_scaling", m_height_scaling, false);
     
     shader.setUniform("u_texture_cubemap", 5, false);
-    drawPhong(shader);
+    drawPhong(shader, *positions, num_threads);
     break;
   }
 
   for (CollisionObject *co : *collision_objects) {
-    co->render(shader);
+    co->render_at(shader, time);
   }
 }
 
-void ClothSimulator::drawWireframe(GLShader &shader) {
-  int num_structural_springs =
-      2 * cloth->num_width_points * cloth->num_height_points -
-      cloth->num_width_points - cloth->num_height_points;
-  int num_shear_springs =
-      2 * (cloth->num_width_points - 1) * (cloth->num_height_points - 1);
-  int num_bending_springs = num_structural_springs - cloth->num_width_points -
-                            cloth->num_height_points;
-
-  int num_springs = cp->enable_structural_constraints * num_structural_springs +
-                    cp->enable_shearing_constraints * num_shear_springs +
-                    cp->enable_bending_constraints * num_bending_springs;
-
-  MatrixXf positions(4, num_springs * 2);
-  MatrixXf normals(4, num_springs * 2);
-
-  // Draw springs as lines
-
-  int si = 0;
-
-  for (int i = 0; i < cloth->springs.size(); i++) {
-    Spring s = cloth->springs[i];
-
-    if ((s.spring_type == STRUCTURAL && !cp->enable_structural_constraints) ||
-        (s.spring_type == SHEARING && !cp->enable_shearing_constraints) ||
-        (s.spring_type == BENDING && !cp->enable_bending_constraints)) {
-      continue;
-    }
-
-    Vector3D pa = s.pm_a->position;
-    Vector3D pb = s.pm_b->position;
-
-    Vector3D na = s.pm_a->normal();
-    Vector3D nb = s.pm_b->normal();
-
-    positions.col(si) << pa.x, pa.y, pa.z, 1.0;
-    positions.col(si + 1) << pb.x, pb.y, pb.z, 1.0;
-
-    normals.col(si) << na.x, na.y, na.z, 0.0;
-    normals.col(si + 1) << nb.x, nb.y, nb.z, 0.0;
-
-    si += 2;
-  }
-
-  //shader.setUniform("u_color", nanogui::Color(1.0f, 1.0f, 1.0f, 1.0f), false);
-  shader.uploadAttrib("in_position", positions, false);
-  // Commented out: the wireframe shader does not have this attribute
-  //shader.uploadAttrib("in_normal", normals);
-
-  shader.drawArray(GL_LINES, 0, num_springs * 2);
+void ClothSimulator::drawWireframe(GLShader &shader, const vector<Vector3D> &positions,
+                                   const ClothParameters &cp) {
+  // Draw springs as lines, skipping disabled spring types as a whole; the
+  // wireframe shader has no normals
+  render_buffers.update(cloth, positions, false,
+                        ThreadUtils::resolve_num_threads(cp.num_threads));
+  render_buffers.draw_springs(shader, cloth, &cp);
 }
 
-void ClothSimulator::drawNormals(GLShader &shader) {
-  int num_tris = cloth->clothMesh->triangles.size();
-
-  MatrixXf positions(4, num_tris * 3);
-  MatrixXf normals(4, num_tris * 3);
-
-  for (int i = 0; i < num_tris; i++) {
-    Triangle *tri = cloth->clothMesh->triangles[i];
-
-    Vector3D p1 = tri->pm1->position;
-    Vector3D p2 = tri->pm2->position;
-    Vector3D p3 = tri->pm3->position;
-
-    Vector3D n1 = tri->pm1->normal();
-    Vector3D n2 = tri->pm2->normal();
-    Vector3D n3 = tri->pm3->normal();
-
-    positions.col(i * 3) << p1.x, p1.y, p1.z, 1.0;
-    positions.col(i * 3 + 1) << p2.x, p2.y, p2.z, 1.0;
-    positions.col(i * 3 + 2) << p3.x, p3.y, p3.z, 1.0;
-
-    normals.col(i * 3) << n1.x, n1.y, n1.z, 0.0;
-    normals.col(i * 3 + 1) << n2.x, n2.y, n2.z, 0.0;
-    normals.col(i * 3 + 2) << n3.x, n3.y, n3.z, 0.0;
-  }
-
-  shader.uploadAttrib("in_position", positions, false);
-  shader.uploadAttrib("in_normal", normals, false);
-
-  shader.drawArray(GL_TRIANGLES, 0, num_tris * 3);
+void ClothSimulator::drawNormals(GLShader &shader, const vector<Vector3D> &positions,
+                                 int num_threads) {
+  render_buffers.update(cloth, positions, true, num_threads);
+  render_buffers.draw_triangles(shader);
 }
 
-void ClothSimulator::drawPhong(GLShader &shader) {
-  int num_tris = cloth->clothMesh->triangles.size();
-
-  MatrixXf positions(4, num_tris * 3);
-  MatrixXf normals(4, num_tris * 3);
-  MatrixXf uvs(2, num_tris * 3);
-  MatrixXf tangents(4, num_tris * 3);
-
-  for (int i = 0; i < num_tris; i++) {
-    Triangle *tri = cloth->clothMesh->triangles[i];
-
-    Vector3D p1 = tri->pm1->position;
-    Vector3D p2 = tri->pm2->position;
-    Vector3D p3 = tri->pm3->position;
-
-    Vector3D n1 = tri->pm1->normal();
-    Vector3D n2 = tri->pm2->normal();
-    Vector3D n3 = tri->pm3->normal();
-
-    positions.col(i * 3    ) << p1.x, p1.y, p1.z, 1.0;
-    positions.col(i * 3 + 1) << p2.x, p2.y, p2.z, 1.0;
-    positions.col(i * 3 + 2) << p3.x, p3.y, p3.z, 1.0;
-
-    normals.col(i * 3    ) << n1.x, n1.y, n1.z, 0.0;
-    normals.col(i * 3 + 1) << n2.x, n2.y, n2.z, 0.0;
-    normals.col(i * 3 + 2) << n3.x, n3.y, n3.z, 0.0;
-    
-    uvs.col(i * 3    ) << tri->uv1.x, tri->uv1.y;
-    uvs.col(i * 3 + 1) << tri->uv2.x, tri->uv2.y;
-    uvs.col(i * 3 + 2) << tri->uv3.x, tri->uv3.y;
-    
-    tangents.col(i * 3    ) << 1.0, 0.0, 0.0, 1.0;
-    tangents.col(i * 3 + 1) << 1.0, 0.0, 0.0, 1.0;
-    tangents.col(i * 3 + 2) << 1.0, 0.0, 0.0, 1.0;
-  }
-
-
-  shader.uploadAttrib("in_position", positions, false);
-  shader.uploadAttrib("in_normal", normals, false);
-  shader.uploadAttrib("in_uv", uvs, false);
-  shader.uploadAttrib("in_tangent", tangents, false);
-
-  shader.drawArray(GL_TRIANGLES, 0, num_tris * 3);
+void ClothSimulator::drawPhong(GLShader &shader, const vector<Vector3D> &positions,
+                               int num_threads) {
+  render_buffers.update(cloth, positions, true, num_threads);
+  render_buffers.draw_triangles(shader);
 }
 
 // ----------------------------------------------------------------------------
@@ -579,22 +496,18 @@ bool ClothSimulator::keyCallbackEvent(int key, int scancode, int action,
       break;
     case 'r':
     case 'R':
-      cloth->reset();
+      simulation.reset();
       break;
     case ' ':
       resetCamera();
       break;
     case 'p':
     case 'P':
-      is_paused = !is_paused;
+      simulation.toggle_pause();
       break;
     case 'n':
     case 'N':
-      if (is_paused) {
-        is_paused = false;
-        drawContents();
-        is_paused = true;
-      }
+      simulation.step();
       break;
     }
   }
@@ -635,22 +548,25 @@ void ClothSimulator::initGUI(Screen *screen) {
     b->setFlags(Button::ToggleButton);
     b->setPushed(cp->enable_structural_constraints);
     b->setFontSize(14);
-    b->setChangeCallback(
-        [this](bool state) { cp->enable_structural_constraints = state; });
+    b->setChangeCallback([this](bool state) {
+      simulation.post([this, state] { cp->enable_structural_constraints = state; });
+    });
 
     b = new Button(window, "shearing");
     b->setFlags(Button::ToggleButton);
     b->setPushed(cp->enable_shearing_constraints);
     b->setFontSize(14);
-    b->setChangeCallback(
-        [this](bool state) { cp->enable_shearing_constraints = state; });
+    b->setChangeCallback([this](bool state) {
+      simulation.post([this, state] { cp->enable_shearing_constraints = state; });
+    });
 
     b = new Button(window, "bending");
     b->setFlags(Button::ToggleButton);
     b->setPushed(cp->enable_bending_constraints);
     b->setFontSize(14);
-    b->setChangeCallback(
-        [this](bool state) { cp->enable_bending_constraints = state; });
+    b->setChangeCallback([this](bool state) {
+      simulation.post([this, state] { cp->enable_bending_constraints = state; });
+    });
   }
 
   // Mass-spring parameters
@@ -674,7 +590,9 @@ void ClothSimulator::initGUI(Screen *screen) {
     fb->setValue(cp->density / 10);
     fb->setUnits("g/cm^2");
     fb->setSpinnable(true);
-    fb->setCallback([this](float value) { cp->density = (double)(value * 10); });
+    fb->setCallback([this](float value) {
+      simulation.post([this, value] { cp->density = (double)(value * 10); });
+    });
 
     new Label(panel, "ks :", "sans-bold");
 
@@ -686,7 +604,9 @@ void ClothSimulator::initGUI(Screen *screen) {
     fb->setUnits("N/m");
     fb->setSpinnable(true);
     fb->setMinValue(0);
-    fb->setCallback([this](float value) { cp->ks = value; });
+    fb->setCallback([this](float value) {
+      simulation.post([this, value] { cp->ks = value; });
+    });
   }
 
   // Simulation constants
@@ -707,9 +627,11 @@ void ClothSimulator::initGUI(Screen *screen) {
     fsec->setEditable(true);
     fsec->setFixedSize(Vector2i(100, 20));
     fsec->setFontSize(14);
-    fsec->setValue(frames_per_sec);
+    fsec->setValue(simulation.settings.frames_per_sec);
     fsec->setSpinnable(true);
-    fsec->setCallback([this](int value) { frames_per_sec = value; });
+    fsec->setCallback([this](int value) {
+      simulation.post([this, value] { simulation.settings.frames_per_sec = value; });
+    });
 
     new Label(panel, "steps/frame :", "sans-bold");
 
@@ -717,12 +639,136 @@ void ClothSimulator::initGUI(Screen *screen) {
     num_steps->setEditable(true);
     num_steps->setFixedSize(Vector2i(100, 20));
     num_steps->setFontSize(14);
-    num_steps->setValue(simulation_steps);
+    num_steps->setValue(simulation.settings.simulation_steps);
     num_steps->setSpinnable(true);
     num_steps->setMinValue(0);
-    num_steps->setCallback([this](int value) { simulation_steps = value; });
+    num_steps->setCallback([this](int value) {
+      simulation.post([this, value] { simulation.settings.simulation_steps = value; });
+    });
+
+    new Label(panel, "adaptive :", "sans-bold");
+
+    CheckBox *adaptive = new CheckBox(panel, "");
+    adaptive->setFontSize(14);
+    adaptive->setChecked(cp->adaptive_substeps);
+    adaptive->setCallback([this](bool state) {
+      simulation.post([this, state] { cp->adaptive_substeps = state; });
+    });
+
+    new Label(panel, "min steps :", "sans-bold");
+
+    IntBox<int> *min_steps = new IntBox<int>(panel);
+    min_steps->setEditable(true);
+    min_steps->setFixedSize(Vector2i(100, 20));
+    min_steps->setFontSize(14);
+    min_steps->setValue(cp->min_substeps);
+    min_steps->setSpinnable(true);
+    min_steps->setMinValue(1);
+    min_steps->setCallback([this](int value) {
+      simulation.post([this, value] { cp->min_substeps = value; });
+    });
+
+    new Label(panel, "max steps :", "sans-bold");
+
+    IntBox<int> *max_steps = new IntBox<int>(panel);
+    max_steps->setEditable(true);
+    max_steps->setFixedSize(Vector2i(100, 20));
+    max_steps->setFontSize(14);
+    max_steps->setValue(cp->max_substeps);
+    max_steps->setSpinnable(true);
+    max_steps->setMinValue(1);
+    max_steps->setCallback([this](int value) {
+      simulation.post([this, value] { cp->max_substeps = value; });
+    });
+
+    new Label(panel, "integrator :", "sans-bold");
+
+    ComboBox *integrator = new ComboBox(panel, {"Verlet", "Implicit", "XPBD", "Projective"});
+    integrator->setFixedSize(Vector2i(100, 20));
+    integrator->setFontSize(14);
+    integrator->setSelectedIndex(cp->integrator);
+    integrator->setCallback([this](int idx) {
+      simulation.post([this, idx] { cp->integrator = (e_integrator)idx; });
+    });
+
+    new Label(panel, "strain iters :", "sans-bold");
+
+    IntBox<int> *strain_iters = new IntBox<int>(panel);
+    strain_iters->setEditable(true);
+    strain_iters->setFixedSize(Vector2i(100, 20));
+    strain_iters->setFontSize(14);
+    strain_iters->setValue(cp->strain_limit_iterations);
+    strain_iters->setSpinnable(true);
+    strain_iters->setMinValue(0);
+    strain_iters->setCallback([this](int value) {
+      simulation.post([this, value] { cp->strain_limit_iterations = value; });
+    });
+
+    new Label(panel, "threads :", "sans-bold");
+
+    IntBox<int> *num_threads = new IntBox<int>(panel);
+    num_threads->setEditable(true);
+    num_threads->setFixedSize(Vector2i(100, 20));
+    num_threads->setFontSize(14);
+    num_threads->setValue(cp->num_threads);
+    num_threads->setSpinnable(true);
+    num_threads->setMinValue(0);
+    num_threads->setCallback([this](int value) {
+      simulation.post([this, value] { cp->num_threads = value; });
+    });
+
+    new Label(panel, "CCD :", "sans-bold");
+
+    CheckBox *ccd = new CheckBox(panel, "");
+    ccd->setFontSize(14);
+    ccd->setChecked(cp->continuous_collision);
+    ccd->setCallback([this](bool state) {
+      simulation.post([this, state] { cp->continuous_collision = state; });
+    });
+
+    new Label(panel, "stepping :", "sans-bold");
+
+    ComboBox *stepping = new ComboBox(panel, {"Fixed rate", "Real time", "Deadline"});
+    stepping->setFixedSize(Vector2i(100, 20));
+    stepping->setFontSize(14);
+    stepping->setSelectedIndex(simulation.settings.stepping);
+    stepping->setCallback([this](int idx) {
+      simulation.post([this, idx] { simulation.settings.stepping = (e_stepping)idx; });
+    });
+
+    new Label(panel, "catch-up :", "sans-bold");
+
+    IntBox<int> *catch_up = new IntBox<int>(panel);
+    catch_up->setEditable(true);
+    catch_up->setFixedSize(Vector2i(100, 20));
+    catch_up->setFontSize(14);
+    catch_up->setValue(simulation.settings.max_catch_up);
+    catch_up->setSpinnable(true);
+    catch_up->setMinValue(1);
+    catch_up->setCallback([this](int value) {
+      simulation.post([this, value] { simulation.settings.max_catch_up = value; });
+    });
+
+    new Label(panel, "deadline :", "sans-bold");
+
+    FloatBox<double> *deadline = new FloatBox<double>(panel);
+    deadline->setEditable(true);
+    deadline->setFixedSize(Vector2i(100, 20));
+    deadline->setFontSize(14);
+    deadline->setValue(simulation.settings.deadline_ms);
+    deadline->setUnits("ms");
+    deadline->setSpinnable(true);
+    deadline->setMinValue(0);
+    deadline->setCallback([this](double value) {
+      simulation.post([this, value] { simulation.settings.deadline_ms = value; });
+    });
   }
 
+  // Per-frame statistics
+
+  substeps_label = new Label(window, "substeps : -", "sans");
+  timing_label = new Label(window, "frame : -", "sans");
+
   // Damping slider and textbox
 
   new Label(window, "Damping", "sans-bold");
@@ -745,8 +791,8 @@ void ClothSimulator::initGUI(Screen *screen) {
     slider->setCallback([percentage](float value) {
       percentage->setValue(std::to_string(value));
     });
-    slider->setFinalCallback([&](float value) {
-      cp->damping = (double)value;
+    slider->setFinalCallback([this](float value) {
+      simulation.post([this, value] { cp->damping = (double)value; });
       // cout << "Final slider value: " << (int)(value * 100) << endl;
     });
   }
@@ -769,10 +815,12 @@ void ClothSimulator::initGUI(Screen *screen) {
     fb->setEditable(true);
     fb->setFixedSize(Vector2i(100, 20));
     fb->setFontSize(14);
-    fb->setValue(gravity.x);
+    fb->setValue(simulation.settings.gravity.x);
     fb->setUnits("m/s^2");
     fb->setSpinnable(true);
-    fb->setCallback([this](float value) { gravity.x = value; });
+    fb->setCallback([this](float value) {
+      simulation.post([this, value] { simulation.settings.gravity.x = value; });
+    });
 
     new Label(panel, "y :", "sans-bold");
 
@@ -780,10 +828,12 @@ void ClothSimulator::initGUI(Screen *screen) {
     fb->setEditable(true);
     fb->setFixedSize(Vector2i(100, 20));
     fb->setFontSize(14);
-    fb->setValue(gravity.y);
+    fb->setValue(simulation.settings.gravity.y);
     fb->setUnits("m/s^2");
     fb->setSpinnable(true);
-    fb->setCallback([this](float value) { gravity.y = value; });
+    fb->setCallback([this](float value) {
+      simulation.post([this, value] { simulation.settings.gravity.y = value; });
+    });
 
     new Label(panel, "z :", "sans-bold");
 
@@ -791,10 +841,12 @@ void ClothSimulator::initGUI(Screen *screen) {
     fb->setEditable(true);
     fb->setFixedSize(Vector2i(100, 20));
     fb->setFontSize(14);
-    fb->setValue(gravity.z);
+    fb->setValue(simulation.settings.gravity.z);
     fb->setUnits("m/s^2");
     fb->setSpinnable(true);
-    fb->setCallback([this](float value) { gravity.z = value; });
+    fb->setCallback([this](float value) {
+      simulation.post([this, value] { simulation.settings.gravity.z = value; });
+    });
   }
   
   window = new Window(screen, "Appearance");
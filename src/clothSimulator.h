@@ -6,7 +6,9 @@
 
 #include "camera.h"
 #include "cloth.h"
+#include "clothRenderBuffers.h"
 #include "collision/collisionObject.h"
+#include "simulationThread.h"
 
 using namespace nanogui;
 
@@ -37,9 +39,10 @@ public:
 
 private:
   virtual void initGUI(Screen *screen);
-  void drawWireframe(GLShader &shader);
-  void drawNormals(GLShader &shader);
-  void drawPhong(GLShader &shader);
+  void drawWireframe(GLShader &shader, const vector<Vector3D> &positions,
+                     const ClothParameters &cp);
+  void drawNormals(GLShader &shader, const vector<Vector3D> &positions, int num_threads);
+  void drawPhong(GLShader &shader, const vector<Vector3D> &positions, int num_threads);
   
   void load_shaders();
   void load_textures();
@@ -54,24 +57,27 @@ private:
   virtual Matrix4f getProjectionMatrix();
   virtual Matrix4f getViewMatrix();
 
-  // Default simulation values
-
-  int frames_per_sec = 90;
-  int simulation_steps = 30;
-
-  CGL::Vector3D gravity = CGL::Vector3D(0, -9.8, 0);
   nanogui::Color color = nanogui::Color(1.0f, 1.0f, 1.0f, 1.0f);
 
   Cloth *cloth;
   ClothParameters *cp;
   vector<CollisionObject *> *collision_objects;
 
+  // Steps the cloth, which only it touches once started; holds the frame
+  // rate, substeps, gravity and pause state
+  SimulationThread simulation;
+
   // OpenGL attributes
 
   int active_shader_idx = 0;
 
   vector<UserShader> shaders;
   vector<std::string> shaders_combobox_names;
+
+  // Cloth vertices, indices and attributes on the GPU
+  ClothRenderBuffers render_buffers;
+  // Positions drawn between two frames
+  vector<Vector3D> blended_positions;
   
   // OpenGL textures
   
@@ -119,9 +125,10 @@ private:
 
   bool ctrl_down = false;
 
-  // Simulation flags
-
-  bool is_paused = true;
+  // Substeps taken by the last simulated frame, its cost, how far it missed
+  // the deadline and the real time dropped so far
+  Label *substeps_label;
+  Label *timing_label;
 
   // Screen attributes
 
@@ -0,0 +1,84 @@
+#ifndef COLLISION_BBOX_H
+#define COLLISION_BBOX_H
+
+#include <algorithm>
+#include <limits>
+
+#include "CGL/CGL.h"
+#include "CGL/vector3D.h"
+
+using namespace CGL;
+using namespace std;
+
+// Axis-aligned bounding box; a default-constructed box is empty and grows
+// with expand().
+struct BBox {
+  BBox()
+      : min(numeric_limits<double>::infinity(),
+            numeric_limits<double>::infinity(),
+            numeric_limits<double>::infinity()),
+        max(-numeric_limits<double>::infinity(),
+            -numeric_limits<double>::infinity(),
+            -numeric_limits<double>::infinity()) {}
+  BBox(const Vector3D &p) : min(p), max(p) {}
+  BBox(const Vector3D &min, const Vector3D &max) : min(min), max(max) {}
+
+  // A box that contains everything
+  static BBox infinite() {
+    double inf = numeric_limits<double>::infinity();
+    return BBox(Vector3D(-inf, -inf, -inf), Vector3D(inf, inf, inf));
+  }
+
+  void expand(const Vector3D &p) {
+    min.x = std::min(min.x, p.x);
+    min.y = std::min(min.y, p.y);
+    min.z = std::min(min.z, p.z);
+    max.x = std::max(max.x, p.x);
+    max.y = std::max(max.y, p.y);
+    max.z = std::max(max.z, p.z);
+  }
+
+  void expand(const BBox &b) {
+    expand(b.min);
+    expand(b.max);
+  }
+
+  // Grows the box by r on every side
+  void pad(double r) {
+    min -= Vector3D(r, r, r);
+    max += Vector3D(r, r, r);
+  }
+
+  bool overlaps(const BBox &b) const {
+    return min.x <= b.max.x && b.min.x <= max.x && min.y <= b.max.y &&
+           b.min.y <= max.y && min.z <= b.max.z && b.min.z <= max.z;
+  }
+
+  bool contains(const Vector3D &p) const {
+    return min.x <= p.x && p.x <= max.x && min.y <= p.y && p.y <= max.y &&
+           min.z <= p.z && p.z <= max.z;
+  }
+
+  // Narrows [t0, t1] to the part of the segment p + t d within the box;
+  // false if that part is empty
+  bool clip(const Vector3D &p, const Vector3D &d, double &t0, double &t1) const {
+    for (int k = 0; k < 3; k++) {
+      if (d[k] == 0) {
+        if (p[k] < min[k] || p[k] > max[k]) { return false; }
+        continue;
+      }
+      double inv = 1 / d[k];
+      double a = (min[k] - p[k]) * inv, b = (max[k] - p[k]) * inv;
+      t0 = std::max(t0, std::min(a, b));
+      t1 = std::min(t1, std::max(a, b));
+    }
+    return t0 <= t1;
+  }
+
+  Vector3D centroid() const { return 0.5 * (min + max); }
+  Vector3D extent() const { return max - min; }
+
+  Vector3D min, max;
+};
+
+#endif /* COLLISION_BBOX_H */
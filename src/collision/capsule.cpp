@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cmath>
+
+#include "../clothMesh.h"
+#include "capsule.h"
+#include "geometry.h"
+
+using namespace CGL;
+
+Capsule::Capsule(const Vector3D &a, const Vector3D &b, double radius, double friction,
+                 int num_lat, int num_lon)
+    : a(a), b(b), radius(radius), friction(friction), ab(b - a),
+      radius2(radius * radius) {
+  double length2 = ab.norm2();
+  inv_length2 = length2 > 0 ? 1 / length2 : 0;
+
+#ifndef CLOTHSIM_HEADLESS
+  // Rings of latitude from the far pole of the hemisphere around a to the
+  // far pole of the one around b; the two equators bound the side
+  Vector3D w = length2 > 0 ? ab.unit() : Vector3D(0, 1, 0);
+  Vector3D u = cross(w, fabs(w.x) < 0.9 ? Vector3D(1, 0, 0) : Vector3D(0, 1, 0)).unit();
+  Vector3D v = cross(w, u);
+  int rings_per_cap = max(1, num_lat / 2);
+  num_lon = max(3, num_lon);
+  vector<Vector3D> centers;
+  vector<double> angles;
+  for (int i = 0; i <= rings_per_cap; i++) {
+    centers.push_back(a);
+    angles.push_back(PI - 0.5 * PI * i / rings_per_cap);
+  }
+  for (int i = 0; i <= rings_per_cap; i++) {
+    centers.push_back(b);
+    angles.push_back(0.5 * PI - 0.5 * PI * i / rings_per_cap);
+  }
+
+  // Drawn slightly thinner, as spheres are, so that the flat cloth
+  // triangles do not cut into it
+  double render_radius = radius * 0.92;
+  int num_rings = centers.size();
+  render_positions = MatrixXf(3, 6 * (num_rings - 1) * num_lon);
+  render_normals = MatrixXf(4, 6 * (num_rings - 1) * num_lon);
+  int column = 0;
+  auto vertex = [&](int ring, int j) {
+    double phi = 2 * PI * j / num_lon;
+    Vector3D n = sin(angles[ring]) * (cos(phi) * u + sin(phi) * v) + cos(angles[ring]) * w;
+    Vector3D p = centers[ring] + render_radius * n;
+    render_positions.col(column) << p.x, p.y, p.z;
+    render_normals.col(column) << n.x, n.y, n.z, 0.0;
+    column++;
+  };
+  for (int i = 0; i + 1 < num_rings; i++) {
+    for (int j = 0; j < num_lon; j++) {
+      vertex(i, j);
+      vertex(i + 1, j);
+      vertex(i + 1, j + 1);
+      vertex(i + 1, j + 1);
+      vertex(i, j + 1);
+      vertex(i, j);
+    }
+  }
+#endif
+}
+
+void Capsule::collide(Vector3D &position, const Vector3D &last_position) {
+  Vector3D center = a + closest_on_segment(position, a, ab, inv_length2) * ab;
+  Vector3D d = position - center;
+  double d2 = d.norm2();
+  if (d2 > radius2) {
+    // The point may still have passed through the capsule during the
+    // substep, which happens when the capsule moves fast; it is then
+    // stopped where its path enters the capsule, found by bisection between
+    // the start of the path and its closest approach to the axis. Paths
+    // that only graze it are ignored, as in Cylinder::sweep.
+    auto outside = [&](const Vector3D &x) {
+      Vector3D c = a + closest_on_segment(x, a, ab, inv_length2) * ab;
+      return (x - c).norm2() > radius2;
+    };
+    Vector3D m = position - last_position;
+    if (m.norm2() < 4 * GRAZE_DEPTH * GRAZE_DEPTH * radius2) { return; }
+    if (!outside(last_position)) { return; }
+    double s, t;
+    closest_on_segments(last_position, position, a, b, s, t);
+    double depth = radius - (last_position + s * m - (a + t * ab)).norm();
+    if (depth < GRAZE_DEPTH * radius) { return; }
+    double lo = 0, hi = s;
+    for (int i = 0; i < 40; i++) {
+      double mid = 0.5 * (lo + hi);
+      if (outside(last_position + mid * m)) { lo = mid; } else { hi = mid; }
+    }
+    Vector3D entry = last_position + lo * m;
+    position = last_position + (entry - last_position) * (1 - friction);
+    return;
+  }
+  if (d2 == 0) { return; }
+
+  // Like a sphere around the closest point of the segment
+  Vector3D tangent = center + d * (radius / sqrt(d2));
+  Vector3D correction = tangent - last_position;
+  position = last_position + correction * (1 - friction);
+}
+
+void Capsule::collide(Vector3D *positions, const Vector3D *last_positions, long count) {
+  // Branch-free point-segment squared distances from the midpoint of each
+  // path; only the points whose path over the substep may reach the capsule
+  // go on to the response
+  collide_batch(positions, last_positions, count, [&](const Vector3D &p, const Vector3D &q) {
+    double px = 0.5 * (p.x + q.x) - a.x, py = 0.5 * (p.y + q.y) - a.y,
+           pz = 0.5 * (p.z + q.z) - a.z;
+    double t = (px * ab.x + py * ab.y + pz * ab.z) * inv_length2;
+    t = min(max(t, 0.0), 1.0);
+    double dx = px - t * ab.x, dy = py - t * ab.y, dz = pz - t * ab.z;
+    double mx = p.x - q.x, my = p.y - q.y, mz = p.z - q.z;
+    return path_within(dx * dx + dy * dy + dz * dz, mx * mx + my * my + mz * mz, radius2);
+  });
+}
+
+#ifndef CLOTHSIM_HEADLESS
+void Capsule::render(GLShader &shader) {
+  nanogui::Color color(0.45f, 0.32f, 0.2f, 1.0f);
+
+  if (shader.uniform("u_color", false) != -1) {
+    shader.setUniform("u_color", color);
+  }
+  shader.uploadAttrib("in_position", render_positions);
+  if (shader.attrib("in_normal", false) != -1) {
+    shader.uploadAttrib("in_normal", render_normals);
+  }
+
+  shader.drawArray(GL_TRIANGLES, 0, render_positions.cols());
+}
+#endif
@@ -0,0 +1,51 @@
+#ifndef COLLISIONOBJECT_CAPSULE_H
+#define COLLISIONOBJECT_CAPSULE_H
+
+#ifndef CLOTHSIM_HEADLESS
+#include <nanogui/nanogui.h>
+#endif
+
+#include "../clothMesh.h"
+#include "collisionObject.h"
+
+#ifndef CLOTHSIM_HEADLESS
+using namespace nanogui;
+#endif
+using namespace CGL;
+using namespace std;
+
+// Points within radius of the segment from a to b, e.g. a tree branch
+struct Capsule : public CollisionObject {
+public:
+  Capsule(const Vector3D &a, const Vector3D &b, double radius, double friction,
+          int num_lat = 40, int num_lon = 40);
+
+#ifndef CLOTHSIM_HEADLESS
+  void render(GLShader &shader);
+#endif
+  void collide(Vector3D &position, const Vector3D &last_position);
+  void collide(Vector3D *positions, const Vector3D *last_positions, long count);
+  BBox bounds() const {
+    BBox box(a);
+    box.expand(b);
+    box.pad(radius);
+    return box;
+  }
+
+  Vector3D a, b;
+  double radius;
+
+  double friction;
+
+private:
+  // Segment direction, and the inverse of its squared length
+  Vector3D ab;
+  double inv_length2;
+  double radius2;
+
+#ifndef CLOTHSIM_HEADLESS
+  MatrixXf render_positions, render_normals;
+#endif
+};
+
+#endif /* COLLISIONOBJECT_CAPSULE_H */
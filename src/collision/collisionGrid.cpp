@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cmath>
+
+#include "collisionGrid.h"
+
+static bool is_bounded(const BBox &box) {
+  for (int k = 0; k < 3; k++) {
+    if (!std::isfinite(box.min[k]) || !std::isfinite(box.max[k])) { return false; }
+  }
+  return true;
+}
+
+void CollisionGrid::update(const vector<CollisionObject *> &objects) {
+  bool changed = objects.size() != cached.size();
+  bounds.resize(objects.size());
+  cached.resize(objects.size());
+  for (size_t o = 0; o < objects.size(); o++) {
+    BBox box = objects[o]->bounds();
+    if (cached[o] != objects[o] || !(box.min == bounds[o].min) || !(box.max == bounds[o].max)) {
+      changed = true;
+    }
+    cached[o] = objects[o];
+    bounds[o] = box;
+  }
+  if (changed) { build(); }
+}
+
+void CollisionGrid::build() {
+  builds++;
+  unbounded.clear();
+  grid_bounds = BBox();
+  int num_bounded = 0;
+  Vector3D mean_extent;
+  for (size_t o = 0; o < bounds.size(); o++) {
+    if (!is_bounded(bounds[o])) {
+      unbounded.push_back((int)o);
+      continue;
+    }
+    grid_bounds.expand(bounds[o]);
+    mean_extent += bounds[o].extent();
+    num_bounded++;
+  }
+
+  dims[0] = dims[1] = dims[2] = 0;
+  cell_start.clear();
+  cell_objects.clear();
+  if (num_bounded == 0) { return; }
+
+  // Cells about as large as the average object, so that most objects fall
+  // into a handful of cells, but no more cells than a few per object
+  Vector3D extent = grid_bounds.extent();
+  mean_extent /= num_bounded;
+  double cell_size = max(max(mean_extent.x, mean_extent.y), mean_extent.z);
+  double volume = max(extent.x, cell_size) * max(extent.y, cell_size) * max(extent.z, cell_size);
+  cell_size = max(cell_size, cbrt(volume / (4.0 * num_bounded)));
+  if (!(cell_size > 0)) { cell_size = 1; }
+  inv_cell_size = 1.0 / cell_size;
+  for (int k = 0; k < 3; k++) {
+    dims[k] = min(1024, max(1, (int)ceil(extent[k] * inv_cell_size)));
+  }
+
+  // Counting sort of the objects into every cell their bounds overlap
+  size_t num_cells = (size_t)dims[0] * dims[1] * dims[2];
+  cell_start.assign(num_cells + 1, 0);
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t o = 0; o < bounds.size(); o++) {
+      if (!is_bounded(bounds[o])) { continue; }
+      int lo[3], hi[3];
+      cell_range(bounds[o], lo, hi);
+      for (int z = lo[2]; z <= hi[2]; z++)
+        for (int y = lo[1]; y <= hi[1]; y++)
+          for (int x = lo[0]; x <= hi[0]; x++) {
+            size_t c = ((size_t)z * dims[1] + y) * dims[0] + x;
+            if (pass == 0) {
+              cell_start[c + 1]++;
+            } else {
+              cell_objects[cell_start[c]++] = (int)o;
+            }
+          }
+    }
+    if (pass == 0) {
+      for (size_t c = 0; c < num_cells; c++) { cell_start[c + 1] += cell_start[c]; }
+      cell_objects.resize(cell_start[num_cells]);
+    } else {
+      // The second pass advanced every start to the next cell's start
+      for (size_t c = num_cells; c > 0; c--) { cell_start[c] = cell_start[c - 1]; }
+      cell_start[0] = 0;
+    }
+  }
+}
+
+void CollisionGrid::cell_range(const BBox &box, int lo[3], int hi[3]) const {
+  for (int k = 0; k < 3; k++) {
+    double a = floor((box.min[k] - grid_bounds.min[k]) * inv_cell_size);
+    double b = floor((box.max[k] - grid_bounds.min[k]) * inv_cell_size);
+    lo[k] = (int)min(max(a, 0.0), (double)(dims[k] - 1));
+    hi[k] = (int)min(max(b, 0.0), (double)(dims[k] - 1));
+  }
+}
+
+void CollisionGrid::query(const BBox &box, vector<int> &out) const {
+  size_t first = out.size();
+  if (!cell_start.empty() && box.overlaps(grid_bounds)) {
+    int lo[3], hi[3];
+    cell_range(box, lo, hi);
+    for (int z = lo[2]; z <= hi[2]; z++)
+      for (int y = lo[1]; y <= hi[1]; y++)
+        for (int x = lo[0]; x <= hi[0]; x++) {
+          size_t c = ((size_t)z * dims[1] + y) * dims[0] + x;
+          for (int i = cell_start[c]; i < cell_start[c + 1]; i++) {
+            int o = cell_objects[i];
+            if (!bounds[o].overlaps(box)) { continue; }
+            // An object overlapping several cells of the range is reported
+            // only from the first of them
+            int first_cell[3], last_cell[3];
+            cell_range(bounds[o], first_cell, last_cell);
+            if (max(first_cell[0], lo[0]) == x && max(first_cell[1], lo[1]) == y &&
+                max(first_cell[2], lo[2]) == z) {
+              out.push_back(o);
+            }
+          }
+        }
+  }
+  out.insert(out.end(), unbounded.begin(), unbounded.end());
+  sort(out.begin() + first, out.end());
+}
+
+void CollisionGrid::collide(const vector<CollisionObject *> &objects, Vector3D *positions,
+                            const Vector3D *last_positions, long count,
+                            vector<int> &candidates) const {
+  for (long begin = 0; begin < count; begin += BATCH_SIZE) {
+    long n = min<long>(BATCH_SIZE, count - begin);
+    BBox box;
+    for (long k = begin; k < begin + n; k++) {
+      box.expand(positions[k]);
+      box.expand(last_positions[k]);
+    }
+    candidates.clear();
+    query(box, candidates);
+    for (int o : candidates) {
+      objects[o]->collide(positions + begin, last_positions + begin, n);
+    }
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef COLLISION_GRID_H
+#define COLLISION_GRID_H
+
+#include <vector>
+
+#include "CGL/CGL.h"
+#include "CGL/vector3D.h"
+#include "bbox.h"
+#include "collisionObject.h"
+
+using namespace CGL;
+using namespace std;
+
+// Broadphase over the collision objects of a scene: a uniform grid over the
+// bounds of the objects, with the objects of cell c in
+//
+//   cell_objects[cell_start[c]] ... cell_objects[cell_start[c + 1] - 1]
+//
+// Objects without finite bounds (planes, or custom objects that do not
+// override bounds()) are kept aside and always tested. The grid is only
+// rebuilt when the objects or their bounds change.
+struct CollisionGrid {
+  // Rebuilds the grid if the objects differ from the last call or moved
+  void update(const vector<CollisionObject *> &objects);
+
+  // Appends to out the indices of the objects that overlap box, followed by
+  // every unbounded object, and sorts the appended range so that objects are
+  // visited in scene order
+  void query(const BBox &box, vector<int> &out) const;
+
+  // Collides count points with the objects near them: the points are split
+  // into small batches, and every batch only goes through the batched
+  // collide of the objects that overlap its bounds. A point pushed by one
+  // object into another that was not near its batch is only caught on the
+  // next substep. candidates is scratch space, one per thread.
+  void collide(const vector<CollisionObject *> &objects, Vector3D *positions,
+               const Vector3D *last_positions, long count,
+               vector<int> &candidates) const;
+
+  // Number of times the grid was built, for the benchmark
+  int builds = 0;
+
+private:
+  static const int BATCH_SIZE = 64;
+
+  void build();
+  void cell_range(const BBox &box, int lo[3], int hi[3]) const;
+
+  vector<const CollisionObject *> cached;
+  vector<BBox> bounds;
+  vector<int> unbounded;
+
+  BBox grid_bounds;
+  double inv_cell_size = 1;
+  int dims[3] = {0, 0, 0};
+  vector<int> cell_start, cell_objects;
+};
+
+#endif /* COLLISION_GRID_H */
@@ -1,18 +1,95 @@
 #ifndef COLLISIONOBJECT
 #define COLLISIONOBJECT
 
+#ifndef CLOTHSIM_HEADLESS
 #include <nanogui/nanogui.h>
+#endif
 
 #include "../clothMesh.h"
+#include "bbox.h"
 
 using namespace CGL;
 using namespace std;
+#ifndef CLOTHSIM_HEADLESS
 using namespace nanogui;
+#endif
 
 class CollisionObject {
 public:
+  virtual ~CollisionObject() {}
+
+  // Drawing is compiled out of headless builds (CLOTHSIM_HEADLESS), which
+  // link neither nanogui nor OpenGL
+#ifndef CLOTHSIM_HEADLESS
   virtual void render(GLShader &shader) = 0;
-  virtual void collide(PointMass &pm) = 0;
+  // Draws the object in its pose at the given simulation time, which may be
+  // behind the one it was last moved to when the simulation runs on another
+  // thread. Only moving objects need to override it.
+  virtual void render_at(GLShader &shader, double time) { render(shader); }
+#endif
+  virtual void collide(Vector3D &position, const Vector3D &last_position) = 0;
+
+  // Collides count points at once. Primitives override this with a cheap
+  // test over the whole batch that picks out the few points that may be in
+  // contact; the default falls back to the single-point collide.
+  virtual void collide(Vector3D *positions, const Vector3D *last_positions, long count) {
+    for (long i = 0; i < count; i++) { collide(positions[i], last_positions[i]); }
+  }
+
+  // Region outside of which the object never moves a point; the default is
+  // unbounded, so objects that do not override it are tested against every
+  // point
+  virtual BBox bounds() const { return BBox::infinite(); }
+
+  // Moves the object to its pose at the given simulation time; called
+  // before the collisions of every substep. Static objects ignore it.
+  virtual void move_to(double time) {}
+
+protected:
+  // Points tested together before any response is computed
+  static const int BATCH_SIZE = 64;
+
+  // Skeleton of the batched collide of a primitive: near(p, q) is a cheap,
+  // branch-free test of the path from q to p over the substep, evaluated
+  // for a whole batch at once; only the points it picks out go on to the
+  // single-point collide, and batches with none are skipped.
+  template <typename Near>
+  void collide_batch(Vector3D *positions, const Vector3D *last_positions, long count,
+                     Near near) {
+    unsigned char hit[BATCH_SIZE];
+    for (long begin = 0; begin < count; begin += BATCH_SIZE) {
+      int n = (int)min<long>(BATCH_SIZE, count - begin);
+      const Vector3D *p = positions + begin;
+      const Vector3D *q = last_positions + begin;
+      int hits = 0;
+      for (int k = 0; k < n; k++) {
+        hit[k] = near(p[k], q[k]);
+        hits += hit[k];
+      }
+      if (hits == 0) { continue; }
+      for (int k = 0; k < n; k++) {
+        if (hit[k]) { collide(positions[begin + k], last_positions[begin + k]); }
+      }
+    }
+  }
+
+  // Whether a path of squared length m2 whose midpoint lies at squared
+  // distance d2 from a point (or a segment) may come within the radius of
+  // it: a path within the radius has its midpoint within the radius plus
+  // half its length, |d| <= radius + |m| / 2, squared twice to avoid the
+  // square roots
+  static bool path_within(double d2, double m2, double radius2) {
+    double h2 = 0.25 * m2;
+    double e = d2 - radius2 - h2;
+    return (e <= 0) | (e * e <= 4 * radius2 * h2);
+  }
+
+  // Whether the bounds of the path from q to p overlap b
+  static bool path_overlaps(const Vector3D &p, const Vector3D &q, const BBox &b) {
+    return (min(p.x, q.x) <= b.max.x) & (max(p.x, q.x) >= b.min.x) &
+           (min(p.y, q.y) <= b.max.y) & (max(p.y, q.y) >= b.min.y) &
+           (min(p.z, q.z) <= b.max.z) & (max(p.z, q.z) >= b.min.z);
+  }
 
 private:
   double friction;
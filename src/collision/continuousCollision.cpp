@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <cmath>
+
+#include "continuousCollision.h"
+#include "geometry.h"
+#include "../cloth.h"
+#include "../misc/thread_utils.h"
+
+// Roots in [0, 1] of k0 + k1 t + k2 t^2 + k3 t^3, in increasing order. The
+// interval is split at the extrema of the cubic, so every piece is monotonic
+// and holds at most one root, which is found by bisection.
+static int unit_roots(const double k[4], double roots[3]) {
+  auto f = [&](double t) { return k[0] + t * (k[1] + t * (k[2] + t * k[3])); };
+
+  // Extrema: roots of k1 + 2 k2 t + 3 k3 t^2
+  double splits[4];
+  int num_splits = 0;
+  splits[num_splits++] = 0;
+  double a = 3 * k[3], b = 2 * k[2], c = k[1];
+  if (fabs(a) > 1e-300) {
+    double disc = b * b - 4 * a * c;
+    if (disc >= 0) {
+      double s = sqrt(disc);
+      double r1 = (-b - s) / (2 * a), r2 = (-b + s) / (2 * a);
+      if (r1 > r2) { swap(r1, r2); }
+      if (r1 > 0 && r1 < 1) { splits[num_splits++] = r1; }
+      if (r2 > 0 && r2 < 1 && r2 != r1) { splits[num_splits++] = r2; }
+    }
+  } else if (fabs(b) > 1e-300) {
+    double r = -c / b;
+    if (r > 0 && r < 1) { splits[num_splits++] = r; }
+  }
+  splits[num_splits++] = 1;
+
+  int num_roots = 0;
+  for (int i = 0; i + 1 < num_splits; i++) {
+    double lo = splits[i], hi = splits[i + 1];
+    double flo = f(lo), fhi = f(hi);
+    if (flo == 0) {
+      if (num_roots == 0 || roots[num_roots - 1] != lo) { roots[num_roots++] = lo; }
+      continue;
+    }
+    if ((flo < 0) == (fhi < 0) && fhi != 0) { continue; }
+    for (int iter = 0; iter < 40; iter++) {
+      double mid = 0.5 * (lo + hi);
+      double fmid = f(mid);
+      if ((fmid < 0) == (flo < 0) && fmid != 0) {
+        lo = mid;
+        flo = fmid;
+      } else {
+        hi = mid;
+      }
+    }
+    if (num_roots < 3) { roots[num_roots++] = hi; }
+  }
+  return num_roots;
+}
+
+// Coefficients of the cubic dot(q(t), cross(u(t), w(t))), for vectors that
+// move linearly from q0 to q0 + dq etc. over the substep
+static void coplanarity(const Vector3D &q0, const Vector3D &dq,
+                        const Vector3D &u0, const Vector3D &du,
+                        const Vector3D &w0, const Vector3D &dw, double k[4]) {
+  Vector3D c0 = cross(u0, w0);
+  Vector3D c1 = cross(u0, dw) + cross(du, w0);
+  Vector3D c2 = cross(du, dw);
+  k[0] = dot(q0, c0);
+  k[1] = dot(q0, c1) + dot(dq, c0);
+  k[2] = dot(q0, c2) + dot(dq, c1);
+  k[3] = dot(dq, c2);
+}
+
+static inline Vector3D lerp(const Vector3D &a, const Vector3D &b, double t) {
+  return a + t * (b - a);
+}
+
+void ContinuousCollision::build(Cloth *cloth) {
+  const vector<Triangle *> &mesh = cloth->clothMesh->triangles;
+  triangles.resize(3 * mesh.size());
+  for (size_t t = 0; t < mesh.size(); t++) {
+    triangles[3 * t] = mesh[t]->pm1->index;
+    triangles[3 * t + 1] = mesh[t]->pm2->index;
+    triangles[3 * t + 2] = mesh[t]->pm3->index;
+  }
+
+  // Unique edges, numbered in order of their sorted endpoints
+  vector<pair<pair<int, int>, int>> sides(triangles.size());
+  for (size_t i = 0; i < triangles.size(); i++) {
+    int a = triangles[i], b = triangles[i - i % 3 + (i + 1) % 3];
+    sides[i] = make_pair(make_pair(min(a, b), max(a, b)), (int)i);
+  }
+  sort(sides.begin(), sides.end());
+  edges.clear();
+  edge_owner.clear();
+  triangle_edges.resize(triangles.size());
+  for (size_t i = 0; i < sides.size(); i++) {
+    if (i == 0 || sides[i].first != sides[i - 1].first) {
+      edges.push_back(sides[i].first.first);
+      edges.push_back(sides[i].first.second);
+      edge_owner.push_back(sides[i].second / 3);
+    }
+    triangle_edges[sides[i].second] = (int)edges.size() / 2 - 1;
+  }
+
+  // The first triangle around a vertex owns it
+  vertex_owner.assign(cloth->particles.size(), -1);
+  for (size_t i = triangles.size(); i-- > 0;) { vertex_owner[triangles[i]] = (int)i / 3; }
+
+  // The hierarchy is built from the rest shape and only refit afterwards
+  const ParticleStore &particles = cloth->particles;
+  boxes.resize(mesh.size());
+  for (size_t t = 0; t < mesh.size(); t++) {
+    BBox box;
+    for (int k = 0; k < 3; k++) { box.expand(particles.start_position[triangles[3 * t + k]]); }
+    boxes[t] = box;
+  }
+  bvh.build(boxes);
+  bvh.self_overlap_tasks(64 * ThreadUtils::max_threads(), tasks);
+  built = true;
+}
+
+void ContinuousCollision::test_triangles(int s, int t, vector<Impact> &out) const {
+  const int *a = &triangles[3 * s];
+  const int *b = &triangles[3 * t];
+  const int *ea = &triangle_edges[3 * s];
+  const int *eb = &triangle_edges[3 * t];
+
+  // Every vertex and edge is only tested from the triangle that owns it, so
+  // each feature pair is tested by exactly one triangle pair: the owners'
+  // swept bounds contain those of their features
+  Impact impact;
+  for (int i = 0; i < 3; i++) {
+    if (vertex_owner[a[i]] == s && a[i] != b[0] && a[i] != b[1] && a[i] != b[2] &&
+        test_vertex_face(a[i], t, impact)) {
+      out.push_back(impact);
+    }
+    if (vertex_owner[b[i]] == t && b[i] != a[0] && b[i] != a[1] && b[i] != a[2] &&
+        test_vertex_face(b[i], s, impact)) {
+      out.push_back(impact);
+    }
+  }
+  for (int i = 0; i < 3; i++) {
+    if (edge_owner[ea[i]] != s) { continue; }
+    for (int j = 0; j < 3; j++) {
+      if (edge_owner[eb[j]] != t) { continue; }
+      int e = ea[i], g = eb[j];
+      if (edges[2 * e] == edges[2 * g] || edges[2 * e] == edges[2 * g + 1] ||
+          edges[2 * e + 1] == edges[2 * g] || edges[2 * e + 1] == edges[2 * g + 1]) {
+        continue;
+      }
+      if (test_edge_edge(e, g, impact)) { out.push_back(impact); }
+    }
+  }
+}
+
+// Orients the impact normal from the second feature towards the first at the
+// start of the substep; if they start in contact, against their approach
+static void orient(Vector3D &normal, const Vector3D &start, const Vector3D &motion) {
+  double side = dot(start, normal);
+  if (side < 0 || (side == 0 && dot(motion, normal) > 0)) { normal = -normal; }
+}
+
+bool ContinuousCollision::test_vertex_face(int v, int f, Impact &impact) const {
+  // Most pairs of overlapping triangles are rejected by the swept bounds of
+  // their features, without solving the cubic
+  BBox swept(x0[v]);
+  swept.expand(x1[v]);
+  if (!swept.overlaps(boxes[f])) { return false; }
+
+  // or because they start further apart than they can move, which is first
+  // checked against the bounding sphere of the face
+  int a = triangles[3 * f], b = triangles[3 * f + 1], c = triangles[3 * f + 2];
+  double reach = separation + motion[v] + max(motion[a], max(motion[b], motion[c]));
+  double sphere = reach + face_radius[f];
+  if ((x0[v] - face_center[f]).norm2() > sphere * sphere) { return false; }
+  Vector3D start_bary = closest_on_triangle(x0[v], x0[a], x0[b], x0[c]);
+  Vector3D start_closest = start_bary.x * x0[a] + start_bary.y * x0[b] + start_bary.z * x0[c];
+  if ((x0[v] - start_closest).norm2() > reach * reach) { return false; }
+  Vector3D q0 = x0[v] - x0[a], u0 = x0[b] - x0[a], w0 = x0[c] - x0[a];
+  Vector3D dq = (x1[v] - x1[a]) - q0;
+  Vector3D du = (x1[b] - x1[a]) - u0;
+  Vector3D dw = (x1[c] - x1[a]) - w0;
+
+  double k[4], roots[3];
+  coplanarity(q0, dq, u0, du, w0, dw, k);
+  int num_roots = unit_roots(k, roots);
+  for (int r = 0; r < num_roots; r++) {
+    double t = roots[r];
+    Vector3D p = lerp(x0[v], x1[v], t);
+    Vector3D pa = lerp(x0[a], x1[a], t), pb = lerp(x0[b], x1[b], t), pc = lerp(x0[c], x1[c], t);
+    Vector3D bary = closest_on_triangle(p, pa, pb, pc);
+    Vector3D closest = bary.x * pa + bary.y * pb + bary.z * pc;
+    if ((p - closest).norm() >= separation) { continue; }
+
+    Vector3D normal = cross(pb - pa, pc - pa);
+    if (normal.norm2() == 0) { normal = p - closest; }
+    if (normal.norm2() == 0) { continue; }
+    normal.normalize();
+
+    impact.key = ((uint64_t)v << 32) | (uint64_t)f;
+    impact.v[0] = v; impact.v[1] = a; impact.v[2] = b; impact.v[3] = c;
+    impact.w[0] = 1; impact.w[1] = -bary.x; impact.w[2] = -bary.y; impact.w[3] = -bary.z;
+    Vector3D start = x0[v] - (bary.x * x0[a] + bary.y * x0[b] + bary.z * x0[c]);
+    Vector3D end = x1[v] - (bary.x * x1[a] + bary.y * x1[b] + bary.z * x1[c]);
+    orient(normal, start, end - start);
+    impact.normal = normal;
+    return true;
+  }
+  return false;
+}
+
+bool ContinuousCollision::test_edge_edge(int e, int g, Impact &impact) const {
+  int p0 = edges[2 * e], p1 = edges[2 * e + 1];
+  int q0 = edges[2 * g], q1 = edges[2 * g + 1];
+  BBox swept_e(x0[p0]), swept_g(x0[q0]);
+  swept_e.expand(x0[p1]);
+  swept_e.expand(x1[p0]);
+  swept_e.expand(x1[p1]);
+  swept_e.pad(separation);
+  swept_g.expand(x0[q1]);
+  swept_g.expand(x1[q0]);
+  swept_g.expand(x1[q1]);
+  if (!swept_e.overlaps(swept_g)) { return false; }
+
+  double reach = separation + max(motion[p0], motion[p1]) + max(motion[q0], motion[q1]);
+  double sphere = reach + edge_radius[e] + edge_radius[g];
+  if ((edge_center[e] - edge_center[g]).norm2() > sphere * sphere) { return false; }
+  double start_s, start_u;
+  closest_on_segments(x0[p0], x0[p1], x0[q0], x0[q1], start_s, start_u);
+  Vector3D start_gap = lerp(x0[p0], x0[p1], start_s) - lerp(x0[q0], x0[q1], start_u);
+  if (start_gap.norm2() > reach * reach) { return false; }
+
+  Vector3D r0 = x0[q0] - x0[p0], u0 = x0[p1] - x0[p0], w0 = x0[q1] - x0[q0];
+  Vector3D dr = (x1[q0] - x1[p0]) - r0;
+  Vector3D du = (x1[p1] - x1[p0]) - u0;
+  Vector3D dw = (x1[q1] - x1[q0]) - w0;
+
+  double k[4], roots[3];
+  coplanarity(r0, dr, u0, du, w0, dw, k);
+  int num_roots = unit_roots(k, roots);
+  for (int r = 0; r < num_roots; r++) {
+    double t = roots[r];
+    Vector3D a0 = lerp(x0[p0], x1[p0], t), a1 = lerp(x0[p1], x1[p1], t);
+    Vector3D b0 = lerp(x0[q0], x1[q0], t), b1 = lerp(x0[q1], x1[q1], t);
+    double s, u;
+    closest_on_segments(a0, a1, b0, b1, s, u);
+    Vector3D gap = lerp(a0, a1, s) - lerp(b0, b1, u);
+    if (gap.norm() >= separation) { continue; }
+
+    Vector3D normal = cross(a1 - a0, b1 - b0);
+    if (normal.norm2() == 0) { normal = gap; }
+    if (normal.norm2() == 0) { continue; }
+    normal.normalize();
+
+    impact.key = (1ull << 63) | ((uint64_t)min(e, g) << 32) | (uint64_t)max(e, g);
+    impact.v[0] = p0; impact.v[1] = p1; impact.v[2] = q0; impact.v[3] = q1;
+    impact.w[0] = 1 - s; impact.w[1] = s; impact.w[2] = -(1 - u); impact.w[3] = -u;
+    Vector3D start = lerp(x0[p0], x0[p1], s) - lerp(x0[q0], x0[q1], u);
+    Vector3D end = lerp(x1[p0], x1[p1], s) - lerp(x1[q0], x1[q1], u);
+    orient(normal, start, end - start);
+    impact.normal = normal;
+    return true;
+  }
+  return false;
+}
+
+bool ContinuousCollision::apply(Cloth *cloth, const Impact &impact) {
+  const vector<double> &inv_mass = cloth->particles.inv_mass;
+
+  // Normal distance at the start of the substep and its change over it
+  double start = 0, motion = 0, denom = 0;
+  for (int k = 0; k < 4; k++) {
+    int v = impact.v[k];
+    start += impact.w[k] * dot(x0[v], impact.normal);
+    motion += impact.w[k] * dot(x1[v] - x0[v], impact.normal);
+    denom += impact.w[k] * impact.w[k] * inv_mass[v];
+  }
+
+  // Inelastic response: the pair may approach to the separation distance
+  // (or stay as close as it started) but no closer
+  double target = min(max(start, 0.0), separation);
+  double delta = target - (start + motion);
+  if (delta <= 0 || denom <= 0) { return false; }
+
+  for (int k = 0; k < 4; k++) {
+    int v = impact.v[k];
+    x1[v] += (impact.w[k] * inv_mass[v] * delta / denom) * impact.normal;
+  }
+  return true;
+}
+
+void ContinuousCollision::resolve(Cloth *cloth, ClothParameters *cp,
+                                  int num_threads) {
+  impacts = 0;
+  if (!cloth->clothMesh) { return; }
+  if (!built || triangles.size() != 3 * cloth->clothMesh->triangles.size()) {
+    build(cloth);
+  }
+
+  ParticleStore &particles = cloth->particles;
+  long num_points = particles.size();
+  long num_triangles = triangles.size() / 3;
+  long num_edges = edges.size() / 2;
+  separation = 0.1 * cloth->thickness;
+  x0.resize(num_points);
+  x1.resize(num_points);
+  motion.resize(num_points);
+  face_center.resize(num_triangles);
+  face_radius.resize(num_triangles);
+  edge_center.resize(num_edges);
+  edge_radius.resize(num_edges);
+
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long i = 0; i < num_points; i++) {
+    x0[i] = particles.get_last_position(i);
+    x1[i] = particles.get_position(i);
+  }
+
+  // Bounding spheres of the faces and edges at the start of the substep
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long t = 0; t < num_triangles; t++) {
+    const int *v = &triangles[3 * t];
+    Vector3D center = (x0[v[0]] + x0[v[1]] + x0[v[2]]) / 3;
+    face_center[t] = center;
+    face_radius[t] = sqrt(max((x0[v[0]] - center).norm2(),
+                              max((x0[v[1]] - center).norm2(), (x0[v[2]] - center).norm2())));
+  }
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long e = 0; e < num_edges; e++) {
+    edge_center[e] = 0.5 * (x0[edges[2 * e]] + x0[edges[2 * e + 1]]);
+    edge_radius[e] = 0.5 * (x0[edges[2 * e]] - x0[edges[2 * e + 1]]).norm();
+  }
+
+  thread_impacts.resize(num_threads);
+  for (int iter = 0; iter < cp->ccd_iterations; iter++) {
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (long i = 0; i < num_points; i++) {
+      motion[i] = (x1[i] - x0[i]).norm();
+    }
+
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (long t = 0; t < num_triangles; t++) {
+      BBox box;
+      for (int k = 0; k < 3; k++) {
+        box.expand(x0[triangles[3 * t + k]]);
+        box.expand(x1[triangles[3 * t + k]]);
+      }
+      box.pad(separation);
+      boxes[t] = box;
+    }
+    bvh.refit(boxes, num_threads);
+
+    // Overlapping leaf pairs come from descending the hierarchy against
+    // itself, split into tasks for the threads
+    for (auto &buffer : thread_impacts) { buffer.clear(); }
+    long num_tasks = tasks.size();
+    #pragma omp parallel for num_threads(num_threads) schedule(dynamic, 1)
+    for (long k = 0; k < num_tasks; k++) {
+      vector<Impact> &out = thread_impacts[ThreadUtils::thread_num()];
+      bvh.self_overlaps(tasks[k].first, tasks[k].second, [&](int m, int n) {
+        const TriangleBVH::Node &leaf = bvh.nodes[m], &other = bvh.nodes[n];
+        for (int i = leaf.begin; i < leaf.end; i++) {
+          int s = bvh.order[i];
+          for (int j = (m == n) ? i + 1 : other.begin; j < other.end; j++) {
+            int t = bvh.order[j];
+            if (boxes[s].overlaps(boxes[t])) { test_triangles(s, t, out); }
+          }
+        }
+      });
+    }
+
+    // Sorting makes the order of the responses independent of the threads
+    sorted.clear();
+    for (auto &buffer : thread_impacts) { sorted.insert(sorted.end(), buffer.begin(), buffer.end()); }
+    sort(sorted.begin(), sorted.end(),
+         [](const Impact &a, const Impact &b) { return a.key < b.key; });
+
+    int applied = 0;
+    for (const Impact &impact : sorted) {
+      if (apply(cloth, impact)) { applied++; }
+    }
+    impacts += applied;
+    if (applied == 0) { break; }
+  }
+
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long i = 0; i < num_points; i++) {
+    particles.set_position(i, x1[i]);
+  }
+}
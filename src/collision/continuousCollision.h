@@ -0,0 +1,91 @@
+#ifndef CONTINUOUS_COLLISION_H
+#define CONTINUOUS_COLLISION_H
+
+#include <cstdint>
+#include <vector>
+
+#include "CGL/CGL.h"
+#include "CGL/vector3D.h"
+#include "bbox.h"
+#include "triangleBVH.h"
+
+using namespace CGL;
+using namespace std;
+
+struct Cloth;
+struct ClothParameters;
+
+// Continuous self-collision of the cloth triangles [Bridson et al. 2002].
+// Over a substep every particle moves along the segment from its last
+// position to its position. A vertex-face or edge-edge pair collides if its
+// four points become coplanar at some time in [0, 1] of the substep (the
+// root of a cubic) while the vertex lies on the face, or the edges cross.
+//
+// Candidate pairs come from a BVH over the swept triangle bounds, which is
+// built once from the mesh and refit every substep, traversed against itself
+// in parallel into per-thread impact buffers. The impacts are then sorted, so
+// they are handled in the same order whatever the thread count, and resolved
+// with inelastic impulses that stop each pair from approaching closer than a
+// tenth of the cloth thickness. Resolving one
+// impact may cause another, so detection and response are repeated up to
+// ccd_iterations times.
+struct ContinuousCollision {
+  // Moves the positions of the cloth so that no vertex passes through a
+  // triangle and no edge through another edge during the last substep
+  void resolve(Cloth *cloth, ClothParameters *cp, int num_threads);
+
+  // Drops the triangles and the hierarchy, e.g. after the mesh was rebuilt
+  void invalidate() { built = false; }
+
+  // Impacts resolved during the last substep, over all iterations
+  int impacts = 0;
+
+private:
+  // An impact moves the relative position sum_k w[k] x[v[k]] along normal:
+  // w = (1, -b0, -b1, -b2) for a vertex against the barycentric point b of a
+  // face, or (1 - a, a, -(1 - b), -b) for edge-edge. key identifies the pair.
+  struct Impact {
+    uint64_t key;
+    int v[4];
+    double w[4];
+    Vector3D normal;
+  };
+
+  void build(Cloth *cloth);
+
+  // Appends the impacts between triangles s and t to out
+  void test_triangles(int s, int t, vector<Impact> &out) const;
+  bool test_vertex_face(int v, int f, Impact &impact) const;
+  bool test_edge_edge(int e, int g, Impact &impact) const;
+
+  // Applies one impact to the positions; returns false if the pair already
+  // separates
+  bool apply(Cloth *cloth, const Impact &impact);
+
+  bool built = false;
+  double separation = 0;
+
+  // Mesh topology: vertices and edges of every triangle, endpoints of every
+  // edge, and the triangle that owns every vertex and edge
+  vector<int> triangles;
+  vector<int> triangle_edges;
+  vector<int> edges;
+  vector<int> vertex_owner, edge_owner;
+
+  // Start and end positions of the substep, distance moved in between, and
+  // swept triangle bounds
+  vector<Vector3D> x0, x1;
+  vector<double> motion;
+
+  // Bounding spheres of the faces and edges at the start of the substep
+  vector<Vector3D> face_center, edge_center;
+  vector<double> face_radius, edge_radius;
+  vector<BBox> boxes;
+  TriangleBVH bvh;
+  vector<pair<int, int>> tasks;
+
+  vector<vector<Impact>> thread_impacts;
+  vector<Impact> sorted;
+};
+
+#endif /* CONTINUOUS_COLLISION_H */
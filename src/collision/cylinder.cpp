@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cmath>
+
+#include "../clothMesh.h"
+#include "cylinder.h"
+#include "geometry.h"
+
+using namespace CGL;
+
+Cylinder::Cylinder(const Vector3D &a, const Vector3D &b, double radius, double friction,
+                   int num_lon)
+    : a(a), b(b), radius(radius), friction(friction), radius2(radius * radius) {
+  length = (b - a).norm();
+  axis = length > 0 ? (b - a) / length : Vector3D(0, 1, 0);
+
+#ifndef CLOTHSIM_HEADLESS
+  Vector3D u = cross(axis, fabs(axis.x) < 0.9 ? Vector3D(1, 0, 0) : Vector3D(0, 1, 0)).unit();
+  Vector3D v = cross(axis, u);
+  num_lon = max(3, num_lon);
+
+  // Side quads, then a triangle fan for each cap; drawn slightly thinner,
+  // as spheres are, so that the flat cloth triangles do not cut into it
+  double render_radius = radius * 0.92;
+  render_positions = MatrixXf(3, 12 * num_lon);
+  render_normals = MatrixXf(4, 12 * num_lon);
+  int column = 0;
+  auto vertex = [&](const Vector3D &p, const Vector3D &n) {
+    render_positions.col(column) << p.x, p.y, p.z;
+    render_normals.col(column) << n.x, n.y, n.z, 0.0;
+    column++;
+  };
+  for (int j = 0; j < num_lon; j++) {
+    double phi0 = 2 * PI * j / num_lon, phi1 = 2 * PI * (j + 1) / num_lon;
+    Vector3D n0 = cos(phi0) * u + sin(phi0) * v, n1 = cos(phi1) * u + sin(phi1) * v;
+    Vector3D a0 = a + render_radius * n0, a1 = a + render_radius * n1;
+    Vector3D b0 = b + render_radius * n0, b1 = b + render_radius * n1;
+    vertex(a0, n0);
+    vertex(b0, n0);
+    vertex(b1, n1);
+    vertex(b1, n1);
+    vertex(a1, n1);
+    vertex(a0, n0);
+    vertex(a, -axis);
+    vertex(a1, -axis);
+    vertex(a0, -axis);
+    vertex(b, axis);
+    vertex(b0, axis);
+    vertex(b1, axis);
+  }
+#endif
+}
+
+bool Cylinder::sweep(const Vector3D &from, const Vector3D &to, double &s) const {
+  Vector3D m = to - from;
+  // Two points outside are joined by a path no deeper than half its length
+  if (m.norm2() < 4 * GRAZE_DEPTH * GRAZE_DEPTH * radius2) { return false; }
+
+  // Between the caps: 0 <= t0 + s tm <= length
+  Vector3D ap = from - a;
+  double t0 = dot(ap, axis), tm = dot(m, axis);
+  double lo = 0, hi = 1;
+  if (tm != 0) {
+    double s0 = -t0 / tm, s1 = (length - t0) / tm;
+    lo = max(lo, min(s0, s1));
+    hi = min(hi, max(s0, s1));
+  } else if (t0 < 0 || t0 > length) {
+    return false;
+  }
+
+  // Within the radius: |r0 + s rm|^2 <= radius^2
+  Vector3D r0 = ap - t0 * axis, rm = m - tm * axis;
+  double qa = rm.norm2(), qb = dot(r0, rm), qc = r0.norm2() - radius2;
+  if (qa > 0) {
+    double disc = qb * qb - qa * qc;
+    if (disc < 0) { return false; }
+    double root = sqrt(disc);
+    lo = max(lo, (-qb - root) / qa);
+    hi = min(hi, (-qb + root) / qa);
+  } else if (qc > 0) {
+    return false;
+  }
+  if (lo > hi || lo <= 0) { return false; }
+
+  // The middle of the part inside is at least as deep as its ends
+  Vector3D mid = from + (0.5 * (lo + hi)) * m - a;
+  double t = dot(mid, axis);
+  double depth = min(min(t, length - t), radius - (mid - t * axis).norm());
+  if (depth < GRAZE_DEPTH * radius) { return false; }
+  s = lo;
+  return true;
+}
+
+void Cylinder::collide(Vector3D &position, const Vector3D &last_position) {
+  Vector3D ap = position - a;
+  double t = dot(ap, axis);
+  Vector3D radial = ap - t * axis;
+  double r2 = radial.norm2();
+  if (t < 0 || t > length || r2 > radius2) {
+    // Stopped where the path entered, if it went through the cylinder
+    double s;
+    if (!sweep(last_position, position, s)) { return; }
+    Vector3D entry = last_position + s * (position - last_position);
+    position = last_position + (entry - last_position) * (1 - friction);
+    return;
+  }
+
+  // Leave through the nearest of the side and the two caps
+  double r = sqrt(r2);
+  double side = radius - r, bottom = t, top = length - t;
+  Vector3D tangent;
+  if (side <= bottom && side <= top && r > 0) {
+    tangent = a + t * axis + radial * (radius / r);
+  } else if (bottom <= top) {
+    tangent = position - t * axis;
+  } else {
+    tangent = position + top * axis;
+  }
+  Vector3D correction = tangent - last_position;
+  position = last_position + correction * (1 - friction);
+}
+
+void Cylinder::collide(Vector3D *positions, const Vector3D *last_positions, long count) {
+  // Branch-free test against the capsule around the cylinder, as in
+  // Capsule::collide; only the points whose path over the substep may reach
+  // it go on to the response
+  collide_batch(positions, last_positions, count, [&](const Vector3D &p, const Vector3D &q) {
+    double px = 0.5 * (p.x + q.x) - a.x, py = 0.5 * (p.y + q.y) - a.y,
+           pz = 0.5 * (p.z + q.z) - a.z;
+    double t = px * axis.x + py * axis.y + pz * axis.z;
+    t = min(max(t, 0.0), length);
+    double dx = px - t * axis.x, dy = py - t * axis.y, dz = pz - t * axis.z;
+    double mx = p.x - q.x, my = p.y - q.y, mz = p.z - q.z;
+    return path_within(dx * dx + dy * dy + dz * dz, mx * mx + my * my + mz * mz, radius2);
+  });
+}
+
+#ifndef CLOTHSIM_HEADLESS
+void Cylinder::render(GLShader &shader) {
+  nanogui::Color color(0.45f, 0.32f, 0.2f, 1.0f);
+
+  if (shader.uniform("u_color", false) != -1) {
+    shader.setUniform("u_color", color);
+  }
+  shader.uploadAttrib("in_position", render_positions);
+  if (shader.attrib("in_normal", false) != -1) {
+    shader.uploadAttrib("in_normal", render_normals);
+  }
+
+  shader.drawArray(GL_TRIANGLES, 0, render_positions.cols());
+}
+#endif
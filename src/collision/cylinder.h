@@ -0,0 +1,58 @@
+#ifndef COLLISIONOBJECT_CYLINDER_H
+#define COLLISIONOBJECT_CYLINDER_H
+
+#ifndef CLOTHSIM_HEADLESS
+#include <nanogui/nanogui.h>
+#endif
+
+#include "../clothMesh.h"
+#include "collisionObject.h"
+
+#ifndef CLOTHSIM_HEADLESS
+using namespace nanogui;
+#endif
+using namespace CGL;
+using namespace std;
+
+// Solid cylinder of the given radius around the segment from a to b, with
+// flat caps at both ends. A point that ends a substep outside is still
+// stopped where its path entered the cylinder, if it passed through it, so
+// that a fast moving cylinder does not tunnel through thin cloth.
+struct Cylinder : public CollisionObject {
+public:
+  Cylinder(const Vector3D &a, const Vector3D &b, double radius, double friction,
+           int num_lon = 40);
+
+#ifndef CLOTHSIM_HEADLESS
+  void render(GLShader &shader);
+#endif
+  void collide(Vector3D &position, const Vector3D &last_position);
+  void collide(Vector3D *positions, const Vector3D *last_positions, long count);
+  BBox bounds() const {
+    BBox box(a);
+    box.expand(b);
+    box.pad(radius);
+    return box;
+  }
+
+  Vector3D a, b;
+  double radius;
+
+  double friction;
+
+private:
+  // Parameter s in [0, 1] at which the path from + s (to - from), starting
+  // outside, enters the cylinder; false if it misses it or only grazes it
+  bool sweep(const Vector3D &from, const Vector3D &to, double &s) const;
+
+  // Unit axis from a to b, and the length of the segment
+  Vector3D axis;
+  double length;
+  double radius2;
+
+#ifndef CLOTHSIM_HEADLESS
+  MatrixXf render_positions, render_normals;
+#endif
+};
+
+#endif /* COLLISIONOBJECT_CYLINDER_H */
@@ -0,0 +1,118 @@
+#ifndef COLLISION_GEOMETRY_H
+#define COLLISION_GEOMETRY_H
+
+#include <algorithm>
+
+#include "CGL/CGL.h"
+#include "CGL/vector3D.h"
+
+using namespace CGL;
+
+// Depth, as a fraction of the radius, that a path must reach inside a
+// sphere, capsule or cylinder to be stopped by the swept tests. A point
+// sliding over the surface ends each substep just outside, but its straight
+// path between two such positions cuts slightly into the curved side.
+#define GRAZE_DEPTH 0.1
+
+// Closest point to p on triangle abc, as barycentric weights [Ericson 2004]
+inline Vector3D closest_on_triangle(const Vector3D &p, const Vector3D &a,
+                                    const Vector3D &b, const Vector3D &c) {
+  Vector3D ab = b - a, ac = c - a, ap = p - a;
+  double d1 = dot(ab, ap), d2 = dot(ac, ap);
+  if (d1 <= 0 && d2 <= 0) { return Vector3D(1, 0, 0); }
+
+  Vector3D bp = p - b;
+  double d3 = dot(ab, bp), d4 = dot(ac, bp);
+  if (d3 >= 0 && d4 <= d3) { return Vector3D(0, 1, 0); }
+
+  double vc = d1 * d4 - d3 * d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+    double v = d1 / (d1 - d3);
+    return Vector3D(1 - v, v, 0);
+  }
+
+  Vector3D cp = p - c;
+  double d5 = dot(ab, cp), d6 = dot(ac, cp);
+  if (d6 >= 0 && d5 <= d6) { return Vector3D(0, 0, 1); }
+
+  double vb = d5 * d2 - d1 * d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+    double w = d2 / (d2 - d6);
+    return Vector3D(1 - w, 0, w);
+  }
+
+  double va = d3 * d6 - d5 * d4;
+  if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+    double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    return Vector3D(0, 1 - w, w);
+  }
+
+  double denom = 1 / (va + vb + vc);
+  double v = vb * denom, w = vc * denom;
+  return Vector3D(1 - v - w, v, w);
+}
+
+// Parameters s, t in [0, 1] of the closest points p0 + s (p1 - p0) and
+// q0 + t (q1 - q0) of two segments [Ericson 2004]
+inline void closest_on_segments(const Vector3D &p0, const Vector3D &p1,
+                                const Vector3D &q0, const Vector3D &q1,
+                                double &s, double &t) {
+  Vector3D d1 = p1 - p0, d2 = q1 - q0, r = p0 - q0;
+  double a = dot(d1, d1), e = dot(d2, d2), f = dot(d2, r);
+  const double eps = 1e-20;
+  if (a <= eps && e <= eps) {
+    s = t = 0;
+    return;
+  }
+  if (a <= eps) {
+    s = 0;
+    t = std::min(1.0, std::max(0.0, f / e));
+    return;
+  }
+  double c = dot(d1, r);
+  if (e <= eps) {
+    t = 0;
+    s = std::min(1.0, std::max(0.0, -c / a));
+    return;
+  }
+  double b = dot(d1, d2);
+  double denom = a * e - b * b;
+  s = denom > eps ? std::min(1.0, std::max(0.0, (b * f - c * e) / denom)) : 0;
+  t = (b * s + f) / e;
+  if (t < 0) {
+    t = 0;
+    s = std::min(1.0, std::max(0.0, -c / a));
+  } else if (t > 1) {
+    t = 1;
+    s = std::min(1.0, std::max(0.0, (b - c) / a));
+  }
+}
+
+// Parameter t in [0, 1] of the point a + t ab of a segment closest to p,
+// given inv_length2 = 1 / |ab|^2 (zero for a degenerate segment)
+inline double closest_on_segment(const Vector3D &p, const Vector3D &a,
+                                 const Vector3D &ab, double inv_length2) {
+  double t = dot(p - a, ab) * inv_length2;
+  return t < 0 ? 0 : (t > 1 ? 1 : t);
+}
+
+// Whether the ray o + t d, t > 0, crosses triangle abc [Moller and Trumbore
+// 1997]; t is set to the distance along d on a hit
+inline bool ray_triangle(const Vector3D &o, const Vector3D &d, const Vector3D &a,
+                         const Vector3D &b, const Vector3D &c, double &t) {
+  Vector3D ab = b - a, ac = c - a;
+  Vector3D p = cross(d, ac);
+  double det = dot(ab, p);
+  if (det == 0) { return false; }
+  double inv_det = 1 / det;
+  Vector3D ao = o - a;
+  double u = dot(ao, p) * inv_det;
+  if (u < 0 || u > 1) { return false; }
+  Vector3D q = cross(ao, ab);
+  double v = dot(d, q) * inv_det;
+  if (v < 0 || u + v > 1) { return false; }
+  t = dot(ac, q) * inv_det;
+  return t > 0;
+}
+
+#endif /* COLLISION_GEOMETRY_H */
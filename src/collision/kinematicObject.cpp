@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cmath>
+
+#include "kinematicObject.h"
+
+using namespace CGL;
+
+// Rotation by |r| radians about r [Rodrigues]
+static Matrix3x3 axis_angle(const Vector3D &r) {
+  Matrix3x3 R = Matrix3x3::identity();
+  double angle = r.norm();
+  if (angle == 0) { return R; }
+  Vector3D k = r / angle;
+  double K[9] = {0, -k.z, k.y, k.z, 0, -k.x, -k.y, k.x, 0};
+  Matrix3x3 cross_k(K);
+  R += sin(angle) * cross_k;
+  R += (1 - cos(angle)) * (cross_k * cross_k);
+  return R;
+}
+
+void Motion::pose(double time, Matrix3x3 &rotation, Vector3D &translation) const {
+  Vector3D r = time * angular_velocity;
+  translation = time * velocity;
+
+  if (!keyframes.empty()) {
+    double start = keyframes.front().time, end = keyframes.back().time;
+    double t = time;
+    if (loop && end > start) {
+      t = start + fmod(t - start, end - start);
+      if (t < start) { t += end - start; }
+    }
+    size_t k = 0;
+    while (k + 1 < keyframes.size() && keyframes[k + 1].time <= t) { k++; }
+    const Keyframe &a = keyframes[k];
+    const Keyframe &b = keyframes[min(k + 1, keyframes.size() - 1)];
+    double s = b.time > a.time ? min(1.0, max(0.0, (t - a.time) / (b.time - a.time))) : 0;
+    translation += a.translation + s * (b.translation - a.translation);
+    r += a.rotation + s * (b.rotation - a.rotation);
+  }
+
+  rotation = axis_angle(r);
+}
+
+KinematicObject::KinematicObject(CollisionObject *shape, const Motion &motion)
+    : motion(motion), shape(shape), time(0) {
+  last_pose = pose = pose_at(0);
+  move_to(0);
+}
+
+KinematicObject::Pose KinematicObject::pose_at(double time) const {
+  Pose p;
+  motion.pose(time, p.rotation, p.translation);
+  return p;
+}
+
+Vector3D KinematicObject::to_local(const Pose &p, const Vector3D &x) const {
+  return p.rotation.T() * (x - motion.pivot - p.translation) + motion.pivot;
+}
+
+Vector3D KinematicObject::to_world(const Pose &p, const Vector3D &x) const {
+  return p.rotation * (x - motion.pivot) + motion.pivot + p.translation;
+}
+
+void KinematicObject::move_to(double time) {
+  // Going back in time (a reset) jumps there instead of sweeping
+  last_pose = time > this->time ? pose : pose_at(time);
+  pose = pose_at(time);
+  this->time = time;
+
+  // Bounds of the shape over the substep, from the corners of its rest
+  // bounds at both ends
+  BBox rest = shape->bounds();
+  swept_bounds = BBox();
+  for (int c = 0; c < 8; c++) {
+    Vector3D corner((c & 1) ? rest.max.x : rest.min.x, (c & 2) ? rest.max.y : rest.min.y,
+                    (c & 4) ? rest.max.z : rest.min.z);
+    if (!std::isfinite(corner.x) || !std::isfinite(corner.y) || !std::isfinite(corner.z)) {
+      swept_bounds = BBox::infinite();
+      return;
+    }
+    swept_bounds.expand(to_world(last_pose, corner));
+    swept_bounds.expand(to_world(pose, corner));
+  }
+}
+
+void KinematicObject::collide(Vector3D &position, const Vector3D &last_position) {
+  Vector3D local = to_local(pose, position);
+  Vector3D moved = local;
+  shape->collide(moved, to_local(last_pose, last_position));
+  if (!(moved == local)) { position = to_world(pose, moved); }
+}
+
+void KinematicObject::collide(Vector3D *positions, const Vector3D *last_positions, long count) {
+  // Points the shape leaves alone are not mapped back, so they keep their
+  // exact positions
+  Vector3D local[BATCH_SIZE], moved[BATCH_SIZE], local_last[BATCH_SIZE];
+  for (long begin = 0; begin < count; begin += BATCH_SIZE) {
+    int n = (int)min<long>(BATCH_SIZE, count - begin);
+    for (int k = 0; k < n; k++) {
+      local[k] = moved[k] = to_local(pose, positions[begin + k]);
+      local_last[k] = to_local(last_pose, last_positions[begin + k]);
+    }
+    shape->collide(moved, local_last, n);
+    for (int k = 0; k < n; k++) {
+      if (!(moved[k] == local[k])) { positions[begin + k] = to_world(pose, moved[k]); }
+    }
+  }
+}
+
+#ifndef CLOTHSIM_HEADLESS
+void KinematicObject::render(GLShader &shader) { render_pose(shader, pose); }
+
+void KinematicObject::render_at(GLShader &shader, double time) {
+  render_pose(shader, pose_at(time));
+}
+
+void KinematicObject::render_pose(GLShader &shader, const Pose &p) {
+  Matrix4f model;
+  model.setIdentity();
+  Vector3D offset = motion.pivot + p.translation - p.rotation * motion.pivot;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) { model(i, j) = p.rotation(i, j); }
+    model(i, 3) = offset[i];
+  }
+  shader.setUniform("u_model", model);
+  shape->render(shader);
+  model.setIdentity();
+  shader.setUniform("u_model", model);
+}
+#endif
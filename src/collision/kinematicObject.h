@@ -0,0 +1,88 @@
+#ifndef COLLISIONOBJECT_KINEMATIC_H
+#define COLLISIONOBJECT_KINEMATIC_H
+
+#include <vector>
+
+#ifndef CLOTHSIM_HEADLESS
+#include <nanogui/nanogui.h>
+#endif
+
+#include "CGL/matrix3x3.h"
+#include "../clothMesh.h"
+#include "collisionObject.h"
+
+#ifndef CLOTHSIM_HEADLESS
+using namespace nanogui;
+#endif
+using namespace CGL;
+using namespace std;
+
+// Scripted rigid motion: a rotation about pivot followed by a translation.
+// Keyframes are interpolated linearly in time, the rotation as an axis-angle
+// vector (exact for a swing about a fixed axis), and held before the first
+// and after the last one unless the motion loops. Constant velocities are
+// added on top, so a motion can also be given by velocities alone.
+struct Motion {
+  struct Keyframe {
+    double time;
+    Vector3D translation;
+    // Axis times angle, in radians
+    Vector3D rotation;
+  };
+
+  // Pose at the given time: x -> rotation (x - pivot) + pivot + translation
+  void pose(double time, Matrix3x3 &rotation, Vector3D &translation) const;
+
+  Vector3D pivot;
+  vector<Keyframe> keyframes;
+  bool loop = false;
+  Vector3D velocity;
+  Vector3D angular_velocity;
+};
+
+// Moves any collision object along a Motion. The shape is defined at rest;
+// every substep the simulation moves the object to the end of the substep,
+// so the pose is interpolated across substeps, and each point is collided
+// with the shape in its rest frame: the last position is mapped through the
+// pose at the start of the substep and the position through the pose at its
+// end. The shape then sees the motion of the point relative to itself, so a
+// moving plane catches points it sweeps over, and the other shapes, which
+// test the whole path of a point, catch points they pass through.
+struct KinematicObject : public CollisionObject {
+public:
+  // Takes ownership of shape
+  KinematicObject(CollisionObject *shape, const Motion &motion);
+  ~KinematicObject() { delete shape; }
+
+#ifndef CLOTHSIM_HEADLESS
+  void render(GLShader &shader);
+  void render_at(GLShader &shader, double time);
+#endif
+  void collide(Vector3D &position, const Vector3D &last_position);
+  void collide(Vector3D *positions, const Vector3D *last_positions, long count);
+  void move_to(double time);
+  BBox bounds() const { return swept_bounds; }
+
+  Motion motion;
+
+private:
+  struct Pose {
+    Matrix3x3 rotation;
+    Vector3D translation;
+  };
+
+  Pose pose_at(double time) const;
+#ifndef CLOTHSIM_HEADLESS
+  void render_pose(GLShader &shader, const Pose &pose);
+#endif
+  Vector3D to_local(const Pose &pose, const Vector3D &p) const;
+  Vector3D to_world(const Pose &pose, const Vector3D &p) const;
+
+  CollisionObject *shape;
+  double time;
+  // Poses at the start and the end of the current substep
+  Pose last_pose, pose;
+  BBox swept_bounds;
+};
+
+#endif /* COLLISIONOBJECT_KINEMATIC_H */
@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+#include "meshBVH.h"
+
+// Start of a cache file
+static const uint32_t BVH_MAGIC = 0x34485642; // "BVH4"
+
+static double surface_area(const BBox &box) {
+  Vector3D e = box.extent();
+  if (e.x < 0 || e.y < 0 || e.z < 0) { return 0; }
+  return 2 * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+void MeshBVH::build(const vector<Vector3D> &vertices, const vector<int> &indices) {
+  long num_triangles = indices.size() / 3;
+  nodes.clear();
+  triangles.clear();
+  bounds = BBox();
+  if (num_triangles == 0) { return; }
+
+  vector<BBox> boxes(num_triangles);
+  vector<Vector3D> centroids(num_triangles);
+  vector<int> order(num_triangles);
+  for (long t = 0; t < num_triangles; t++) {
+    for (int k = 0; k < 3; k++) { boxes[t].expand(vertices[indices[3 * t + k]]); }
+    centroids[t] = boxes[t].centroid();
+    order[t] = (int)t;
+    bounds.expand(boxes[t]);
+  }
+
+  vector<BinaryNode> binary;
+  binary.reserve(2 * num_triangles);
+  build_binary(binary, order, boxes, centroids, 0, (int)num_triangles, 0);
+
+  // Triangles in leaf order, so that a leaf range of order[] is the same
+  // range of triangles
+  triangles.resize(num_triangles);
+  for (long i = 0; i < num_triangles; i++) {
+    int t = order[i];
+    triangles[i].a = vertices[indices[3 * t]];
+    triangles[i].b = vertices[indices[3 * t + 1]];
+    triangles[i].c = vertices[indices[3 * t + 2]];
+  }
+
+  nodes.reserve(binary.size() / 3 + 1);
+  collapse(binary, 0);
+}
+
+int MeshBVH::build_binary(vector<BinaryNode> &binary, vector<int> &order,
+                          const vector<BBox> &boxes, const vector<Vector3D> &centroids,
+                          int begin, int end, int depth) {
+  int index = (int)binary.size();
+  binary.push_back(BinaryNode());
+  BBox node_bounds, centroid_bounds;
+  for (int i = begin; i < end; i++) {
+    node_bounds.expand(boxes[order[i]]);
+    centroid_bounds.expand(centroids[order[i]]);
+  }
+  binary[index].bounds = node_bounds;
+  binary[index].left = binary[index].right = -1;
+  binary[index].begin = begin;
+  binary[index].end = end;
+
+  int count = end - begin;
+  if (count <= 2 || depth >= MAX_DEPTH) { return index; }
+
+  // Binned SAH [Wald 2007]: the centroids are sorted into BINS bins along
+  // each axis, and the split between two bins with the lowest sum of
+  // child area times triangle count is taken
+  double best_cost = numeric_limits<double>::infinity();
+  int best_axis = -1, best_split = 0;
+  for (int axis = 0; axis < 3; axis++) {
+    double lo = centroid_bounds.min[axis], extent = centroid_bounds.max[axis] - lo;
+    if (!(extent > 0)) { continue; }
+    double scale = BINS / extent;
+
+    BBox bin_bounds[BINS];
+    int bin_count[BINS] = {0};
+    for (int i = begin; i < end; i++) {
+      int b = min(BINS - 1, (int)((centroids[order[i]][axis] - lo) * scale));
+      bin_bounds[b].expand(boxes[order[i]]);
+      bin_count[b]++;
+    }
+
+    // Right-hand sides of every split, swept from the last bin
+    double right_area[BINS];
+    int right_count[BINS];
+    BBox right;
+    int n = 0;
+    for (int b = BINS - 1; b > 0; b--) {
+      right.expand(bin_bounds[b]);
+      n += bin_count[b];
+      right_area[b] = surface_area(right);
+      right_count[b] = n;
+    }
+
+    BBox left;
+    n = 0;
+    for (int b = 0; b < BINS - 1; b++) {
+      left.expand(bin_bounds[b]);
+      n += bin_count[b];
+      double cost = surface_area(left) * n + right_area[b + 1] * right_count[b + 1];
+      if (n > 0 && right_count[b + 1] > 0 && cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_split = b;
+      }
+    }
+  }
+
+  // A leaf costs one test per triangle; a split one box test plus the
+  // expected tests in its children
+  double area = surface_area(node_bounds);
+  if (count <= MAX_LEAF_SIZE && (best_axis < 0 || area * count <= area + best_cost)) {
+    return index;
+  }
+
+  int middle;
+  if (best_axis >= 0) {
+    double lo = centroid_bounds.min[best_axis];
+    double scale = BINS / (centroid_bounds.max[best_axis] - lo);
+    middle = (int)(partition(order.begin() + begin, order.begin() + end, [&](int t) {
+                     return min(BINS - 1, (int)((centroids[t][best_axis] - lo) * scale)) <= best_split;
+                   }) - order.begin());
+  } else {
+    // All centroids coincide; any split is as good as another
+    middle = (begin + end) / 2;
+  }
+
+  int left = build_binary(binary, order, boxes, centroids, begin, middle, depth + 1);
+  int right = build_binary(binary, order, boxes, centroids, middle, end, depth + 1);
+  binary[index].left = left;
+  binary[index].right = right;
+  return index;
+}
+
+int MeshBVH::collapse(const vector<BinaryNode> &binary, int index) {
+  // Up to four descendants of the binary node become the children of a
+  // wide node, opening the largest inner one first
+  int children[4];
+  int num_children = 0;
+  if (binary[index].left < 0) {
+    children[num_children++] = index;
+  } else {
+    children[num_children++] = binary[index].left;
+    children[num_children++] = binary[index].right;
+  }
+  while (num_children < 4) {
+    int open = -1;
+    double largest = -1;
+    for (int k = 0; k < num_children; k++) {
+      const BinaryNode &child = binary[children[k]];
+      if (child.left >= 0 && surface_area(child.bounds) > largest) {
+        largest = surface_area(child.bounds);
+        open = k;
+      }
+    }
+    if (open < 0) { break; }
+    int opened = children[open];
+    children[open] = binary[opened].left;
+    children[num_children++] = binary[opened].right;
+  }
+
+  int node = (int)nodes.size();
+  nodes.push_back(Node());
+  for (int k = 0; k < 4; k++) {
+    Node &n = nodes[node];
+    if (k >= num_children) {
+      n.min_x[k] = n.min_y[k] = n.min_z[k] = INFINITY;
+      n.max_x[k] = n.max_y[k] = n.max_z[k] = -INFINITY;
+      n.child[k] = -1;
+      n.count[k] = 0;
+      continue;
+    }
+    const BinaryNode &child = binary[children[k]];
+    n.min_x[k] = round_down(child.bounds.min.x);
+    n.min_y[k] = round_down(child.bounds.min.y);
+    n.min_z[k] = round_down(child.bounds.min.z);
+    n.max_x[k] = round_up(child.bounds.max.x);
+    n.max_y[k] = round_up(child.bounds.max.y);
+    n.max_z[k] = round_up(child.bounds.max.z);
+    if (child.left < 0) {
+      n.child[k] = child.begin;
+      n.count[k] = child.end - child.begin;
+    } else {
+      // nodes may grow here, so n is looked up again afterwards
+      int c = collapse(binary, children[k]);
+      nodes[node].child[k] = c;
+      nodes[node].count[k] = 0;
+    }
+  }
+  return node;
+}
+
+bool MeshBVH::load(const string &filename, uint64_t key) {
+  ifstream in(filename, ios::binary);
+  if (!in.good()) { return false; }
+
+  uint32_t magic = 0;
+  uint64_t file_key = 0, num_nodes = 0, num_triangles = 0;
+  double box[6];
+  in.read((char *)&magic, sizeof(magic));
+  in.read((char *)&file_key, sizeof(file_key));
+  in.read((char *)&num_nodes, sizeof(num_nodes));
+  in.read((char *)&num_triangles, sizeof(num_triangles));
+  in.read((char *)box, sizeof(box));
+  if (!in.good() || magic != BVH_MAGIC || file_key != key) { return false; }
+
+  vector<Node> file_nodes(num_nodes);
+  vector<Triangle> file_triangles(num_triangles);
+  in.read((char *)file_nodes.data(), num_nodes * sizeof(Node));
+  in.read((char *)file_triangles.data(), num_triangles * sizeof(Triangle));
+  if (!in.good()) { return false; }
+
+  bounds = BBox(Vector3D(box[0], box[1], box[2]), Vector3D(box[3], box[4], box[5]));
+  nodes.swap(file_nodes);
+  triangles.swap(file_triangles);
+  return true;
+}
+
+bool MeshBVH::save(const string &filename, uint64_t key) const {
+  static_assert(sizeof(Triangle) == 9 * sizeof(double), "Triangle must be written as is");
+
+  ofstream out(filename, ios::binary);
+  if (!out.good()) { return false; }
+  uint64_t num_nodes = nodes.size(), num_triangles = triangles.size();
+  double box[6] = {bounds.min.x, bounds.min.y, bounds.min.z,
+                   bounds.max.x, bounds.max.y, bounds.max.z};
+  out.write((const char *)&BVH_MAGIC, sizeof(BVH_MAGIC));
+  out.write((const char *)&key, sizeof(key));
+  out.write((const char *)&num_nodes, sizeof(num_nodes));
+  out.write((const char *)&num_triangles, sizeof(num_triangles));
+  out.write((const char *)box, sizeof(box));
+  out.write((const char *)nodes.data(), num_nodes * sizeof(Node));
+  out.write((const char *)triangles.data(), num_triangles * sizeof(Triangle));
+  return out.good();
+}
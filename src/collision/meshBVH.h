@@ -0,0 +1,115 @@
+#ifndef COLLISION_MESH_BVH_H
+#define COLLISION_MESH_BVH_H
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bbox.h"
+
+using namespace CGL;
+using namespace std;
+
+// Static 4-wide bounding volume hierarchy over the triangles of a collision
+// mesh. A binary tree is built once with binned surface area heuristic
+// splits and then collapsed, so that every node holds the boxes of up to
+// four children. The boxes are stored per axis in float: a node is two cache
+// lines, and the four boxes are tested against a query with a few packed
+// compares. Triangles are stored by value in leaf order, so the triangles of
+// a leaf are contiguous.
+//
+// Everything is held in flat arrays that are written to disk and read back
+// as is, so a mesh only has to be built once.
+struct MeshBVH {
+  struct Triangle {
+    Vector3D a, b, c;
+  };
+
+  struct Node {
+    // Child boxes, rounded outwards; empty slots have min > max
+    float min_x[4], min_y[4], min_z[4];
+    float max_x[4], max_y[4], max_z[4];
+    // An inner child is the node child[k] and has count 0; a leaf child is
+    // the range [child[k], child[k] + count[k]) of triangles
+    int child[4];
+    int count[4];
+  };
+
+  // Builds the hierarchy over the given mesh (three vertex indices per
+  // triangle)
+  void build(const vector<Vector3D> &vertices, const vector<int> &indices);
+
+  // Reads a hierarchy written by save() with the same key; returns false if
+  // the file is missing, was saved with another key or is truncated
+  bool load(const string &filename, uint64_t key);
+  bool save(const string &filename, uint64_t key) const;
+
+  // Calls f(t) for every triangle t in a leaf whose box overlaps box; the
+  // triangle itself is not tested
+  template <typename F> void query(const BBox &box, F f) const {
+    if (nodes.empty()) { return; }
+    float lo_x = round_down(box.min.x), lo_y = round_down(box.min.y), lo_z = round_down(box.min.z);
+    float hi_x = round_up(box.max.x), hi_y = round_up(box.max.y), hi_z = round_up(box.max.z);
+
+    int stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      const Node &node = nodes[stack[--top]];
+      int hit[4];
+      for (int k = 0; k < 4; k++) {
+        hit[k] = (node.min_x[k] <= hi_x) & (node.max_x[k] >= lo_x) &
+                 (node.min_y[k] <= hi_y) & (node.max_y[k] >= lo_y) &
+                 (node.min_z[k] <= hi_z) & (node.max_z[k] >= lo_z);
+      }
+      for (int k = 0; k < 4; k++) {
+        if (!hit[k]) { continue; }
+        if (node.count[k] > 0) {
+          for (int t = node.child[k], end = t + node.count[k]; t < end; t++) { f(t); }
+        } else {
+          stack[top++] = node.child[k];
+        }
+      }
+    }
+  }
+
+  // Bounds of the whole mesh
+  BBox bounds;
+  vector<Node> nodes;
+  vector<Triangle> triangles;
+
+  // Conversions to float that never shrink a box
+  static float round_down(double x) {
+    float f = (float)x;
+    return f > x ? nextafterf(f, -INFINITY) : f;
+  }
+  static float round_up(double x) {
+    float f = (float)x;
+    return f < x ? nextafterf(f, INFINITY) : f;
+  }
+
+private:
+  // The binary tree is at most MAX_DEPTH deep (deeper ranges become leaves
+  // whatever their size), so the collapsed tree is too, and a traversal
+  // stack holds at most 3 MAX_DEPTH + 1 nodes
+  static const int MAX_DEPTH = 64;
+  static const int STACK_SIZE = 3 * MAX_DEPTH + 1;
+  static const int MAX_LEAF_SIZE = 8;
+  static const int BINS = 16;
+
+  struct BinaryNode {
+    BBox bounds;
+    // Children, or -1 for a leaf
+    int left, right;
+    // Range of order[] below the node
+    int begin, end;
+  };
+
+  int build_binary(vector<BinaryNode> &binary, vector<int> &order,
+                   const vector<BBox> &boxes, const vector<Vector3D> &centroids,
+                   int begin, int end, int depth);
+  int collapse(const vector<BinaryNode> &binary, int index);
+};
+
+#endif /* COLLISION_MESH_BVH_H */
@@ -0,0 +1,421 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+
+#include "geometry.h"
+#include "meshSDF.h"
+#include "triangleBVH.h"
+#include "../misc/hash_utils.h"
+#include "../misc/thread_utils.h"
+
+using namespace CGL;
+
+#define SURFACE_OFFSET 0.0001
+
+// Start of a cache file; also hashed, so changing it invalidates old caches
+static const uint32_t SDF_MAGIC = 0x31464453; // "SDF1"
+
+MeshSDF::MeshSDF(const vector<Vector3D> &vertices, const vector<int> &triangles,
+                 double friction, int resolution, int band,
+                 const string &cache_prefix)
+    : friction(friction), vertices(vertices), triangles(triangles),
+      resolution(max(1, resolution)), band(max(1, band)) {
+  for (const Vector3D &v : vertices) { mesh_bounds.expand(v); }
+  Vector3D extent = vertices.empty() ? Vector3D() : mesh_bounds.extent();
+  double longest = max(max(extent.x, extent.y), extent.z);
+  cell_size = longest > 0 ? longest / this->resolution : 1;
+  inv_cell_size = 1 / cell_size;
+
+  // The grid reaches band + 1 cells beyond the mesh on every side, so the
+  // field is sampled all around the surface
+  int margin = this->band + 1;
+  origin = (vertices.empty() ? Vector3D() : mesh_bounds.min) - Vector3D(margin * cell_size);
+  for (int k = 0; k < 3; k++) {
+    int cells = (int)ceil(extent[k] * inv_cell_size) + 2 * margin;
+    bricks[k] = (cells + BRICK - 1) / BRICK;
+  }
+
+  uint64_t key = hash();
+  string filename;
+  if (!cache_prefix.empty()) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key);
+    filename = cache_prefix + "." + hex + ".sdf";
+    loaded_from_cache = load(filename, key);
+  }
+  if (!loaded_from_cache) {
+    bake();
+    if (!filename.empty()) { save(filename, key); }
+  }
+
+#ifndef CLOTHSIM_HEADLESS
+  // Flat-shaded triangles for rendering
+  long num_triangles = triangles.size() / 3;
+  render_positions = MatrixXf(3, 3 * num_triangles);
+  render_normals = MatrixXf(4, 3 * num_triangles);
+  for (long t = 0; t < num_triangles; t++) {
+    const Vector3D &a = vertices[triangles[3 * t]];
+    const Vector3D &b = vertices[triangles[3 * t + 1]];
+    const Vector3D &c = vertices[triangles[3 * t + 2]];
+    Vector3D n = cross(b - a, c - a);
+    if (n.norm2() > 0) { n.normalize(); }
+    const Vector3D *corners[3] = {&a, &b, &c};
+    for (int k = 0; k < 3; k++) {
+      render_positions.col(3 * t + k) << corners[k]->x, corners[k]->y, corners[k]->z;
+      render_normals.col(3 * t + k) << n.x, n.y, n.z, 0.0;
+    }
+  }
+#endif
+}
+
+uint64_t MeshSDF::hash() const {
+  // 64-bit FNV-1a over the mesh and the grid settings
+  uint64_t h = HashUtils::FNV1A_BASIS;
+  int settings[4] = {(int)SDF_MAGIC, BRICK, resolution, band};
+  HashUtils::fnv1a(h, settings, sizeof(settings));
+  for (const Vector3D &v : vertices) {
+    double xyz[3] = {v.x, v.y, v.z};
+    HashUtils::fnv1a(h, xyz, sizeof(xyz));
+  }
+  HashUtils::fnv1a(h, triangles.data(), triangles.size() * sizeof(int));
+  return h;
+}
+
+void MeshSDF::bake() {
+  long num_triangles = triangles.size() / 3;
+  long num_bricks = (long)bricks[0] * bricks[1] * bricks[2];
+  auto corner = [&](long t, int k) -> const Vector3D & { return vertices[triangles[3 * t + k]]; };
+
+  // Angle-weighted pseudonormals [Baerentzen and Aanaes 2005]: the sign of
+  // the distance to a point is that of its offset from the closest point
+  // along the pseudonormal of the closest feature (face, edge or vertex)
+  vector<Vector3D> face_normal(num_triangles);
+  vector<Vector3D> vertex_normal(vertices.size());
+  unordered_map<uint64_t, Vector3D> edge_normal;
+  auto edge_key = [](int a, int b) {
+    return ((uint64_t)(uint32_t)min(a, b) << 32) | (uint32_t)max(a, b);
+  };
+  for (long t = 0; t < num_triangles; t++) {
+    Vector3D n = cross(corner(t, 1) - corner(t, 0), corner(t, 2) - corner(t, 0));
+    if (n.norm2() > 0) { n.normalize(); }
+    face_normal[t] = n;
+    for (int k = 0; k < 3; k++) {
+      Vector3D e1 = corner(t, (k + 1) % 3) - corner(t, k);
+      Vector3D e2 = corner(t, (k + 2) % 3) - corner(t, k);
+      if (e1.norm2() > 0 && e2.norm2() > 0) {
+        double angle = acos(max(-1.0, min(1.0, dot(e1.unit(), e2.unit()))));
+        vertex_normal[triangles[3 * t + k]] += angle * n;
+      }
+      edge_normal[edge_key(triangles[3 * t + k], triangles[3 * t + (k + 1) % 3])] += n;
+    }
+  }
+
+  vector<BBox> boxes(num_triangles);
+  for (long t = 0; t < num_triangles; t++) {
+    for (int k = 0; k < 3; k++) { boxes[t].expand(corner(t, k)); }
+  }
+  TriangleBVH bvh;
+  bvh.build(boxes);
+
+  // Bricks within band cells of a triangle hold samples
+  double reach = band * cell_size;
+  vector<char> near(num_bricks, 0);
+  for (long t = 0; t < num_triangles; t++) {
+    int lo[3], hi[3];
+    for (int k = 0; k < 3; k++) {
+      double a = floor((boxes[t].min[k] - reach - origin[k]) * inv_cell_size / BRICK);
+      double b = floor((boxes[t].max[k] + reach - origin[k]) * inv_cell_size / BRICK);
+      lo[k] = (int)max(0.0, min(a, bricks[k] - 1.0));
+      hi[k] = (int)max(0.0, min(b, bricks[k] - 1.0));
+    }
+    for (int z = lo[2]; z <= hi[2]; z++)
+      for (int y = lo[1]; y <= hi[1]; y++)
+        for (int x = lo[0]; x <= hi[0]; x++) { near[((long)z * bricks[1] + y) * bricks[0] + x] = 1; }
+  }
+
+  brick_table.assign(num_bricks, FAR_OUTSIDE);
+  vector<long> near_bricks;
+  for (long b = 0; b < num_bricks; b++) {
+    if (near[b]) {
+      brick_table[b] = (int)near_bricks.size();
+      near_bricks.push_back(b);
+    }
+  }
+  const int nodes_per_brick = BRICK_NODES * BRICK_NODES * BRICK_NODES;
+  brick_values.assign(near_bricks.size() * nodes_per_brick, 0.0f);
+
+  // Every node of a near brick is within reach plus the brick diagonal of
+  // some triangle, so the triangles that close to the brick hold its
+  // closest point
+  double radius = reach + sqrt(3.0) * BRICK * cell_size;
+  int num_threads = ThreadUtils::max_threads();
+  long num_near = near_bricks.size();
+
+  #pragma omp parallel num_threads(num_threads)
+  {
+    vector<int> candidates;
+
+    #pragma omp for schedule(dynamic, 1)
+    for (long n = 0; n < num_near; n++) {
+      long b = near_bricks[n];
+      int base[3] = {(int)(b % bricks[0]) * BRICK, (int)(b / bricks[0] % bricks[1]) * BRICK,
+                     (int)(b / ((long)bricks[0] * bricks[1])) * BRICK};
+      Vector3D brick_min = origin + cell_size * Vector3D(base[0], base[1], base[2]);
+      BBox box(brick_min, brick_min + Vector3D(BRICK * cell_size));
+      box.pad(radius);
+      candidates.clear();
+      bvh.query(box, [&](int t) {
+        if (boxes[t].overlaps(box)) { candidates.push_back(t); }
+      });
+
+      float *values = &brick_values[n * nodes_per_brick];
+      for (int k = 0; k < BRICK_NODES; k++)
+        for (int j = 0; j < BRICK_NODES; j++)
+          for (int i = 0; i < BRICK_NODES; i++) {
+            Vector3D p = origin + cell_size * Vector3D(base[0] + i, base[1] + j, base[2] + k);
+            double best = numeric_limits<double>::infinity();
+            int best_t = -1;
+            Vector3D best_bary, best_point;
+            for (int t : candidates) {
+              Vector3D bary = closest_on_triangle(p, corner(t, 0), corner(t, 1), corner(t, 2));
+              Vector3D q = bary.x * corner(t, 0) + bary.y * corner(t, 1) + bary.z * corner(t, 2);
+              double d2 = (p - q).norm2();
+              if (d2 < best) {
+                best = d2;
+                best_t = t;
+                best_bary = bary;
+                best_point = q;
+              }
+            }
+            float &value = values[(k * BRICK_NODES + j) * BRICK_NODES + i];
+            if (best_t < 0) {
+              value = (float)radius;
+              continue;
+            }
+
+            // The zero weights tell which feature holds the closest point
+            Vector3D normal;
+            int zeros = (best_bary.x == 0) + (best_bary.y == 0) + (best_bary.z == 0);
+            if (zeros == 2) {
+              int v = best_bary.x != 0 ? 0 : (best_bary.y != 0 ? 1 : 2);
+              normal = vertex_normal[triangles[3 * best_t + v]];
+            } else if (zeros == 1) {
+              int skip = best_bary.x == 0 ? 0 : (best_bary.y == 0 ? 1 : 2);
+              normal = edge_normal.at(edge_key(triangles[3 * best_t + (skip + 1) % 3],
+                                               triangles[3 * best_t + (skip + 2) % 3]));
+            } else {
+              normal = face_normal[best_t];
+            }
+            double d = sqrt(best);
+            value = (float)(dot(p - best_point, normal) < 0 ? -d : d);
+          }
+    }
+  }
+
+  // Bricks away from the surface are inside if a ray from their center
+  // crosses the mesh an odd number of times. The direction is skewed so that
+  // it does not run along the grid axes or through mesh edges of
+  // axis-aligned models.
+  Vector3D direction = Vector3D(1, 0.0137, 0.0291).unit();
+  #pragma omp parallel for num_threads(num_threads) schedule(dynamic, 16)
+  for (long b = 0; b < num_bricks; b++) {
+    if (brick_table[b] != FAR_OUTSIDE) { continue; }
+    Vector3D center = origin + cell_size * BRICK *
+                      Vector3D(b % bricks[0] + 0.5, b / bricks[0] % bricks[1] + 0.5,
+                               b / ((long)bricks[0] * bricks[1]) + 0.5);
+    int crossings = 0;
+    for (long t = 0; t < num_triangles; t++) {
+      double hit;
+      crossings += ray_triangle(center, direction, corner(t, 0), corner(t, 1), corner(t, 2), hit);
+    }
+    if (crossings % 2 == 1) { brick_table[b] = FAR_INSIDE; }
+  }
+}
+
+bool MeshSDF::load(const string &filename, uint64_t key) {
+  ifstream in(filename, ios::binary);
+  if (!in.good()) { return false; }
+
+  uint32_t magic = 0;
+  uint64_t file_key = 0;
+  int file_bricks[3];
+  uint64_t table_size = 0, values_size = 0;
+  in.read((char *)&magic, sizeof(magic));
+  in.read((char *)&file_key, sizeof(file_key));
+  in.read((char *)file_bricks, sizeof(file_bricks));
+  in.read((char *)&table_size, sizeof(table_size));
+  in.read((char *)&values_size, sizeof(values_size));
+  long num_bricks = (long)bricks[0] * bricks[1] * bricks[2];
+  if (!in.good() || magic != SDF_MAGIC || file_key != key || file_bricks[0] != bricks[0] ||
+      file_bricks[1] != bricks[1] || file_bricks[2] != bricks[2] ||
+      table_size != (uint64_t)num_bricks) {
+    return false;
+  }
+
+  vector<int> table(table_size);
+  vector<float> values(values_size);
+  in.read((char *)table.data(), table_size * sizeof(int));
+  in.read((char *)values.data(), values_size * sizeof(float));
+  if (!in.good()) { return false; }
+
+  brick_table.swap(table);
+  brick_values.swap(values);
+  return true;
+}
+
+void MeshSDF::save(const string &filename, uint64_t key) const {
+  ofstream out(filename, ios::binary);
+  if (!out.good()) {
+    cout << "Warn: Unable to write signed distance cache " << filename << endl;
+    return;
+  }
+  uint64_t table_size = brick_table.size(), values_size = brick_values.size();
+  out.write((const char *)&SDF_MAGIC, sizeof(SDF_MAGIC));
+  out.write((const char *)&key, sizeof(key));
+  out.write((const char *)bricks, sizeof(bricks));
+  out.write((const char *)&table_size, sizeof(table_size));
+  out.write((const char *)&values_size, sizeof(values_size));
+  out.write((const char *)brick_table.data(), table_size * sizeof(int));
+  out.write((const char *)brick_values.data(), values_size * sizeof(float));
+}
+
+double MeshSDF::distance(const Vector3D &p, Vector3D *gradient) const {
+  const double inf = numeric_limits<double>::infinity();
+  int cell[3];
+  double t[3];
+  for (int k = 0; k < 3; k++) {
+    double g = (p[k] - origin[k]) * inv_cell_size;
+    double f = floor(g);
+    if (!(f >= 0 && f < bricks[k] * BRICK)) { return inf; }
+    cell[k] = (int)f;
+    t[k] = g - f;
+  }
+
+  long b = ((long)(cell[2] / BRICK) * bricks[1] + cell[1] / BRICK) * bricks[0] + cell[0] / BRICK;
+  int entry = brick_table[b];
+  if (entry == FAR_OUTSIDE) { return inf; }
+  if (entry == FAR_INSIDE) { return -inf; }
+
+  const int nx = 1, ny = BRICK_NODES, nz = BRICK_NODES * BRICK_NODES;
+  const float *c = &brick_values[(size_t)entry * nz * BRICK_NODES] +
+                   (cell[2] % BRICK) * nz + (cell[1] % BRICK) * ny + cell[0] % BRICK;
+  double c000 = c[0], c100 = c[nx], c010 = c[ny], c110 = c[nx + ny];
+  double c001 = c[nz], c101 = c[nx + nz], c011 = c[ny + nz], c111 = c[nx + ny + nz];
+
+  // Trilinear interpolation, x then y then z
+  double x00 = c000 + t[0] * (c100 - c000), x10 = c010 + t[0] * (c110 - c010);
+  double x01 = c001 + t[0] * (c101 - c001), x11 = c011 + t[0] * (c111 - c011);
+  double y0 = x00 + t[1] * (x10 - x00), y1 = x01 + t[1] * (x11 - x01);
+
+  if (gradient) {
+    double dx = (1 - t[2]) * ((1 - t[1]) * (c100 - c000) + t[1] * (c110 - c010)) +
+                t[2] * ((1 - t[1]) * (c101 - c001) + t[1] * (c111 - c011));
+    double dy = (1 - t[2]) * (x10 - x00) + t[2] * (x11 - x01);
+    double dz = y1 - y0;
+    *gradient = Vector3D(dx, dy, dz) * inv_cell_size;
+  }
+  return y0 + t[2] * (y1 - y0);
+}
+
+// Depth, in cells, that a path must reach inside the mesh to be stopped.
+// The interpolated field is only accurate to a fraction of a cell, and a
+// point sliding over a curved surface cuts slightly into it between two
+// positions just outside.
+#define GRAZE_CELLS 0.5
+
+// Steps of the march along a path, which ends at the first one inside
+#define MAX_SWEEP_STEPS 256
+
+bool MeshSDF::sweep(const Vector3D &from, const Vector3D &to, double &s) const {
+  Vector3D m = to - from;
+  double length = m.norm();
+  double graze = GRAZE_CELLS * cell_size;
+  // Two points outside are joined by a path no deeper than half its length
+  if (length < 2 * graze) { return false; }
+
+  double lo = 0, hi = 1;
+  if (!mesh_bounds.clip(from, m, lo, hi)) { return false; }
+
+  // Conservative advancement: the surface is at least |d| away from a
+  // point at distance d, so the path can skip that far without crossing
+  // it. Bricks without samples are at least band cells from the surface.
+  double reach = band * cell_size, min_step = 0.25 * cell_size;
+  bool outside = false;
+  double last_outside = 0;
+  for (int i = 0; i < MAX_SWEEP_STEPS && lo <= hi; i++) {
+    double d = distance(from + lo * m);
+    if (d < -graze) {
+      if (!outside) { return false; }
+      // Entered between the last point found outside and this one
+      double a = last_outside, b = lo;
+      for (int k = 0; k < 10; k++) {
+        double mid = 0.5 * (a + b);
+        if (distance(from + mid * m) > 0) { a = mid; } else { b = mid; }
+      }
+      s = a;
+      return true;
+    }
+    if (d > 0) {
+      outside = true;
+      last_outside = lo;
+    }
+    double step = std::isinf(d) ? reach : max(fabs(d), min_step);
+    lo += step / length;
+  }
+  return false;
+}
+
+void MeshSDF::collide(Vector3D &position, const Vector3D &last_position) {
+  Vector3D gradient;
+  double d = mesh_bounds.contains(position) ? distance(position, &gradient)
+                                            : numeric_limits<double>::infinity();
+  if (d >= 0) {
+    // Stopped where the path entered, if it went through the mesh
+    double s;
+    if (!sweep(last_position, position, s)) { return; }
+    Vector3D entry = last_position + s * (position - last_position);
+    position = last_position + (entry - last_position) * (1 - friction);
+    return;
+  }
+
+  // Deep inside there are no samples to find the way out; undo the move
+  if (std::isinf(d)) {
+    position = last_position;
+    return;
+  }
+
+  // Move the point along the gradient to just outside the surface
+  double g = gradient.norm();
+  if (g == 0) { return; }
+  Vector3D surface = position + gradient * ((SURFACE_OFFSET - d) / g);
+  Vector3D correction = surface - last_position;
+  position = last_position + correction * (1 - friction);
+}
+
+void MeshSDF::collide(Vector3D *positions, const Vector3D *last_positions, long count) {
+  // Only points whose path over the substep overlaps the bounds of the
+  // mesh can be inside it or have passed through it
+  collide_batch(positions, last_positions, count, [&](const Vector3D &p, const Vector3D &q) {
+    return path_overlaps(p, q, mesh_bounds);
+  });
+}
+
+#ifndef CLOTHSIM_HEADLESS
+void MeshSDF::render(GLShader &shader) {
+  nanogui::Color color(0.55f, 0.45f, 0.35f, 1.0f);
+
+  if (shader.uniform("u_color", false) != -1) {
+    shader.setUniform("u_color", color);
+  }
+  shader.uploadAttrib("in_position", render_positions);
+  if (shader.attrib("in_normal", false) != -1) {
+    shader.uploadAttrib("in_normal", render_normals);
+  }
+
+  shader.drawArray(GL_TRIANGLES, 0, render_positions.cols());
+}
+#endif
@@ -0,0 +1,102 @@
+#ifndef COLLISIONOBJECT_MESH_SDF_H
+#define COLLISIONOBJECT_MESH_SDF_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef CLOTHSIM_HEADLESS
+#include <nanogui/nanogui.h>
+#endif
+
+#include "../clothMesh.h"
+#include "bbox.h"
+#include "collisionObject.h"
+
+#ifndef CLOTHSIM_HEADLESS
+using namespace nanogui;
+#endif
+using namespace CGL;
+using namespace std;
+
+// Collider for an arbitrary closed triangle mesh (trunks, rocks, terrain
+// blocks) through a signed distance field, negative inside the mesh.
+//
+// The field is sampled on the nodes of a uniform grid that covers the mesh,
+// but only near the surface: the grid is split into bricks of BRICK^3 cells,
+// and only bricks within band cells of a triangle store their nodes. Every
+// other brick is flagged as entirely outside or entirely inside. A lookup is
+// a brick table access plus a trilinear interpolation within one brick, so
+// colliding a point costs the same whatever the size of the mesh.
+//
+// Baking is done once, in parallel over the bricks, and saved next to the
+// mesh file under a name holding a hash of the mesh and the grid settings,
+// so later runs with the same mesh load it instead.
+//
+// A point that ends a substep outside is also marched along its path over
+// the substep by conservative advancement, and stopped where the path
+// entered the mesh, so that a fast moving mesh does not tunnel through thin
+// cloth.
+struct MeshSDF : public CollisionObject {
+public:
+  // Bakes the field of the given mesh (three vertex indices per triangle),
+  // with resolution cells along the longest side of the mesh, or loads it
+  // from cache_prefix.<hash>.sdf when present. An empty prefix disables the
+  // cache.
+  MeshSDF(const vector<Vector3D> &vertices, const vector<int> &triangles,
+          double friction, int resolution = 64, int band = 3,
+          const string &cache_prefix = "");
+
+#ifndef CLOTHSIM_HEADLESS
+  void render(GLShader &shader);
+#endif
+  void collide(Vector3D &position, const Vector3D &last_position);
+  void collide(Vector3D *positions, const Vector3D *last_positions, long count);
+  BBox bounds() const { return mesh_bounds; }
+
+  // Signed distance at p, with its gradient if requested. Points in a brick
+  // without samples get +infinity (outside, or beyond the grid) or -infinity
+  // (deep inside).
+  double distance(const Vector3D &p, Vector3D *gradient = nullptr) const;
+
+  // Whether the field came from the disk cache rather than a bake
+  bool loaded_from_cache = false;
+
+  double friction;
+
+private:
+  // Cells along each side of a brick; a brick stores the BRICK + 1 nodes of
+  // each side, so the corners of any of its cells are within the brick
+  static const int BRICK = 8;
+  static const int BRICK_NODES = BRICK + 1;
+  enum { FAR_OUTSIDE = -1, FAR_INSIDE = -2 };
+
+  // Parameter s in [0, 1] at which the path from + s (to - from), starting
+  // outside, enters the mesh; false if it misses it or only grazes it
+  bool sweep(const Vector3D &from, const Vector3D &to, double &s) const;
+
+  void bake();
+  uint64_t hash() const;
+  bool load(const string &filename, uint64_t key);
+  void save(const string &filename, uint64_t key) const;
+
+  vector<Vector3D> vertices;
+  vector<int> triangles;
+  BBox mesh_bounds;
+
+  // Grid: node (i, j, k) lies at origin + cell_size * (i, j, k)
+  int resolution, band;
+  Vector3D origin;
+  double cell_size, inv_cell_size;
+  int bricks[3];
+
+  // Per brick, the index of its samples in brick_values or a FAR_ flag
+  vector<int> brick_table;
+  vector<float> brick_values;
+
+#ifndef CLOTHSIM_HEADLESS
+  MatrixXf render_positions, render_normals;
+#endif
+};
+
+#endif /* COLLISIONOBJECT_MESH_SDF_H */
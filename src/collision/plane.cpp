@@ -1,8 +1,6 @@
 #include "iostream"
-#include <nanogui/nanogui.h>
 
 #include "../clothMesh.h"
-#include "../clothSimulator.h"
 #include "plane.h"
 
 using namespace std;
@@ -10,22 +8,35 @@ using namespace CGL;
 
 #define SURFACE_OFFSET 0.0001
 
-void Plane::collide(PointMass &pm) {
+void Plane::collide(Vector3D &position, const Vector3D &last_position) {
   // TODO (Part 3): Handle collisions with planes.
   //determine if collission occurred. 
-    double detLast = dot(normal,  point - pm.last_position);
-    double detCurr = dot(normal,  point - pm.position);
-    Vector3D l = (pm.last_position - pm.position).unit();
+    double detLast = dot(normal,  point - last_position);
+    double detCurr = dot(normal,  point - position);
+    Vector3D l = (last_position - position).unit();
     if (((detLast <= 0 && detCurr >= 0) || (detLast >= 0 && detCurr <= 0) )&& dot(l, normal) != 0) {
 
-        double d = dot(point - pm.last_position, normal) / dot(l, normal);
-        Vector3D tangent = pm.last_position + normal * (d + SURFACE_OFFSET);
-        Vector3D correction = (tangent - pm.last_position);
+        double d = dot(point - last_position, normal) / dot(l, normal);
+        Vector3D tangent = last_position + normal * (d + SURFACE_OFFSET);
+        Vector3D correction = (tangent - last_position);
        // correction += SURFACE_OFFSET * correction.unit();
-        pm.position = pm.last_position + correction * (1 - friction);
+        position = last_position + correction * (1 - friction);
     }
 }
 
+void Plane::collide(Vector3D *positions, const Vector3D *last_positions, long count) {
+  // A point can only cross the plane if its signed distances at the start
+  // and the end of the substep differ in sign
+  collide_batch(positions, last_positions, count, [&](const Vector3D &p, const Vector3D &q) {
+    double det_curr = normal.x * (point.x - p.x) + normal.y * (point.y - p.y) +
+                      normal.z * (point.z - p.z);
+    double det_last = normal.x * (point.x - q.x) + normal.y * (point.y - q.y) +
+                      normal.z * (point.z - q.z);
+    return (det_curr <= 0 && det_last >= 0) | (det_curr >= 0 && det_last <= 0);
+  });
+}
+
+#ifndef CLOTHSIM_HEADLESS
 void Plane::render(GLShader &shader) {
   nanogui::Color color(0.7f, 0.7f, 0.7f, 1.0f);
 
@@ -37,17 +48,17 @@ void Plane::render(GLShader &shader) {
   Vector3f sCross = sNormal.cross(sParallel);
 
   MatrixXf positions(3, 4);
-  MatrixXf normals(3, 4);
+  MatrixXf normals(4, 4);
 
   positions.col(0) << sPoint + 2 * (sCross + sParallel);
   positions.col(1) << sPoint + 2 * (sCross - sParallel);
   positions.col(2) << sPoint + 2 * (-sCross + sParallel);
   positions.col(3) << sPoint + 2 * (-sCross - sParallel);
 
-  normals.col(0) << sNormal;
-  normals.col(1) << sNormal;
-  normals.col(2) << sNormal;
-  normals.col(3) << sNormal;
+  normals.col(0) << sNormal, 0.0;
+  normals.col(1) << sNormal, 0.0;
+  normals.col(2) << sNormal, 0.0;
+  normals.col(3) << sNormal, 0.0;
 
   if (shader.uniform("u_color", false) != -1) {
     shader.setUniform("u_color", color);
@@ -59,3 +70,4 @@ void Plane::render(GLShader &shader) {
 
   shader.drawArray(GL_TRIANGLE_STRIP, 0, 4);
 }
+#endif
@@ -1,12 +1,16 @@
 #ifndef COLLISIONOBJECT_PLANE_H
 #define COLLISIONOBJECT_PLANE_H
 
+#ifndef CLOTHSIM_HEADLESS
 #include <nanogui/nanogui.h>
+#endif
 
 #include "../clothMesh.h"
 #include "collisionObject.h"
 
+#ifndef CLOTHSIM_HEADLESS
 using namespace nanogui;
+#endif
 using namespace CGL;
 using namespace std;
 
@@ -15,8 +19,11 @@ public:
   Plane(const Vector3D &point, const Vector3D &normal, double friction)
       : point(point), normal(normal.unit()), friction(friction) {}
 
+#ifndef CLOTHSIM_HEADLESS
   void render(GLShader &shader);
-  void collide(PointMass &pm);
+#endif
+  void collide(Vector3D &position, const Vector3D &last_position);
+  void collide(Vector3D *positions, const Vector3D *last_positions, long count);
 
   Vector3D point;
   Vector3D normal;
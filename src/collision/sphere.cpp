@@ -1,26 +1,66 @@
-#include <nanogui/nanogui.h>
+#include <map>
 
 #include "../clothMesh.h"
-#include "../misc/sphere_drawing.h"
+#include "geometry.h"
 #include "sphere.h"
 
-using namespace nanogui;
 using namespace CGL;
 
-void Sphere::collide(PointMass &pm) {
+void Sphere::collide(Vector3D &position, const Vector3D &last_position) {
   // TODO (Part 3): Handle collisions with spheres.
 	// test if collision or interesection occurrs
 	
-	if ((pm.position - origin).norm() > radius) { return; }
+	Vector3D d = position - origin;
+	double d2 = d.norm2();
+	if (d2 > radius2) {
+		// The point may still have passed through the sphere during the
+		// substep, which happens when the sphere moves fast (a KinematicObject
+		// sees the path of the point relative to it); it is then stopped
+		// where its path enters the sphere. Paths that only graze it are
+		// ignored; two points outside are joined by a path no deeper than
+		// half its length.
+		Vector3D m = position - last_position, f = last_position - origin;
+		double a = m.norm2(), b = dot(f, m), c = f.norm2() - radius2;
+		if (a < 4 * GRAZE_DEPTH * GRAZE_DEPTH * radius2) { return; }
+		if (c <= 0 || b >= 0 || b * b < a * c) { return; }
+		// Deepest at the closest approach to the centre
+		double depth = radius - sqrt(max(0.0, f.norm2() - b * b / a));
+		if (depth < GRAZE_DEPTH * radius) { return; }
+		double s = (-b - sqrt(b * b - a * c)) / a;
+		if (s > 1) { return; }
+		Vector3D entry = last_position + s * m;
+		position = last_position + (entry - last_position) * (1 - friction);
+		return;
+	}
 	// Calculate Where Intersection Point Should have been by extending vector (pm - origin) to sphere surface, this is the tangent point
-	Vector3D tangent =  origin  + radius * (pm.position - origin).unit();
+	Vector3D tangent =  origin  + d * (radius / sqrt(d2));
 	
-	Vector3D correction = tangent - pm.last_position;
-	pm.position = pm.last_position +  correction * (1 - friction);
+	Vector3D correction = tangent - last_position;
+	position = last_position +  correction * (1 - friction);
 }
 
+void Sphere::collide(Vector3D *positions, const Vector3D *last_positions, long count) {
+  // Only the points whose path over the substep may reach the sphere go on
+  // to the response
+  collide_batch(positions, last_positions, count, [&](const Vector3D &p, const Vector3D &q) {
+    double dx = 0.5 * (p.x + q.x) - origin.x, dy = 0.5 * (p.y + q.y) - origin.y,
+           dz = 0.5 * (p.z + q.z) - origin.z;
+    double mx = p.x - q.x, my = p.y - q.y, mz = p.z - q.z;
+    return path_within(dx * dx + dy * dy + dz * dz, mx * mx + my * my + mz * mz, radius2);
+  });
+}
+
+#ifndef CLOTHSIM_HEADLESS
 void Sphere::render(GLShader &shader) {
   // We decrease the radius here so flat triangles don't behave strangely
   // and intersect with the sphere when rendered
-  m_sphere_mesh.draw_sphere(shader, origin, radius * 0.92);
+  m_sphere_mesh->draw_sphere(shader, origin, radius * 0.92);
+}
+
+shared_ptr<Misc::SphereMesh> Sphere::shared_mesh(int num_lat, int num_lon) {
+  static map<pair<int, int>, shared_ptr<Misc::SphereMesh>> meshes;
+  shared_ptr<Misc::SphereMesh> &mesh = meshes[make_pair(num_lat, num_lon)];
+  if (!mesh) { mesh = make_shared<Misc::SphereMesh>(num_lat, num_lon); }
+  return mesh;
 }
+#endif
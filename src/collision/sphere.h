@@ -1,8 +1,12 @@
 #ifndef COLLISIONOBJECT_SPHERE_H
 #define COLLISIONOBJECT_SPHERE_H
 
+#include <memory>
+
 #include "../clothMesh.h"
+#ifndef CLOTHSIM_HEADLESS
 #include "../misc/sphere_drawing.h"
+#endif
 #include "collisionObject.h"
 
 using namespace CGL;
@@ -11,11 +15,20 @@ using namespace std;
 struct Sphere : public CollisionObject {
 public:
   Sphere(const Vector3D &origin, double radius, double friction, int num_lat = 40, int num_lon = 40)
-      : origin(origin), radius(radius), radius2(radius * radius),
-        friction(friction), m_sphere_mesh(Misc::SphereMesh(num_lat, num_lon)) {}
+      : origin(origin), radius(radius), radius2(radius * radius), friction(friction) {
+#ifndef CLOTHSIM_HEADLESS
+    m_sphere_mesh = shared_mesh(num_lat, num_lon);
+#endif
+  }
 
+#ifndef CLOTHSIM_HEADLESS
   void render(GLShader &shader);
-  void collide(PointMass &pm);
+#endif
+  void collide(Vector3D &position, const Vector3D &last_position);
+  void collide(Vector3D *positions, const Vector3D *last_positions, long count);
+  BBox bounds() const {
+    return BBox(origin - Vector3D(radius, radius, radius), origin + Vector3D(radius, radius, radius));
+  }
 
 private:
   Vector3D origin;
@@ -23,8 +36,13 @@ private:
   double radius2;
 
   double friction;
-  
-  Misc::SphereMesh m_sphere_mesh;
+
+#ifndef CLOTHSIM_HEADLESS
+  // Spheres of the same resolution draw with one mesh, so that scenes with
+  // thousands of them do not hold thousands of copies
+  static shared_ptr<Misc::SphereMesh> shared_mesh(int num_lat, int num_lon);
+  shared_ptr<Misc::SphereMesh> m_sphere_mesh;
+#endif
 };
 
 #endif /* COLLISIONOBJECT_SPHERE_H */
@@ -0,0 +1,105 @@
+#include <algorithm>
+
+#include "triangleBVH.h"
+
+void TriangleBVH::build(const vector<BBox> &boxes) {
+  nodes.clear();
+  leaves.clear();
+  order.resize(boxes.size());
+  for (size_t i = 0; i < boxes.size(); i++) { order[i] = (int)i; }
+  if (boxes.empty()) { return; }
+  nodes.reserve(2 * (boxes.size() / LEAF_SIZE + 1));
+  build_node(boxes, 0, (int)boxes.size());
+}
+
+int TriangleBVH::build_node(const vector<BBox> &boxes, int begin, int end) {
+  int index = (int)nodes.size();
+  nodes.push_back(Node());
+  nodes[index].left = nodes[index].right = -1;
+  nodes[index].begin = begin;
+  nodes[index].end = end;
+
+  BBox bounds, centroids;
+  for (int i = begin; i < end; i++) {
+    bounds.expand(boxes[order[i]]);
+    centroids.expand(boxes[order[i]].centroid());
+  }
+  nodes[index].bounds = bounds;
+
+  if (end - begin <= LEAF_SIZE) {
+    leaves.push_back(index);
+    return index;
+  }
+
+  Vector3D extent = centroids.extent();
+  int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+  int middle = (begin + end) / 2;
+  nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+              [&](int a, int b) {
+                return boxes[a].centroid()[axis] < boxes[b].centroid()[axis];
+              });
+
+  int left = build_node(boxes, begin, middle);
+  int right = build_node(boxes, middle, end);
+  nodes[index].left = left;
+  nodes[index].right = right;
+  return index;
+}
+
+void TriangleBVH::refit(const vector<BBox> &boxes, int num_threads) {
+  long num_leaves = leaves.size();
+
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long l = 0; l < num_leaves; l++) {
+    Node &node = nodes[leaves[l]];
+    BBox bounds;
+    for (int i = node.begin; i < node.end; i++) { bounds.expand(boxes[order[i]]); }
+    node.bounds = bounds;
+  }
+
+  // Children come after their parents, so a reverse sweep sees every child
+  // before its parent
+  for (int i = (int)nodes.size() - 1; i >= 0; i--) {
+    Node &node = nodes[i];
+    if (node.left < 0) { continue; }
+    node.bounds = nodes[node.left].bounds;
+    node.bounds.expand(nodes[node.right].bounds);
+  }
+}
+
+void TriangleBVH::self_overlap_tasks(size_t min_tasks,
+                                     vector<pair<int, int>> &tasks) const {
+  tasks.clear();
+  if (nodes.empty()) { return; }
+  tasks.push_back(make_pair(0, 0));
+
+  // Splits every task into the pairs of its children until there are enough
+  // of them; overlap is left to self_overlaps, so the split is the same
+  // whatever the node bounds
+  vector<pair<int, int>> next;
+  while (tasks.size() < min_tasks) {
+    next.clear();
+    bool split = false;
+    for (const pair<int, int> &task : tasks) {
+      const Node &ni = nodes[task.first], &nj = nodes[task.second];
+      if (task.first == task.second && ni.left >= 0) {
+        next.push_back(make_pair(ni.left, ni.left));
+        next.push_back(make_pair(ni.right, ni.right));
+        next.push_back(make_pair(ni.left, ni.right));
+        split = true;
+      } else if (task.first != task.second && ni.left >= 0) {
+        next.push_back(make_pair(ni.left, task.second));
+        next.push_back(make_pair(ni.right, task.second));
+        split = true;
+      } else if (task.first != task.second && nj.left >= 0) {
+        next.push_back(make_pair(task.first, nj.left));
+        next.push_back(make_pair(task.first, nj.right));
+        split = true;
+      } else {
+        next.push_back(task);
+      }
+    }
+    tasks.swap(next);
+    if (!split) { break; }
+  }
+}
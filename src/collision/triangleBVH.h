@@ -0,0 +1,117 @@
+#ifndef TRIANGLE_BVH_H
+#define TRIANGLE_BVH_H
+
+#include <utility>
+#include <vector>
+
+#include "bbox.h"
+
+using namespace std;
+
+// Binary bounding volume hierarchy over a fixed set of primitives (the
+// triangles of a cloth). The tree is built once, from the primitive bounds at
+// rest, and afterwards only refit: its topology stays the same while the node
+// bounds follow the primitives, which is cheap and good enough as long as the
+// mesh connectivity does not change.
+struct TriangleBVH {
+  struct Node {
+    BBox bounds;
+    // Children, or -1 for a leaf
+    int left, right;
+    // Range of order[] held by a leaf
+    int begin, end;
+  };
+
+  // Builds the hierarchy over the given primitive bounds by median splits
+  // along the longest axis of the centroids
+  void build(const vector<BBox> &boxes);
+
+  // Recomputes the node bounds from new primitive bounds; the leaves are
+  // refit in parallel, the inner nodes bottom-up
+  void refit(const vector<BBox> &boxes, int num_threads);
+
+  // Calls f(n) for every leaf node n that overlaps box
+  template <typename F> void query_leaves(const BBox &box, F f) const {
+    if (nodes.empty()) { return; }
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      int index = stack[--top];
+      const Node &node = nodes[index];
+      if (!node.bounds.overlaps(box)) { continue; }
+      if (node.left < 0) {
+        f(index);
+      } else {
+        stack[top++] = node.right;
+        stack[top++] = node.left;
+      }
+    }
+  }
+
+  // Calls f(p) for every primitive p in a leaf that overlaps box; the bounds
+  // of p itself are not tested
+  template <typename F> void query(const BBox &box, F f) const {
+    query_leaves(box, [&](int n) {
+      for (int i = nodes[n].begin; i < nodes[n].end; i++) { f(order[i]); }
+    });
+  }
+
+  // Calls f(m, n) once for every unordered pair of overlapping leaves below
+  // the node pair (a, b) by descending both subtrees together. With a == b
+  // the pairs within the subtree of a are enumerated, including every leaf
+  // with itself.
+  template <typename F> void self_overlaps(int a, int b, F f) const {
+    int stack[256][2];
+    int top = 0;
+    stack[top][0] = a;
+    stack[top++][1] = b;
+    while (top > 0) {
+      top--;
+      int i = stack[top][0], j = stack[top][1];
+      const Node &ni = nodes[i], &nj = nodes[j];
+      if (i == j) {
+        if (ni.left < 0) {
+          f(i, i);
+          continue;
+        }
+        push(stack, top, ni.left, ni.right);
+        push(stack, top, ni.right, ni.right);
+        push(stack, top, ni.left, ni.left);
+        continue;
+      }
+      if (!ni.bounds.overlaps(nj.bounds)) { continue; }
+      if (ni.left < 0 && nj.left < 0) {
+        f(i, j);
+      } else if (nj.left < 0 || (ni.left >= 0 && ni.end - ni.begin >= nj.end - nj.begin)) {
+        push(stack, top, ni.right, j);
+        push(stack, top, ni.left, j);
+      } else {
+        push(stack, top, i, nj.right);
+        push(stack, top, i, nj.left);
+      }
+    }
+  }
+
+  // Splits the self-overlap traversal of the whole tree into at least
+  // min_tasks node pairs (fewer for small trees) that can be passed to
+  // self_overlaps independently, e.g. by different threads
+  void self_overlap_tasks(size_t min_tasks, vector<pair<int, int>> &tasks) const;
+
+  // Nodes in depth-first order, so every child comes after its parent
+  vector<Node> nodes;
+  vector<int> order;
+  vector<int> leaves;
+
+private:
+  static const int LEAF_SIZE = 4;
+
+  int build_node(const vector<BBox> &boxes, int begin, int end);
+
+  static void push(int stack[][2], int &top, int i, int j) {
+    stack[top][0] = i;
+    stack[top++][1] = j;
+  }
+};
+
+#endif /* TRIANGLE_BVH_H */
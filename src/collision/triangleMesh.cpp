@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "geometry.h"
+#include "triangleMesh.h"
+#include "../misc/hash_utils.h"
+#include "../misc/obj_loader.h"
+
+using namespace CGL;
+
+// Start of the cache key, so changing it invalidates old caches
+static const uint32_t MESH_KEY_VERSION = 1;
+
+TriangleMesh::TriangleMesh(const vector<Vector3D> &vertices, const vector<int> &triangles,
+                           double friction, double thickness)
+    : friction(friction), thickness(thickness) {
+  bvh.build(vertices, triangles);
+  finish();
+}
+
+TriangleMesh *TriangleMesh::load(const string &filename, const Vector3D &position,
+                                 double scale, double friction, double thickness) {
+  struct stat info;
+  if (stat(filename.c_str(), &info) != 0) { return nullptr; }
+
+  // 64-bit FNV-1a over the file identity and the transform
+  uint64_t key = HashUtils::FNV1A_BASIS;
+  int64_t identity[3] = {MESH_KEY_VERSION, (int64_t)info.st_size, (int64_t)info.st_mtime};
+  double transform[4] = {position.x, position.y, position.z, scale};
+  HashUtils::fnv1a(key, identity, sizeof(identity));
+  HashUtils::fnv1a(key, transform, sizeof(transform));
+
+  TriangleMesh *mesh = new TriangleMesh(friction, thickness);
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key);
+  mesh->cache_filename = filename + "." + hex + ".bvh";
+  mesh->loaded_from_cache = mesh->bvh.load(mesh->cache_filename, key);
+
+  if (!mesh->loaded_from_cache) {
+    vector<Vector3D> vertices;
+    vector<int> triangles;
+    if (!ObjLoader::load_obj(filename, vertices, triangles)) {
+      delete mesh;
+      return nullptr;
+    }
+    for (Vector3D &v : vertices) {
+      v = position + scale * v;
+    }
+    mesh->bvh.build(vertices, triangles);
+    if (!mesh->bvh.save(mesh->cache_filename, key)) {
+      cout << "Warn: Unable to write mesh hierarchy cache " << mesh->cache_filename << endl;
+    }
+  }
+
+  mesh->finish();
+  return mesh;
+}
+
+void TriangleMesh::finish() {
+  padded_bounds = bvh.bounds;
+  if (!bvh.triangles.empty()) { padded_bounds.pad(thickness); }
+}
+
+void TriangleMesh::collide(Vector3D &position, const Vector3D &last_position) {
+  BBox path(last_position);
+  path.expand(position);
+  path.pad(thickness);
+  if (!path.overlaps(bvh.bounds)) { return; }
+
+  // The first crossing of the path with the surface, and otherwise the
+  // closest triangle within thickness of the position
+  Vector3D m = position - last_position;
+  double first = numeric_limits<double>::infinity();
+  int crossed = -1;
+  double closest2 = thickness * thickness;
+  int closest = -1;
+  Vector3D closest_point;
+  bvh.query(path, [&](int t) {
+    const MeshBVH::Triangle &tri = bvh.triangles[t];
+    double s;
+    if (ray_triangle(last_position, m, tri.a, tri.b, tri.c, s) && s <= 1 && s < first) {
+      first = s;
+      crossed = t;
+    }
+    if (crossed >= 0) { return; }
+    Vector3D bary = closest_on_triangle(position, tri.a, tri.b, tri.c);
+    Vector3D q = bary.x * tri.a + bary.y * tri.b + bary.z * tri.c;
+    double d2 = (position - q).norm2();
+    if (d2 < closest2) {
+      closest2 = d2;
+      closest = t;
+      closest_point = q;
+    }
+  });
+  if (crossed < 0 && closest < 0) { return; }
+
+  // Face normal of the triangle hit, on the side of the last position
+  const MeshBVH::Triangle &tri = bvh.triangles[crossed >= 0 ? crossed : closest];
+  Vector3D normal = cross(tri.b - tri.a, tri.c - tri.a);
+  if (dot(last_position - tri.a, normal) < 0) { normal = -normal; }
+
+  Vector3D target;
+  if (crossed >= 0) {
+    // Stop the point just before the surface it went through
+    if (normal.norm2() == 0) { return; }
+    target = last_position + first * m + thickness * normal.unit();
+  } else {
+    // Push the point out to thickness from the surface, on its own side
+    Vector3D d = position - closest_point;
+    double distance = sqrt(closest2);
+    if (distance > 0) {
+      target = closest_point + d * (thickness / distance);
+    } else if (normal.norm2() > 0) {
+      target = closest_point + thickness * normal.unit();
+    } else {
+      return;
+    }
+  }
+  Vector3D correction = target - last_position;
+  position = last_position + correction * (1 - friction);
+}
+
+void TriangleMesh::collide(Vector3D *positions, const Vector3D *last_positions, long count) {
+  // Only points whose path overlaps the padded bounds of the mesh can reach
+  // it; the others skip the tree altogether
+  collide_batch(positions, last_positions, count, [&](const Vector3D &p, const Vector3D &q) {
+    return path_overlaps(p, q, padded_bounds);
+  });
+}
+
+#ifndef CLOTHSIM_HEADLESS
+void TriangleMesh::render(GLShader &shader) {
+  nanogui::Color color(0.45f, 0.5f, 0.4f, 1.0f);
+
+  // Flat-shaded triangles, set up on first use so that loading a large mesh
+  // only costs reading its hierarchy
+  long num_triangles = bvh.triangles.size();
+  if (render_positions.cols() != 3 * num_triangles) {
+    render_positions = MatrixXf(3, 3 * num_triangles);
+    render_normals = MatrixXf(4, 3 * num_triangles);
+    for (long t = 0; t < num_triangles; t++) {
+      const MeshBVH::Triangle &tri = bvh.triangles[t];
+      Vector3D n = cross(tri.b - tri.a, tri.c - tri.a);
+      if (n.norm2() > 0) { n.normalize(); }
+      const Vector3D *corners[3] = {&tri.a, &tri.b, &tri.c};
+      for (int k = 0; k < 3; k++) {
+        render_positions.col(3 * t + k) << corners[k]->x, corners[k]->y, corners[k]->z;
+        render_normals.col(3 * t + k) << n.x, n.y, n.z, 0.0;
+      }
+    }
+  }
+
+  if (shader.uniform("u_color", false) != -1) {
+    shader.setUniform("u_color", color);
+  }
+  shader.uploadAttrib("in_position", render_positions);
+  if (shader.attrib("in_normal", false) != -1) {
+    shader.uploadAttrib("in_normal", render_normals);
+  }
+
+  shader.drawArray(GL_TRIANGLES, 0, render_positions.cols());
+}
+#endif
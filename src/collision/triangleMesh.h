@@ -0,0 +1,72 @@
+#ifndef COLLISIONOBJECT_TRIANGLE_MESH_H
+#define COLLISIONOBJECT_TRIANGLE_MESH_H
+
+#include <string>
+#include <vector>
+
+#ifndef CLOTHSIM_HEADLESS
+#include <nanogui/nanogui.h>
+#endif
+
+#include "../clothMesh.h"
+#include "collisionObject.h"
+#include "meshBVH.h"
+
+#ifndef CLOTHSIM_HEADLESS
+using namespace nanogui;
+#endif
+using namespace CGL;
+using namespace std;
+
+// Exact collider for an arbitrary triangle mesh, open or closed (terrain,
+// walls, roofs), found through a MeshBVH. Points are kept thickness away
+// from the triangles: a point whose path over the substep crosses a
+// triangle is stopped on the side it came from, and a point that ends up
+// closer than thickness to the surface is pushed back out on its own side.
+struct TriangleMesh : public CollisionObject {
+public:
+  // Builds the hierarchy of the given mesh (three vertex indices per
+  // triangle)
+  TriangleMesh(const vector<Vector3D> &vertices, const vector<int> &triangles,
+               double friction, double thickness = 0.002);
+
+  // Reads an OBJ mesh, scaled by scale and then moved by position. Its
+  // hierarchy is cached next to it as filename.<hash>.bvh, where the hash
+  // covers the size and modification time of the file and the transform,
+  // so a cached mesh starts without reading the OBJ file at all. Returns
+  // null if the file cannot be read.
+  static TriangleMesh *load(const string &filename, const Vector3D &position,
+                            double scale, double friction, double thickness = 0.002);
+
+#ifndef CLOTHSIM_HEADLESS
+  void render(GLShader &shader);
+#endif
+  void collide(Vector3D &position, const Vector3D &last_position);
+  void collide(Vector3D *positions, const Vector3D *last_positions, long count);
+  BBox bounds() const { return padded_bounds; }
+
+  // Whether the hierarchy came from the disk cache rather than a build, and
+  // the cache file used, if any
+  bool loaded_from_cache = false;
+  string cache_filename;
+
+  double friction;
+  double thickness;
+
+  MeshBVH bvh;
+
+private:
+  TriangleMesh(double friction, double thickness)
+      : friction(friction), thickness(thickness) {}
+
+  // Sets up the bounds once the hierarchy is ready
+  void finish();
+
+  BBox padded_bounds;
+
+#ifndef CLOTHSIM_HEADLESS
+  MatrixXf render_positions, render_normals;
+#endif
+};
+
+#endif /* COLLISIONOBJECT_TRIANGLE_MESH_H */
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include "misc/getopt.h" // getopt for windows
+#else
+#include <getopt.h>
+#include <unistd.h>
+#endif
+#include <vector>
+
+#include "CGL/CGL.h"
+#include "cloth.h"
+#include "misc/thread_utils.h"
+#include "sceneLoader.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Start of a state file, followed by the number of point masses along the
+// width and the height of the cloth (int32 each), then for every frame
+// written its number (int32), its simulated time (double) and the xyz
+// positions of the point masses in row order (float32 each)
+static const char STATE_MAGIC[4] = {'C', 'L', 'S', '1'};
+
+void usageError(const char *binaryName) {
+  printf("Usage: %s -f <scene> [options]\n", binaryName);
+  printf("Simulates a scene without a display and reports the cost of every frame.\n");
+  printf("Program options:\n");
+  printf("  -f     <STRING>    Filename of scene (required)\n");
+  printf("  -n     <INT>       Frames to simulate (default 300)\n");
+  printf("  -s     <INT>       Substeps per frame, unless the scene is adaptive (default 30)\n");
+  printf("  -p     <INT>       Frames per simulated second (default 90)\n");
+  printf("  -t     <INT>       Threads, 0 for all cores (default from the scene)\n");
+  printf("  -o     <STRING>    Per-frame timing CSV (default standard output)\n");
+  printf("  -x     <STRING>    Binary state output, positions of every written frame\n");
+  printf("  -k     <INT>       Write the state every k frames (default 1)\n");
+  printf("\n");
+  exit(-1);
+}
+
+static void write_state(ofstream &out, int frame, const Cloth &cloth) {
+  int32_t number = frame;
+  double time = cloth.time;
+  out.write((const char *)&number, sizeof(number));
+  out.write((const char *)&time, sizeof(time));
+
+  const ParticleStore &particles = cloth.particles;
+  vector<float> positions(3 * particles.size());
+  for (size_t i = 0; i < particles.size(); i++) {
+    Vector3D x = particles.get_position(i);
+    positions[3 * i] = x.x;
+    positions[3 * i + 1] = x.y;
+    positions[3 * i + 2] = x.z;
+  }
+  out.write((const char *)positions.data(), positions.size() * sizeof(float));
+}
+
+int main(int argc, char **argv) {
+  string scene;
+  int num_frames = 300;
+  int simulation_steps = 30;
+  int frames_per_sec = 90;
+  int num_threads = -1;
+  string timing_filename, state_filename;
+  int state_interval = 1;
+
+  int c;
+  while ((c = getopt(argc, argv, "f:n:s:p:t:o:x:k:")) != -1) {
+    switch (c) {
+      case 'f':
+        scene = optarg;
+        break;
+      case 'n':
+        num_frames = max(0, atoi(optarg));
+        break;
+      case 's':
+        simulation_steps = max(1, atoi(optarg));
+        break;
+      case 'p':
+        frames_per_sec = max(1, atoi(optarg));
+        break;
+      case 't':
+        num_threads = max(0, atoi(optarg));
+        break;
+      case 'o':
+        timing_filename = optarg;
+        break;
+      case 'x':
+        state_filename = optarg;
+        break;
+      case 'k':
+        state_interval = max(1, atoi(optarg));
+        break;
+      default:
+        usageError(argv[0]);
+        break;
+    }
+  }
+  if (scene.empty()) { usageError(argv[0]); }
+
+  Cloth cloth;
+  ClothParameters cp;
+  vector<CollisionObject *> objects;
+  if (!loadObjectsFromFile(scene, &cloth, &cp, &objects, 40, 40)) {
+    cout << "Error: Unable to load from file: " << scene << endl;
+    return -1;
+  }
+  if (num_threads >= 0) { cp.num_threads = num_threads; }
+
+  cloth.buildGrid(&cp, frames_per_sec, simulation_steps);
+  cloth.buildClothMesh();
+
+  ofstream timing_file;
+  if (!timing_filename.empty()) {
+    timing_file.open(timing_filename);
+    if (!timing_file.good()) {
+      cout << "Error: Unable to write " << timing_filename << endl;
+      return -1;
+    }
+  }
+  ostream &timing = timing_filename.empty() ? cout : timing_file;
+
+  ofstream state;
+  if (!state_filename.empty()) {
+    state.open(state_filename, ios::binary);
+    if (!state.good()) {
+      cout << "Error: Unable to write " << state_filename << endl;
+      return -1;
+    }
+    int32_t size[2] = {cloth.num_width_points, cloth.num_height_points};
+    state.write(STATE_MAGIC, sizeof(STATE_MAGIC));
+    state.write((const char *)size, sizeof(size));
+    write_state(state, 0, cloth);
+  }
+
+  cerr << "[ClothSim] " << cloth.particles.size() << " point masses, "
+       << cloth.springs.size() << " springs, " << objects.size() << " collision objects, "
+       << ThreadUtils::resolve_num_threads(cp.num_threads) << " threads" << endl;
+
+  vector<Vector3D> external_accelerations = {Vector3D(0, -9.8, 0)};
+  vector<double> frame_ms(num_frames);
+  timing << "frame,substeps,ms,time" << endl;
+  for (int frame = 1; frame <= num_frames; frame++) {
+    Clock::time_point start = Clock::now();
+    int steps = cloth.substep_controller.choose(&cloth, &cp, frames_per_sec, simulation_steps);
+    for (int i = 0; i < steps; i++) {
+      cloth.simulate(frames_per_sec, steps, &cp, external_accelerations, &objects);
+    }
+    double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+    frame_ms[frame - 1] = ms;
+
+    timing << frame << "," << steps << "," << ms << "," << cloth.time << "\n";
+    if (state.is_open() && frame % state_interval == 0) { write_state(state, frame, cloth); }
+  }
+  timing.flush();
+
+  if (state.is_open() && !state.good()) {
+    cout << "Error: Unable to write " << state_filename << endl;
+    return -1;
+  }
+
+  if (num_frames > 0) {
+    double total = 0;
+    for (double ms : frame_ms) { total += ms; }
+    sort(frame_ms.begin(), frame_ms.end());
+    fprintf(stderr, "[ClothSim] %d frames in %.1f s: %.2f ms mean, %.2f ms median, "
+                    "%.2f ms 95th percentile, %.2f ms worst\n",
+            num_frames, total / 1000, total / num_frames, frame_ms[num_frames / 2],
+            frame_ms[min(num_frames - 1, (int)(0.95 * num_frames))], frame_ms.back());
+  }
+
+  for (CollisionObject *object : objects) { delete object; }
+  return 0;
+}
@@ -0,0 +1,351 @@
+#include "kernels.h"
+
+#ifdef CLOTHSIM_X86_KERNELS
+
+#include <cmath>
+#include <immintrin.h>
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+using namespace CGL;
+
+namespace Kernels {
+
+// Springs are packed {a, b, rest_length} triples of 32-bit words
+static const int SPRING_WORDS = sizeof(Spring) / sizeof(uint32_t);
+
+AVX2_TARGET static inline __m128i spring_word_index() {
+  return _mm_setr_epi32(0, SPRING_WORDS, 2 * SPRING_WORDS, 3 * SPRING_WORDS);
+}
+
+// Loads endpoint indices (pre-multiplied by 3) and rest lengths of 4 springs
+AVX2_TARGET static inline void load_springs(const Spring *s, __m128i &a3,
+                                            __m128i &b3, __m256d &rest) {
+  __m128i three = _mm_set1_epi32(3);
+  a3 = _mm_mullo_epi32(_mm_setr_epi32(s[0].a, s[1].a, s[2].a, s[3].a), three);
+  b3 = _mm_mullo_epi32(_mm_setr_epi32(s[0].b, s[1].b, s[2].b, s[3].b), three);
+  rest = _mm256_cvtps_pd(_mm_setr_ps(s[0].rest_length, s[1].rest_length,
+                                     s[2].rest_length, s[3].rest_length));
+}
+
+// Loads the positions of 4 particles (indices pre-multiplied by 3) and
+// transposes them into one register per coordinate. Cheaper than three
+// gathers on most cores.
+AVX2_TARGET static inline void load_points(const double *position, __m128i i3,
+                                           __m256d &x, __m256d &y, __m256d &z) {
+  alignas(16) int idx[4];
+  _mm_store_si128(reinterpret_cast<__m128i *>(idx), i3);
+  __m256d r[4];
+  for (int l = 0; l < 4; l++) {
+    const double *p = position + idx[l];
+    r[l] = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(p)),
+                                _mm_load_sd(p + 2), 1);
+  }
+  __m256d xz01 = _mm256_unpacklo_pd(r[0], r[1]);
+  __m256d y01 = _mm256_unpackhi_pd(r[0], r[1]);
+  __m256d xz23 = _mm256_unpacklo_pd(r[2], r[3]);
+  __m256d y23 = _mm256_unpackhi_pd(r[2], r[3]);
+  x = _mm256_permute2f128_pd(xz01, xz23, 0x20);
+  y = _mm256_permute2f128_pd(y01, y23, 0x20);
+  z = _mm256_permute2f128_pd(xz01, xz23, 0x31);
+}
+
+AVX2_TARGET static void spring_forces_avx2(const Spring *springs, long count,
+                                           double ks, const double *position,
+                                           double *forces) {
+  __m256d vks = _mm256_set1_pd(ks);
+  long k = 0;
+  for (; k + 4 <= count; k += 4) {
+    __m128i a3, b3;
+    __m256d rest;
+    load_springs(springs + k, a3, b3, rest);
+
+    __m256d ax, ay, az, bx, by, bz;
+    load_points(position, a3, ax, ay, az);
+    load_points(position, b3, bx, by, bz);
+    __m256d dx = _mm256_sub_pd(ax, bx);
+    __m256d dy = _mm256_sub_pd(ay, by);
+    __m256d dz = _mm256_sub_pd(az, bz);
+    __m256d length = _mm256_sqrt_pd(_mm256_add_pd(
+        _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+        _mm256_mul_pd(dz, dz)));
+    __m256d s = _mm256_div_pd(
+        _mm256_mul_pd(vks, _mm256_sub_pd(length, rest)), length);
+
+    // AVX2 has no scatter; springs of a block are independent, so the four
+    // lanes are written back one by one.
+    alignas(32) double fx[4], fy[4], fz[4];
+    alignas(16) int ia[4], ib[4];
+    _mm256_store_pd(fx, _mm256_mul_pd(dx, s));
+    _mm256_store_pd(fy, _mm256_mul_pd(dy, s));
+    _mm256_store_pd(fz, _mm256_mul_pd(dz, s));
+    _mm_store_si128(reinterpret_cast<__m128i *>(ia), a3);
+    _mm_store_si128(reinterpret_cast<__m128i *>(ib), b3);
+    for (int l = 0; l < 4; l++) {
+      double *fa = forces + ia[l];
+      double *fb = forces + ib[l];
+      fb[0] += fx[l]; fb[1] += fy[l]; fb[2] += fz[l];
+      fa[0] -= fx[l]; fa[1] -= fy[l]; fa[2] -= fz[l];
+    }
+  }
+  scalar_kernels.f64.spring_forces(springs + k, count - k, ks, position,
+                                   forces);
+}
+
+AVX2_TARGET static void verlet_avx2(long begin, long end, double damping,
+                                    double dt2, const double *inv_mass,
+                                    const double *forces, double *position,
+                                    double *last_position) {
+  __m256d vdamping = _mm256_set1_pd(damping);
+  __m256d vdt2 = _mm256_set1_pd(dt2);
+  __m256d zero = _mm256_setzero_pd();
+  long i = begin;
+  // 4 particles are 12 interleaved coordinates, i.e. 3 registers
+  for (; i + 4 <= end; i += 4) {
+    __m256d w4 = _mm256_loadu_pd(inv_mass + i);
+    __m256d w[3] = {
+      _mm256_permute4x64_pd(w4, _MM_SHUFFLE(1, 0, 0, 0)),
+      _mm256_permute4x64_pd(w4, _MM_SHUFFLE(2, 2, 1, 1)),
+      _mm256_permute4x64_pd(w4, _MM_SHUFFLE(3, 3, 3, 2)),
+    };
+    for (int r = 0; r < 3; r++) {
+      double *pp = position + 3 * i + 4 * r;
+      double *lp = last_position + 3 * i + 4 * r;
+      __m256d p = _mm256_loadu_pd(pp);
+      __m256d l = _mm256_loadu_pd(lp);
+      __m256d f = _mm256_loadu_pd(forces + 3 * i + 4 * r);
+      __m256d next = _mm256_add_pd(
+          _mm256_add_pd(p, _mm256_mul_pd(vdamping, _mm256_sub_pd(p, l))),
+          _mm256_mul_pd(f, _mm256_mul_pd(w[r], vdt2)));
+      // pinned particles (zero inverse mass) keep both positions
+      __m256d moving = _mm256_cmp_pd(w[r], zero, _CMP_NEQ_OQ);
+      _mm256_storeu_pd(pp, _mm256_blendv_pd(p, next, moving));
+      _mm256_storeu_pd(lp, _mm256_blendv_pd(l, p, moving));
+    }
+  }
+  scalar_kernels.f64.verlet(i, end, damping, dt2, inv_mass, forces, position,
+                            last_position);
+}
+
+AVX2_TARGET static void limit_strain_avx2(const Spring *springs, long count,
+                                          double max_stretch,
+                                          const double *inv_mass,
+                                          double *position) {
+  __m256d vstretch = _mm256_set1_pd(max_stretch);
+  long k = 0;
+  for (; k + 4 <= count; k += 4) {
+    __m128i a3, b3;
+    __m256d rest;
+    load_springs(springs + k, a3, b3, rest);
+
+    __m256d ax, ay, az, bx, by, bz;
+    load_points(position, a3, ax, ay, az);
+    load_points(position, b3, bx, by, bz);
+    __m256d dx = _mm256_sub_pd(bx, ax);
+    __m256d dy = _mm256_sub_pd(by, ay);
+    __m256d dz = _mm256_sub_pd(bz, az);
+    __m256d dist = _mm256_sqrt_pd(_mm256_add_pd(
+        _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+        _mm256_mul_pd(dz, dz)));
+    __m256d max_length = _mm256_mul_pd(rest, vstretch);
+
+    // Most springs are within the limit; skip the block early if all are
+    int stretched = _mm256_movemask_pd(_mm256_cmp_pd(dist, max_length, _CMP_GT_OQ));
+    if (stretched == 0) continue;
+
+    alignas(32) double cx[4], cy[4], cz[4], over[4], d[4];
+    alignas(16) int ia[4], ib[4];
+    _mm256_store_pd(cx, dx);
+    _mm256_store_pd(cy, dy);
+    _mm256_store_pd(cz, dz);
+    _mm256_store_pd(over, _mm256_sub_pd(dist, max_length));
+    _mm256_store_pd(d, dist);
+    _mm_store_si128(reinterpret_cast<__m128i *>(ia), a3);
+    _mm_store_si128(reinterpret_cast<__m128i *>(ib), b3);
+    for (int l = 0; l < 4; l++) {
+      if (!(stretched & (1 << l))) continue;
+      double wa = inv_mass[ia[l] / 3], wb = inv_mass[ib[l] / 3];
+      double w = wa + wb;
+      if (w == 0) continue;
+      double s = over[l] / (d[l] * w);
+      double *pa = position + ia[l];
+      double *pb = position + ib[l];
+      pa[0] += wa * (cx[l] * s); pa[1] += wa * (cy[l] * s); pa[2] += wa * (cz[l] * s);
+      pb[0] -= wb * (cx[l] * s); pb[1] -= wb * (cy[l] * s); pb[2] -= wb * (cz[l] * s);
+    }
+  }
+  scalar_kernels.f64.limit_strain(springs + k, count - k, max_stretch,
+                                  inv_mass, position);
+}
+
+// Single-precision kernels handle 8 springs or particles per iteration.
+
+// Loads endpoint indices (pre-multiplied by 3) and rest lengths of 8 springs
+AVX2_TARGET static inline void load_springs(const Spring *s, __m256i &a3,
+                                            __m256i &b3, __m256 &rest) {
+  __m256i three = _mm256_set1_epi32(3);
+  a3 = _mm256_mullo_epi32(_mm256_setr_epi32(s[0].a, s[1].a, s[2].a, s[3].a,
+                                            s[4].a, s[5].a, s[6].a, s[7].a),
+                          three);
+  b3 = _mm256_mullo_epi32(_mm256_setr_epi32(s[0].b, s[1].b, s[2].b, s[3].b,
+                                            s[4].b, s[5].b, s[6].b, s[7].b),
+                          three);
+  rest = _mm256_setr_ps(s[0].rest_length, s[1].rest_length, s[2].rest_length,
+                        s[3].rest_length, s[4].rest_length, s[5].rest_length,
+                        s[6].rest_length, s[7].rest_length);
+}
+
+// Loads 8 doubles rounded to float
+AVX2_TARGET static inline __m256 load_float8(const double *v) {
+  return _mm256_insertf128_ps(
+      _mm256_castps128_ps256(_mm256_cvtpd_ps(_mm256_loadu_pd(v))),
+      _mm256_cvtpd_ps(_mm256_loadu_pd(v + 4)), 1);
+}
+
+// A packed float xyz triple cannot be loaded as one vector without reading
+// past the last particle, so coordinates are gathered instead
+AVX2_TARGET static inline void load_points(const float *position, __m256i i3,
+                                           __m256 &x, __m256 &y, __m256 &z) {
+  x = _mm256_i32gather_ps(position, i3, 4);
+  y = _mm256_i32gather_ps(position + 1, i3, 4);
+  z = _mm256_i32gather_ps(position + 2, i3, 4);
+}
+
+AVX2_TARGET static void spring_forces_avx2_f32(const Spring *springs,
+                                               long count, double ks,
+                                               const float *position,
+                                               double *forces) {
+  __m256 vks = _mm256_set1_ps((float)ks);
+  long k = 0;
+  for (; k + 8 <= count; k += 8) {
+    __m256i a3, b3;
+    __m256 rest;
+    load_springs(springs + k, a3, b3, rest);
+
+    __m256 ax, ay, az, bx, by, bz;
+    load_points(position, a3, ax, ay, az);
+    load_points(position, b3, bx, by, bz);
+    __m256 dx = _mm256_sub_ps(ax, bx);
+    __m256 dy = _mm256_sub_ps(ay, by);
+    __m256 dz = _mm256_sub_ps(az, bz);
+    __m256 length = _mm256_sqrt_ps(_mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+        _mm256_mul_ps(dz, dz)));
+    __m256 s = _mm256_div_ps(_mm256_mul_ps(vks, _mm256_sub_ps(length, rest)),
+                             length);
+
+    alignas(32) float fx[8], fy[8], fz[8];
+    alignas(32) int ia[8], ib[8];
+    _mm256_store_ps(fx, _mm256_mul_ps(dx, s));
+    _mm256_store_ps(fy, _mm256_mul_ps(dy, s));
+    _mm256_store_ps(fz, _mm256_mul_ps(dz, s));
+    _mm256_store_si256(reinterpret_cast<__m256i *>(ia), a3);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(ib), b3);
+    for (int l = 0; l < 8; l++) {
+      double *fa = forces + ia[l];
+      double *fb = forces + ib[l];
+      fb[0] += fx[l]; fb[1] += fy[l]; fb[2] += fz[l];
+      fa[0] -= fx[l]; fa[1] -= fy[l]; fa[2] -= fz[l];
+    }
+  }
+  scalar_kernels.f32.spring_forces(springs + k, count - k, ks, position,
+                                   forces);
+}
+
+AVX2_TARGET static void verlet_avx2_f32(long begin, long end, double damping,
+                                        double dt2, const double *inv_mass,
+                                        const double *forces, float *position,
+                                        float *last_position) {
+  __m256 vdamping = _mm256_set1_ps((float)damping);
+  __m256 vdt2 = _mm256_set1_ps((float)dt2);
+  __m256 zero = _mm256_setzero_ps();
+  // Inverse mass of the particle owning each of the 24 coordinates
+  const __m256i owner[3] = {
+    _mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2),
+    _mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5),
+    _mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7),
+  };
+  long i = begin;
+  // 8 particles are 24 interleaved coordinates, i.e. 3 registers
+  for (; i + 8 <= end; i += 8) {
+    __m256 w8 = load_float8(inv_mass + i);
+    for (int r = 0; r < 3; r++) {
+      __m256 w = _mm256_permutevar8x32_ps(w8, owner[r]);
+      float *pp = position + 3 * i + 8 * r;
+      float *lp = last_position + 3 * i + 8 * r;
+      __m256 p = _mm256_loadu_ps(pp);
+      __m256 l = _mm256_loadu_ps(lp);
+      __m256 f = load_float8(forces + 3 * i + 8 * r);
+      __m256 next = _mm256_add_ps(
+          _mm256_add_ps(p, _mm256_mul_ps(vdamping, _mm256_sub_ps(p, l))),
+          _mm256_mul_ps(f, _mm256_mul_ps(w, vdt2)));
+      // pinned particles (zero inverse mass) keep both positions
+      __m256 moving = _mm256_cmp_ps(w, zero, _CMP_NEQ_OQ);
+      _mm256_storeu_ps(pp, _mm256_blendv_ps(p, next, moving));
+      _mm256_storeu_ps(lp, _mm256_blendv_ps(l, p, moving));
+    }
+  }
+  scalar_kernels.f32.verlet(i, end, damping, dt2, inv_mass, forces, position,
+                            last_position);
+}
+
+AVX2_TARGET static void limit_strain_avx2_f32(const Spring *springs,
+                                              long count, double max_stretch,
+                                              const double *inv_mass,
+                                              float *position) {
+  __m256 vstretch = _mm256_set1_ps((float)max_stretch);
+  long k = 0;
+  for (; k + 8 <= count; k += 8) {
+    __m256i a3, b3;
+    __m256 rest;
+    load_springs(springs + k, a3, b3, rest);
+
+    __m256 ax, ay, az, bx, by, bz;
+    load_points(position, a3, ax, ay, az);
+    load_points(position, b3, bx, by, bz);
+    __m256 dx = _mm256_sub_ps(bx, ax);
+    __m256 dy = _mm256_sub_ps(by, ay);
+    __m256 dz = _mm256_sub_ps(bz, az);
+    __m256 dist = _mm256_sqrt_ps(_mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+        _mm256_mul_ps(dz, dz)));
+    __m256 max_length = _mm256_mul_ps(rest, vstretch);
+
+    // Most springs are within the limit; skip the block early if all are
+    int stretched = _mm256_movemask_ps(_mm256_cmp_ps(dist, max_length, _CMP_GT_OQ));
+    if (stretched == 0) continue;
+
+    alignas(32) float cx[8], cy[8], cz[8], over[8], d[8];
+    alignas(32) int ia[8], ib[8];
+    _mm256_store_ps(cx, dx);
+    _mm256_store_ps(cy, dy);
+    _mm256_store_ps(cz, dz);
+    _mm256_store_ps(over, _mm256_sub_ps(dist, max_length));
+    _mm256_store_ps(d, dist);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(ia), a3);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(ib), b3);
+    for (int l = 0; l < 8; l++) {
+      if (!(stretched & (1 << l))) continue;
+      float wa = (float)inv_mass[ia[l] / 3], wb = (float)inv_mass[ib[l] / 3];
+      float w = wa + wb;
+      if (w == 0) continue;
+      float s = over[l] / (d[l] * w);
+      float *pa = position + ia[l];
+      float *pb = position + ib[l];
+      pa[0] += wa * (cx[l] * s); pa[1] += wa * (cy[l] * s); pa[2] += wa * (cz[l] * s);
+      pb[0] -= wb * (cx[l] * s); pb[1] -= wb * (cy[l] * s); pb[2] -= wb * (cz[l] * s);
+    }
+  }
+  scalar_kernels.f32.limit_strain(springs + k, count - k, max_stretch,
+                                  inv_mass, position);
+}
+
+const KernelTable avx2_kernels = {
+  ISA_AVX2, "avx2",
+  {spring_forces_avx2, verlet_avx2, limit_strain_avx2},
+  {spring_forces_avx2_f32, verlet_avx2_f32, limit_strain_avx2_f32}
+};
+
+}
+
+#endif // CLOTHSIM_X86_KERNELS
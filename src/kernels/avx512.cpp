@@ -0,0 +1,350 @@
+#include "kernels.h"
+
+#ifdef CLOTHSIM_X86_KERNELS
+
+#include <cmath>
+#include <immintrin.h>
+
+#define AVX512_TARGET __attribute__((target("avx512f")))
+
+using namespace CGL;
+
+namespace Kernels {
+
+// Springs are packed {a, b, rest_length} triples of 32-bit words
+static const int SPRING_WORDS = sizeof(Spring) / sizeof(uint32_t);
+
+// Loads endpoint indices and rest lengths of 8 springs
+AVX512_TARGET static inline void load_springs(const Spring *springs, __m256i &a,
+                                              __m256i &b, __m512d &rest) {
+  const int *words = reinterpret_cast<const int *>(springs);
+  __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                     _mm256_set1_epi32(SPRING_WORDS));
+  a = _mm256_i32gather_epi32(words, index, 4);
+  b = _mm256_i32gather_epi32(words + 1, index, 4);
+  rest = _mm512_cvtps_pd(_mm256_i32gather_ps(
+      reinterpret_cast<const float *>(words + 2), index, 4));
+}
+
+AVX512_TARGET static inline __m256i times3(__m256i v) {
+  return _mm256_mullo_epi32(v, _mm256_set1_epi32(3));
+}
+
+AVX512_TARGET static void spring_forces_avx512(const Spring *springs,
+                                               long count, double ks,
+                                               const double *position,
+                                               double *forces) {
+  __m512d vks = _mm512_set1_pd(ks);
+  long k = 0;
+  for (; k + 8 <= count; k += 8) {
+    __m256i a, b;
+    __m512d rest;
+    load_springs(springs + k, a, b, rest);
+    __m256i a3 = times3(a), b3 = times3(b);
+
+    __m512d dx = _mm512_sub_pd(_mm512_i32gather_pd(a3, position, 8),
+                               _mm512_i32gather_pd(b3, position, 8));
+    __m512d dy = _mm512_sub_pd(_mm512_i32gather_pd(a3, position + 1, 8),
+                               _mm512_i32gather_pd(b3, position + 1, 8));
+    __m512d dz = _mm512_sub_pd(_mm512_i32gather_pd(a3, position + 2, 8),
+                               _mm512_i32gather_pd(b3, position + 2, 8));
+    __m512d length = _mm512_sqrt_pd(_mm512_add_pd(
+        _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)),
+        _mm512_mul_pd(dz, dz)));
+    __m512d s = _mm512_div_pd(
+        _mm512_mul_pd(vks, _mm512_sub_pd(length, rest)), length);
+    __m512d f[3] = {_mm512_mul_pd(dx, s), _mm512_mul_pd(dy, s),
+                    _mm512_mul_pd(dz, s)};
+
+    // Springs of a block share no particle, so the scatters cannot collide
+    for (int c = 0; c < 3; c++) {
+      __m512d fb = _mm512_i32gather_pd(b3, forces + c, 8);
+      _mm512_i32scatter_pd(forces + c, b3, _mm512_add_pd(fb, f[c]), 8);
+      __m512d fa = _mm512_i32gather_pd(a3, forces + c, 8);
+      _mm512_i32scatter_pd(forces + c, a3, _mm512_sub_pd(fa, f[c]), 8);
+    }
+  }
+  scalar_kernels.f64.spring_forces(springs + k, count - k, ks, position,
+                                   forces);
+}
+
+AVX512_TARGET static void verlet_avx512(long begin, long end, double damping,
+                                        double dt2, const double *inv_mass,
+                                        const double *forces, double *position,
+                                        double *last_position) {
+  __m512d vdamping = _mm512_set1_pd(damping);
+  __m512d vdt2 = _mm512_set1_pd(dt2);
+  __m512d zero = _mm512_setzero_pd();
+  // Inverse mass of the particle owning each of the 24 coordinates
+  const __m512i owner[3] = {
+    _mm512_setr_epi64(0, 0, 0, 1, 1, 1, 2, 2),
+    _mm512_setr_epi64(2, 3, 3, 3, 4, 4, 4, 5),
+    _mm512_setr_epi64(5, 5, 6, 6, 6, 7, 7, 7),
+  };
+  long i = begin;
+  // 8 particles are 24 interleaved coordinates, i.e. 3 registers
+  for (; i + 8 <= end; i += 8) {
+    __m512d w8 = _mm512_loadu_pd(inv_mass + i);
+    for (int r = 0; r < 3; r++) {
+      __m512d w = _mm512_permutexvar_pd(owner[r], w8);
+      double *pp = position + 3 * i + 8 * r;
+      double *lp = last_position + 3 * i + 8 * r;
+      __m512d p = _mm512_loadu_pd(pp);
+      __m512d l = _mm512_loadu_pd(lp);
+      __m512d f = _mm512_loadu_pd(forces + 3 * i + 8 * r);
+      __m512d next = _mm512_add_pd(
+          _mm512_add_pd(p, _mm512_mul_pd(vdamping, _mm512_sub_pd(p, l))),
+          _mm512_mul_pd(f, _mm512_mul_pd(w, vdt2)));
+      // pinned particles (zero inverse mass) keep both positions
+      __mmask8 moving = _mm512_cmp_pd_mask(w, zero, _CMP_NEQ_OQ);
+      _mm512_mask_storeu_pd(pp, moving, next);
+      _mm512_mask_storeu_pd(lp, moving, p);
+    }
+  }
+  scalar_kernels.f64.verlet(i, end, damping, dt2, inv_mass, forces, position,
+                            last_position);
+}
+
+AVX512_TARGET static void limit_strain_avx512(const Spring *springs,
+                                              long count, double max_stretch,
+                                              const double *inv_mass,
+                                              double *position) {
+  __m512d vstretch = _mm512_set1_pd(max_stretch);
+  __m512d zero = _mm512_setzero_pd();
+  long k = 0;
+  for (; k + 8 <= count; k += 8) {
+    __m256i a, b;
+    __m512d rest;
+    load_springs(springs + k, a, b, rest);
+    __m256i a3 = times3(a), b3 = times3(b);
+
+    __m512d dx = _mm512_sub_pd(_mm512_i32gather_pd(b3, position, 8),
+                               _mm512_i32gather_pd(a3, position, 8));
+    __m512d dy = _mm512_sub_pd(_mm512_i32gather_pd(b3, position + 1, 8),
+                               _mm512_i32gather_pd(a3, position + 1, 8));
+    __m512d dz = _mm512_sub_pd(_mm512_i32gather_pd(b3, position + 2, 8),
+                               _mm512_i32gather_pd(a3, position + 2, 8));
+    __m512d dist = _mm512_sqrt_pd(_mm512_add_pd(
+        _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)),
+        _mm512_mul_pd(dz, dz)));
+    __m512d max_length = _mm512_mul_pd(rest, vstretch);
+
+    // Most springs are within the limit; skip the block early if all are
+    __mmask8 stretched = _mm512_cmp_pd_mask(dist, max_length, _CMP_GT_OQ);
+    if (stretched == 0) continue;
+
+    __m512d wa = _mm512_mask_i32gather_pd(zero, stretched, a, inv_mass, 8);
+    __m512d wb = _mm512_mask_i32gather_pd(zero, stretched, b, inv_mass, 8);
+    __m512d w = _mm512_add_pd(wa, wb);
+    __mmask8 active = _mm512_mask_cmp_pd_mask(stretched, w, zero, _CMP_NEQ_OQ);
+    if (active == 0) continue;
+
+    __m512d s = _mm512_div_pd(_mm512_sub_pd(dist, max_length),
+                              _mm512_mul_pd(dist, w));
+    __m512d c[3] = {_mm512_mul_pd(dx, s), _mm512_mul_pd(dy, s),
+                    _mm512_mul_pd(dz, s)};
+    for (int j = 0; j < 3; j++) {
+      __m512d pa = _mm512_mask_i32gather_pd(zero, active, a3, position + j, 8);
+      pa = _mm512_add_pd(pa, _mm512_mul_pd(wa, c[j]));
+      _mm512_mask_i32scatter_pd(position + j, active, a3, pa, 8);
+      __m512d pb = _mm512_mask_i32gather_pd(zero, active, b3, position + j, 8);
+      pb = _mm512_sub_pd(pb, _mm512_mul_pd(wb, c[j]));
+      _mm512_mask_i32scatter_pd(position + j, active, b3, pb, 8);
+    }
+  }
+  scalar_kernels.f64.limit_strain(springs + k, count - k, max_stretch,
+                                  inv_mass, position);
+}
+
+// Single-precision kernels handle 16 springs or particles per iteration.
+
+// Loads endpoint indices and rest lengths of 16 springs
+AVX512_TARGET static inline void load_springs(const Spring *springs, __m512i &a,
+                                              __m512i &b, __m512 &rest) {
+  const int *words = reinterpret_cast<const int *>(springs);
+  __m512i index = _mm512_mullo_epi32(
+      _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+      _mm512_set1_epi32(SPRING_WORDS));
+  a = _mm512_i32gather_epi32(index, words, 4);
+  b = _mm512_i32gather_epi32(index, words + 1, 4);
+  rest = _mm512_i32gather_ps(index, words + 2, 4);
+}
+
+AVX512_TARGET static inline __m512i times3(__m512i v) {
+  return _mm512_mullo_epi32(v, _mm512_set1_epi32(3));
+}
+
+// Converts 16 doubles (inverse masses or forces) to float
+AVX512_TARGET static inline __m512 to_float(__m512d lo, __m512d hi) {
+  return _mm512_castpd_ps(_mm512_insertf64x4(
+      _mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(lo))),
+      _mm256_castps_pd(_mm512_cvtpd_ps(hi)), 1));
+}
+
+// Adds 16 floats to the doubles at base[i3], in two halves of 8 lanes
+AVX512_TARGET static inline void scatter_add(double *base, __m512i i3,
+                                             __m512 v) {
+  __m256i index[2] = {_mm512_castsi512_si256(i3),
+                      _mm512_extracti64x4_epi64(i3, 1)};
+  __m256 high = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1));
+  __m512d half[2] = {_mm512_cvtps_pd(_mm512_castps512_ps256(v)),
+                     _mm512_cvtps_pd(high)};
+  for (int h = 0; h < 2; h++) {
+    __m512d sum = _mm512_add_pd(_mm512_i32gather_pd(index[h], base, 8), half[h]);
+    _mm512_i32scatter_pd(base, index[h], sum, 8);
+  }
+}
+
+AVX512_TARGET static void spring_forces_avx512_f32(const Spring *springs,
+                                                   long count, double ks,
+                                                   const float *position,
+                                                   double *forces) {
+  __m512 vks = _mm512_set1_ps((float)ks);
+  long k = 0;
+  for (; k + 16 <= count; k += 16) {
+    __m512i a, b;
+    __m512 rest;
+    load_springs(springs + k, a, b, rest);
+    __m512i a3 = times3(a), b3 = times3(b);
+
+    __m512 dx = _mm512_sub_ps(_mm512_i32gather_ps(a3, position, 4),
+                              _mm512_i32gather_ps(b3, position, 4));
+    __m512 dy = _mm512_sub_ps(_mm512_i32gather_ps(a3, position + 1, 4),
+                              _mm512_i32gather_ps(b3, position + 1, 4));
+    __m512 dz = _mm512_sub_ps(_mm512_i32gather_ps(a3, position + 2, 4),
+                              _mm512_i32gather_ps(b3, position + 2, 4));
+    __m512 length = _mm512_sqrt_ps(_mm512_add_ps(
+        _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)),
+        _mm512_mul_ps(dz, dz)));
+    __m512 s = _mm512_div_ps(_mm512_mul_ps(vks, _mm512_sub_ps(length, rest)),
+                             length);
+    __m512 f[3] = {_mm512_mul_ps(dx, s), _mm512_mul_ps(dy, s),
+                   _mm512_mul_ps(dz, s)};
+
+    // Springs of a block share no particle, so the scatters cannot collide.
+    // Negating a float is exact, so adding -f rounds like subtracting f.
+    __m512 zero = _mm512_setzero_ps();
+    for (int c = 0; c < 3; c++) {
+      scatter_add(forces + c, b3, f[c]);
+      scatter_add(forces + c, a3, _mm512_sub_ps(zero, f[c]));
+    }
+  }
+  scalar_kernels.f32.spring_forces(springs + k, count - k, ks, position,
+                                   forces);
+}
+
+AVX512_TARGET static void verlet_avx512_f32(long begin, long end,
+                                            double damping, double dt2,
+                                            const double *inv_mass,
+                                            const double *forces,
+                                            float *position,
+                                            float *last_position) {
+  __m512 vdamping = _mm512_set1_ps((float)damping);
+  __m512 vdt2 = _mm512_set1_ps((float)dt2);
+  __m512 zero = _mm512_setzero_ps();
+  // Inverse mass of the particle owning each of the 48 coordinates
+  const __m512i owner[3] = {
+    _mm512_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5),
+    _mm512_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10),
+    _mm512_setr_epi32(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15,
+                      15, 15),
+  };
+  long i = begin;
+  // 16 particles are 48 interleaved coordinates, i.e. 3 registers
+  for (; i + 16 <= end; i += 16) {
+    __m512 w16 = to_float(_mm512_loadu_pd(inv_mass + i),
+                          _mm512_loadu_pd(inv_mass + i + 8));
+    for (int r = 0; r < 3; r++) {
+      __m512 w = _mm512_permutexvar_ps(owner[r], w16);
+      float *pp = position + 3 * i + 16 * r;
+      float *lp = last_position + 3 * i + 16 * r;
+      __m512 p = _mm512_loadu_ps(pp);
+      __m512 l = _mm512_loadu_ps(lp);
+      const double *fp = forces + 3 * i + 16 * r;
+      __m512 f = to_float(_mm512_loadu_pd(fp), _mm512_loadu_pd(fp + 8));
+      __m512 next = _mm512_add_ps(
+          _mm512_add_ps(p, _mm512_mul_ps(vdamping, _mm512_sub_ps(p, l))),
+          _mm512_mul_ps(f, _mm512_mul_ps(w, vdt2)));
+      // pinned particles (zero inverse mass) keep both positions
+      __mmask16 moving = _mm512_cmp_ps_mask(w, zero, _CMP_NEQ_OQ);
+      _mm512_mask_storeu_ps(pp, moving, next);
+      _mm512_mask_storeu_ps(lp, moving, p);
+    }
+  }
+  scalar_kernels.f32.verlet(i, end, damping, dt2, inv_mass, forces, position,
+                            last_position);
+}
+
+// Gathers the inverse masses of 16 particles where mask is set, as floats
+AVX512_TARGET static inline __m512 gather_inv_mass(__mmask16 mask, __m512i i,
+                                                   const double *inv_mass) {
+  __m512d zero = _mm512_setzero_pd();
+  __m512d lo = _mm512_mask_i32gather_pd(zero, (__mmask8)mask,
+                                        _mm512_castsi512_si256(i), inv_mass, 8);
+  __m512d hi = _mm512_mask_i32gather_pd(zero, (__mmask8)(mask >> 8),
+                                        _mm512_extracti64x4_epi64(i, 1),
+                                        inv_mass, 8);
+  return to_float(lo, hi);
+}
+
+AVX512_TARGET static void limit_strain_avx512_f32(const Spring *springs,
+                                                  long count,
+                                                  double max_stretch,
+                                                  const double *inv_mass,
+                                                  float *position) {
+  __m512 vstretch = _mm512_set1_ps((float)max_stretch);
+  __m512 zero = _mm512_setzero_ps();
+  long k = 0;
+  for (; k + 16 <= count; k += 16) {
+    __m512i a, b;
+    __m512 rest;
+    load_springs(springs + k, a, b, rest);
+    __m512i a3 = times3(a), b3 = times3(b);
+
+    __m512 dx = _mm512_sub_ps(_mm512_i32gather_ps(b3, position, 4),
+                              _mm512_i32gather_ps(a3, position, 4));
+    __m512 dy = _mm512_sub_ps(_mm512_i32gather_ps(b3, position + 1, 4),
+                              _mm512_i32gather_ps(a3, position + 1, 4));
+    __m512 dz = _mm512_sub_ps(_mm512_i32gather_ps(b3, position + 2, 4),
+                              _mm512_i32gather_ps(a3, position + 2, 4));
+    __m512 dist = _mm512_sqrt_ps(_mm512_add_ps(
+        _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)),
+        _mm512_mul_ps(dz, dz)));
+    __m512 max_length = _mm512_mul_ps(rest, vstretch);
+
+    // Most springs are within the limit; skip the block early if all are
+    __mmask16 stretched = _mm512_cmp_ps_mask(dist, max_length, _CMP_GT_OQ);
+    if (stretched == 0) continue;
+
+    __m512 wa = gather_inv_mass(stretched, a, inv_mass);
+    __m512 wb = gather_inv_mass(stretched, b, inv_mass);
+    __m512 w = _mm512_add_ps(wa, wb);
+    __mmask16 active = _mm512_mask_cmp_ps_mask(stretched, w, zero, _CMP_NEQ_OQ);
+    if (active == 0) continue;
+
+    __m512 s = _mm512_div_ps(_mm512_sub_ps(dist, max_length),
+                             _mm512_mul_ps(dist, w));
+    __m512 c[3] = {_mm512_mul_ps(dx, s), _mm512_mul_ps(dy, s),
+                   _mm512_mul_ps(dz, s)};
+    for (int j = 0; j < 3; j++) {
+      __m512 pa = _mm512_mask_i32gather_ps(zero, active, a3, position + j, 4);
+      pa = _mm512_add_ps(pa, _mm512_mul_ps(wa, c[j]));
+      _mm512_mask_i32scatter_ps(position + j, active, a3, pa, 4);
+      __m512 pb = _mm512_mask_i32gather_ps(zero, active, b3, position + j, 4);
+      pb = _mm512_sub_ps(pb, _mm512_mul_ps(wb, c[j]));
+      _mm512_mask_i32scatter_ps(position + j, active, b3, pb, 4);
+    }
+  }
+  scalar_kernels.f32.limit_strain(springs + k, count - k, max_stretch,
+                                  inv_mass, position);
+}
+
+const KernelTable avx512_kernels = {
+  ISA_AVX512, "avx512",
+  {spring_forces_avx512, verlet_avx512, limit_strain_avx512},
+  {spring_forces_avx512_f32, verlet_avx512_f32, limit_strain_avx512_f32}
+};
+
+}
+
+#endif // CLOTHSIM_X86_KERNELS
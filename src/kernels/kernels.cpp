@@ -0,0 +1,105 @@
+#include <cmath>
+
+#include "kernels.h"
+
+using namespace CGL;
+
+namespace Kernels {
+
+template <typename Real>
+static void spring_forces_scalar(const Spring *springs, long count, double ks,
+                                 const Real *position, double *forces) {
+  for (long k = 0; k < count; k++) {
+    const Real *pa = position + 3 * springs[k].a;
+    const Real *pb = position + 3 * springs[k].b;
+    Real dx = pa[0] - pb[0];
+    Real dy = pa[1] - pb[1];
+    Real dz = pa[2] - pb[2];
+    Real length = std::sqrt(dx * dx + dy * dy + dz * dz);
+    Real s = (Real)ks * (length - (Real)springs[k].rest_length) / length;
+    Real fx = dx * s, fy = dy * s, fz = dz * s;
+
+    double *fa = forces + 3 * springs[k].a;
+    double *fb = forces + 3 * springs[k].b;
+    fb[0] += fx; fb[1] += fy; fb[2] += fz;
+    fa[0] -= fx; fa[1] -= fy; fa[2] -= fz;
+  }
+}
+
+template <typename Real>
+static void verlet_scalar(long begin, long end, double damping, double dt2,
+                          const double *inv_mass, const double *forces,
+                          Real *position, Real *last_position) {
+  Real d = (Real)damping;
+  for (long i = begin; i < end; i++) {
+    if (inv_mass[i] == 0) continue;
+    Real w = (Real)inv_mass[i] * (Real)dt2;
+    for (long c = 3 * i; c < 3 * i + 3; c++) {
+      Real p = position[c];
+      position[c] = p + d * (p - last_position[c]) + (Real)forces[c] * w;
+      last_position[c] = p;
+    }
+  }
+}
+
+template <typename Real>
+static void limit_strain_scalar(const Spring *springs, long count,
+                                double max_stretch, const double *inv_mass,
+                                Real *position) {
+  for (long k = 0; k < count; k++) {
+    uint32_t a = springs[k].a, b = springs[k].b;
+    Real *pa = position + 3 * a;
+    Real *pb = position + 3 * b;
+    Real dx = pb[0] - pa[0];
+    Real dy = pb[1] - pa[1];
+    Real dz = pb[2] - pa[2];
+    Real dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+    Real max_length = (Real)springs[k].rest_length * (Real)max_stretch;
+    if (dist <= max_length) continue;
+    Real wa = (Real)inv_mass[a], wb = (Real)inv_mass[b];
+    Real w = wa + wb;
+    if (w == 0) continue;
+    Real s = (dist - max_length) / (dist * w);
+    Real cx = dx * s, cy = dy * s, cz = dz * s;
+    pa[0] += wa * cx; pa[1] += wa * cy; pa[2] += wa * cz;
+    pb[0] -= wb * cx; pb[1] -= wb * cy; pb[2] -= wb * cz;
+  }
+}
+
+const KernelTable scalar_kernels = {
+  ISA_SCALAR, "scalar",
+  {spring_forces_scalar<double>, verlet_scalar<double>,
+   limit_strain_scalar<double>},
+  {spring_forces_scalar<float>, verlet_scalar<float>,
+   limit_strain_scalar<float>}
+};
+
+const char *isa_name(e_isa isa) {
+  static const char *const names[NUM_ISAS] = {"scalar", "avx2", "avx512"};
+  return isa >= 0 && isa < NUM_ISAS ? names[isa] : "unknown";
+}
+
+bool is_supported(e_isa isa) {
+  switch (isa) {
+  case ISA_SCALAR:
+    return true;
+#ifdef CLOTHSIM_X86_KERNELS
+  case ISA_AVX2:
+    return __builtin_cpu_supports("avx2");
+  case ISA_AVX512:
+    return __builtin_cpu_supports("avx512f");
+#endif
+  default:
+    return false;
+  }
+}
+
+const KernelTable &select(e_isa requested) {
+#ifdef CLOTHSIM_X86_KERNELS
+  if (requested >= ISA_AVX512 && is_supported(ISA_AVX512)) return avx512_kernels;
+  if (requested >= ISA_AVX2 && is_supported(ISA_AVX2)) return avx2_kernels;
+#endif
+  return scalar_kernels;
+}
+
+}
@@ -0,0 +1,101 @@
+#ifndef CLOTHSIM_KERNELS_H
+#define CLOTHSIM_KERNELS_H
+
+#include <vector>
+
+#include "CGL/vector3D.h"
+#include "../spring.h"
+
+// Explicit SIMD versions are only built for x86 with GCC/Clang, where the
+// instruction set can be chosen per function and detected at runtime.
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define CLOTHSIM_X86_KERNELS 1
+#endif
+
+// Hot loops of the mass-spring step, written against the raw particle and
+// spring arrays, with one implementation per instruction set.
+namespace Kernels {
+
+enum e_isa { ISA_SCALAR = 0, ISA_AVX2 = 1, ISA_AVX512 = 2, NUM_ISAS = 3 };
+
+// Springs handed to a kernel in one call must not share a particle (i.e. come
+// from a single color of a SpringBuffer type range): results are scattered to
+// both endpoints without any synchronization.
+
+// Every kernel exists for double and for single-precision (packed xyz float)
+// particle storage. Parameters stay double; the float kernels round them once
+// and then do all of their arithmetic in float, except that forces are
+// always summed in double: a point takes up to a dozen spring forces that
+// largely cancel, and summing them in float loses most of the residual.
+template <typename Real>
+struct KernelSet {
+  // forces[a] -= f, forces[b] += f for every spring of springs[0, count)
+  typedef void (*SpringForcesFn)(const CGL::Spring *springs, long count,
+                                 double ks, const Real *position, double *forces);
+
+  // Verlet step of particles [begin, end); pinned particles are left untouched
+  typedef void (*VerletFn)(long begin, long end, double damping, double dt2,
+                           const double *inv_mass, const double *forces,
+                           Real *position, Real *last_position);
+
+  // Provot clamp of springs[0, count) to max_stretch times their rest length
+  typedef void (*LimitStrainFn)(const CGL::Spring *springs, long count,
+                                double max_stretch, const double *inv_mass,
+                                Real *position);
+
+  SpringForcesFn spring_forces;
+  VerletFn verlet;
+  LimitStrainFn limit_strain;
+};
+
+struct KernelTable {
+  e_isa isa;
+  const char *name;
+  KernelSet<double> f64;
+  KernelSet<float> f32;
+
+  // Kernels for particle storage of type Real
+  template <typename Real> const KernelSet<Real> &get() const;
+};
+
+template <> inline const KernelSet<double> &KernelTable::get<double>() const {
+  return f64;
+}
+
+template <> inline const KernelSet<float> &KernelTable::get<float>() const {
+  return f32;
+}
+
+// Number of springs or particles handed to a kernel per call; the parallel
+// passes distribute these blocks over threads.
+const long BLOCK_SIZE = 2048;
+
+extern const KernelTable scalar_kernels;
+#ifdef CLOTHSIM_X86_KERNELS
+extern const KernelTable avx2_kernels;
+extern const KernelTable avx512_kernels;
+#endif
+
+// Name of an instruction set, whether or not this build or CPU supports it
+const char *isa_name(e_isa isa);
+
+// Whether both this build and the running CPU support an instruction set
+bool is_supported(e_isa isa);
+
+// Kernels for the widest supported instruction set not wider than requested
+const KernelTable &select(e_isa requested = ISA_AVX512);
+
+inline double *coords(std::vector<CGL::Vector3D> &v) {
+  static_assert(sizeof(CGL::Vector3D) == 3 * sizeof(double),
+                "Vector3D must be three packed doubles");
+  return reinterpret_cast<double *>(v.data());
+}
+
+inline const double *coords(const std::vector<CGL::Vector3D> &v) {
+  return reinterpret_cast<const double *>(v.data());
+}
+
+}
+
+#endif // CLOTHSIM_KERNELS_H
@@ -9,32 +9,19 @@
 #include <getopt.h>
 #include <unistd.h>
 #endif
-#include <unordered_set>
 #include <stdlib.h> // atoi for getopt inputs
 
 #include "CGL/CGL.h"
-#include "collision/plane.h"
-#include "collision/sphere.h"
 #include "cloth.h"
 #include "clothSimulator.h"
-#include "json.hpp"
 #include "misc/file_utils.h"
+#include "sceneLoader.h"
 
 typedef uint32_t gid_t;
 
 using namespace std;
 using namespace nanogui;
 
-using json = nlohmann::json;
-
-#define msg(s) cerr << "[ClothSim] " << s << endl;
-
-const string SPHERE = "sphere";
-const string PLANE = "plane";
-const string CLOTH = "cloth";
-
-const unordered_set<string> VALID_KEYS = {SPHERE, PLANE, CLOTH};
-
 ClothSimulator *app = nullptr;
 GLFWwindow *window = nullptr;
 Screen *screen = nullptr;
@@ -151,219 +138,6 @@ void usageError(const char *binaryName) {
   exit(-1);
 }
 
-void incompleteObjectError(const char *object, const char *attribute) {
-  cout << "Incomplete " << object << " definition, missing " << attribute << endl;
-  exit(-1);
-}
-
-bool loadObjectsFromFile(string filename, Cloth *cloth, ClothParameters *cp, vector<CollisionObject *>* objects, int sphere_num_lat, int sphere_num_lon) {
-  // Read JSON from file
-  ifstream i(filename);
-  if (!i.good()) {
-    return false;
-  }
-  json j;
-  i >> j;
-
-  // Loop over objects in scene
-  for (json::iterator it = j.begin(); it != j.end(); ++it) {
-    string key = it.key();
-
-    // Check that object is valid
-    unordered_set<string>::const_iterator query = VALID_KEYS.find(key);
-    if (query == VALID_KEYS.end()) {
-      cout << "Invalid scene object found: " << key << endl;
-      exit(-1);
-    }
-
-    // Retrieve object
-    json object = it.value();
-
-    // Parse object depending on type (cloth, sphere, or plane)
-    if (key == CLOTH) {
-      // Cloth
-      double width, height;
-      int num_width_points, num_height_points;
-      float thickness;
-      e_orientation orientation;
-      vector<vector<int>> pinned;
-
-      auto it_width = object.find("width");
-      if (it_width != object.end()) {
-        width = *it_width;
-      } else {
-        incompleteObjectError("cloth", "width");
-      }
-
-      auto it_height = object.find("height");
-      if (it_height != object.end()) {
-        height = *it_height;
-      } else {
-        incompleteObjectError("cloth", "height");
-      }
-
-      auto it_num_width_points = object.find("num_width_points");
-      if (it_num_width_points != object.end()) {
-        num_width_points = *it_num_width_points;
-      } else {
-        incompleteObjectError("cloth", "num_width_points");
-      }
-
-      auto it_num_height_points = object.find("num_height_points");
-      if (it_num_height_points != object.end()) {
-        num_height_points = *it_num_height_points;
-      } else {
-        incompleteObjectError("cloth", "num_height_points");
-      }
-
-      auto it_thickness = object.find("thickness");
-      if (it_thickness != object.end()) {
-        thickness = *it_thickness;
-      } else {
-        incompleteObjectError("cloth", "thickness");
-      }
-
-      auto it_orientation = object.find("orientation");
-      if (it_orientation != object.end()) {
-        orientation = *it_orientation;
-      } else {
-        incompleteObjectError("cloth", "orientation");
-      }
-
-      auto it_pinned = object.find("pinned");
-      if (it_pinned != object.end()) {
-        vector<json> points = *it_pinned;
-        for (auto pt : points) {
-          vector<int> point = pt;
-          pinned.push_back(point);
-        }
-      }
-
-      cloth->width = width;
-      cloth->height = height;
-      cloth->num_width_points = num_width_points;
-      cloth->num_height_points = num_height_points;
-      cloth->thickness = thickness;
-      cloth->orientation = orientation;
-      cloth->pinned = pinned;
-
-      // Cloth parameters
-      bool enable_structural_constraints, enable_shearing_constraints, enable_bending_constraints;
-      double damping, density, ks;
-
-      auto it_enable_structural = object.find("enable_structural");
-      if (it_enable_structural != object.end()) {
-        enable_structural_constraints = *it_enable_structural;
-      } else {
-        incompleteObjectError("cloth", "enable_structural");
-      }
-
-      auto it_enable_shearing = object.find("enable_shearing");
-      if (it_enable_shearing != object.end()) {
-        enable_shearing_constraints = *it_enable_shearing;
-      } else {
-        incompleteObjectError("cloth", "it_enable_shearing");
-      }
-
-      auto it_enable_bending = object.find("enable_bending");
-      if (it_enable_bending != object.end()) {
-        enable_bending_constraints = *it_enable_bending;
-      } else {
-        incompleteObjectError("cloth", "it_enable_bending");
-      }
-
-      auto it_damping = object.find("damping");
-      if (it_damping != object.end()) {
-        damping = *it_damping;
-      } else {
-        incompleteObjectError("cloth", "damping");
-      }
-
-      auto it_density = object.find("density");
-      if (it_density != object.end()) {
-        density = *it_density;
-      } else {
-        incompleteObjectError("cloth", "density");
-      }
-
-      auto it_ks = object.find("ks");
-      if (it_ks != object.end()) {
-        ks = *it_ks;
-      } else {
-        incompleteObjectError("cloth", "ks");
-      }
-
-      cp->enable_structural_constraints = enable_structural_constraints;
-      cp->enable_shearing_constraints = enable_shearing_constraints;
-      cp->enable_bending_constraints = enable_bending_constraints;
-      cp->density = density;
-      cp->damping = damping;
-      cp->ks = ks;
-    } else if (key == SPHERE) {
-      Vector3D origin;
-      double radius, friction;
-
-      auto it_origin = object.find("origin");
-      if (it_origin != object.end()) {
-        vector<double> vec_origin = *it_origin;
-        origin = Vector3D(vec_origin[0], vec_origin[1], vec_origin[2]);
-      } else {
-        incompleteObjectError("sphere", "origin");
-      }
-
-      auto it_radius = object.find("radius");
-      if (it_radius != object.end()) {
-        radius = *it_radius;
-      } else {
-        incompleteObjectError("sphere", "radius");
-      }
-
-      auto it_friction = object.find("friction");
-      if (it_friction != object.end()) {
-        friction = *it_friction;
-      } else {
-        incompleteObjectError("sphere", "friction");
-      }
-
-      Sphere *s = new Sphere(origin, radius, friction, sphere_num_lat, sphere_num_lon);
-      objects->push_back(s);
-    } else { // PLANE
-      Vector3D point, normal;
-      double friction;
-
-      auto it_point = object.find("point");
-      if (it_point != object.end()) {
-        vector<double> vec_point = *it_point;
-        point = Vector3D(vec_point[0], vec_point[1], vec_point[2]);
-      } else {
-        incompleteObjectError("plane", "point");
-      }
-
-      auto it_normal = object.find("normal");
-      if (it_normal != object.end()) {
-        vector<double> vec_normal = *it_normal;
-        normal = Vector3D(vec_normal[0], vec_normal[1], vec_normal[2]);
-      } else {
-        incompleteObjectError("plane", "normal");
-      }
-
-      auto it_friction = object.find("friction");
-      if (it_friction != object.end()) {
-        friction = *it_friction;
-      } else {
-        incompleteObjectError("plane", "friction");
-      }
-
-      Plane *p = new Plane(point, normal, friction);
-      objects->push_back(p);
-    }
-  }
-
-  i.close();
-  
-  return true;
-}
-
 bool is_valid_project_root(const std::string& search_path) {
     std::stringstream ss;
     ss << search_path;
@@ -469,8 +243,9 @@ int main(int argc, char **argv) {
 
   createGLContexts();
 
-  // Initialize the Cloth object
-  cloth.buildGrid();
+  // Initialize the Cloth object for the simulation thread's default rates
+  SimulationThread::Settings settings;
+  cloth.buildGrid(&cp, settings.frames_per_sec, settings.simulation_steps);
   cloth.buildClothMesh();
 
   // Initialize the ClothSimulator object
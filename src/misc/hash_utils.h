@@ -0,0 +1,24 @@
+#ifndef CS184_HASH_UTILS_H
+#define CS184_HASH_UTILS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace HashUtils {
+
+// Starting value of a 64-bit FNV-1a hash.
+const uint64_t FNV1A_BASIS = 14695981039346656037ULL;
+
+// Mixes size bytes at data into the 64-bit FNV-1a hash h; used for the
+// keys of the files that cache baked collision data.
+inline void fnv1a(uint64_t &h, const void *data, size_t size) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  for (size_t i = 0; i < size; i++) {
+    h ^= bytes[i];
+    h *= 1099511628211ULL;
+  }
+}
+
+}
+
+#endif // CS184_HASH_UTILS_H
@@ -0,0 +1,51 @@
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "obj_loader.h"
+
+namespace ObjLoader {
+
+bool load_obj(const std::string& filename, std::vector<CGL::Vector3D>& vertices,
+              std::vector<int>& triangles) {
+  std::ifstream in(filename);
+  if (!in.good()) {
+    return false;
+  }
+
+  vertices.clear();
+  triangles.clear();
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream ss(line);
+    std::string type;
+    ss >> type;
+
+    if (type == "v") {
+      CGL::Vector3D v;
+      ss >> v.x >> v.y >> v.z;
+      vertices.push_back(v);
+    } else if (type == "f") {
+      // Each corner is v, v/vt, v//vn or v/vt/vn; negative indices count back
+      // from the last vertex read so far
+      std::vector<int> face;
+      std::string corner;
+      while (ss >> corner) {
+        int index = atoi(corner.c_str());
+        index = index < 0 ? (int)vertices.size() + index : index - 1;
+        if (index < 0 || index >= (int)vertices.size()) {
+          return false;
+        }
+        face.push_back(index);
+      }
+      for (size_t k = 2; k < face.size(); k++) {
+        triangles.push_back(face[0]);
+        triangles.push_back(face[k - 1]);
+        triangles.push_back(face[k]);
+      }
+    }
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,22 @@
+#ifndef CS184_OBJ_LOADER_H
+#define CS184_OBJ_LOADER_H
+
+#include <string>
+#include <vector>
+
+#include "CGL/CGL.h"
+#include "CGL/vector3D.h"
+
+namespace ObjLoader {
+
+// Reads the vertex positions and faces of a Wavefront OBJ file. Polygons are
+// split into triangle fans, and triangles holds three vertex indices per
+// triangle, counted from zero. Texture coordinates, normals, groups and
+// materials are ignored. Returns false if the file cannot be read or a face
+// refers to a missing vertex.
+bool load_obj(const std::string& filename, std::vector<CGL::Vector3D>& vertices,
+              std::vector<int>& triangles);
+
+}
+
+#endif // CS184_OBJ_LOADER_H
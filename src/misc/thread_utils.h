@@ -0,0 +1,35 @@
+#ifndef CS184_THREAD_UTILS_H
+#define CS184_THREAD_UTILS_H
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace ThreadUtils {
+
+// Number of hardware threads OpenMP may use (1 when built without OpenMP).
+inline int max_threads() {
+#ifdef _OPENMP
+  return omp_get_num_procs();
+#else
+  return 1;
+#endif
+}
+
+// Index of the calling thread within the current parallel region.
+inline int thread_num() {
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+// A requested thread count of zero or less means "use every core".
+inline int resolve_num_threads(int requested) {
+  return requested > 0 ? requested : max_threads();
+}
+
+}
+
+#endif // CS184_THREAD_UTILS_H
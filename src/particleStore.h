@@ -0,0 +1,168 @@
+#ifndef PARTICLE_STORE_H
+#define PARTICLE_STORE_H
+
+#include <vector>
+
+#include "CGL/CGL.h"
+#include "CGL/vector3D.h"
+
+using namespace CGL;
+using namespace std;
+
+// Storage type of the dynamic particle arrays
+enum e_precision { DOUBLE_PRECISION = 0, SINGLE_PRECISION = 1 };
+
+// Structure-of-arrays storage for every simulated point of a cloth. Each hot
+// loop in Cloth::simulate only streams the arrays it actually touches.
+//
+// Positions are kept either as doubles (position, last_position) or as
+// packed xyz floats (position_f, last_position_f), depending on precision;
+// only the active set is populated. Forces are summed in double in both
+// modes. Code outside the
+// step kernels goes through the get_/set_ accessors, which always work in
+// double precision.
+struct ParticleStore {
+  void clear() {
+    start_position.clear();
+    position.clear();
+    last_position.clear();
+    forces.clear();
+    position_f.clear();
+    last_position_f.clear();
+    inv_mass.clear();
+  }
+
+  void reserve(size_t n) {
+    start_position.reserve(n);
+    inv_mass.reserve(n);
+    if (precision == SINGLE_PRECISION) {
+      position_f.reserve(3 * n);
+      last_position_f.reserve(3 * n);
+    } else {
+      position.reserve(n);
+      last_position.reserve(n);
+    }
+    forces.reserve(n);
+  }
+
+  int add(const Vector3D &p, bool pinned) {
+    start_position.push_back(p);
+    inv_mass.push_back(pinned ? 0.0 : 1.0 / mass);
+    if (precision == SINGLE_PRECISION) {
+      push(position_f, p);
+      push(last_position_f, p);
+    } else {
+      position.push_back(p);
+      last_position.push_back(p);
+    }
+    forces.push_back(Vector3D());
+    return (int)start_position.size() - 1;
+  }
+
+  size_t size() const { return start_position.size(); }
+
+  bool is_pinned(int i) const { return inv_mass[i] == 0; }
+
+  // Every free particle shares the same mass; pinned particles keep an
+  // inverse mass of zero so that they never move.
+  void set_mass(double m) {
+    mass = m;
+    for (double &w : inv_mass) {
+      if (w != 0) w = 1.0 / m;
+    }
+  }
+
+  // Moves the current state into the storage of the given precision
+  void set_precision(e_precision p) {
+    if (p == precision) return;
+    if (p == SINGLE_PRECISION) {
+      to_float(position, position_f);
+      to_float(last_position, last_position_f);
+    } else {
+      to_double(position_f, position);
+      to_double(last_position_f, last_position);
+    }
+    precision = p;
+  }
+
+  void reset() {
+    for (size_t i = 0; i < size(); i++) {
+      set_position(i, start_position[i]);
+      set_last_position(i, start_position[i]);
+    }
+  }
+
+  Vector3D get_position(size_t i) const {
+    return precision == SINGLE_PRECISION ? load(position_f, i) : position[i];
+  }
+
+  Vector3D get_last_position(size_t i) const {
+    return precision == SINGLE_PRECISION ? load(last_position_f, i)
+                                         : last_position[i];
+  }
+
+  Vector3D get_forces(size_t i) const { return forces[i]; }
+
+  void set_position(size_t i, const Vector3D &p) {
+    if (precision == SINGLE_PRECISION) store(position_f, i, p);
+    else position[i] = p;
+  }
+
+  void set_last_position(size_t i, const Vector3D &p) {
+    if (precision == SINGLE_PRECISION) store(last_position_f, i, p);
+    else last_position[i] = p;
+  }
+
+  e_precision precision = DOUBLE_PRECISION;
+
+  // static values
+  vector<Vector3D> start_position;
+
+  // dynamic values, double precision
+  vector<Vector3D> position;
+  vector<Vector3D> last_position;
+
+  // dynamic values, single precision (packed xyz)
+  vector<float> position_f;
+  vector<float> last_position_f;
+
+  // summed forces, double in both precisions
+  vector<Vector3D> forces;
+
+  vector<double> inv_mass;
+
+  double mass = 1.0;
+
+private:
+  static Vector3D load(const vector<float> &v, size_t i) {
+    return Vector3D(v[3 * i], v[3 * i + 1], v[3 * i + 2]);
+  }
+
+  static void store(vector<float> &v, size_t i, const Vector3D &p) {
+    v[3 * i] = p.x;
+    v[3 * i + 1] = p.y;
+    v[3 * i + 2] = p.z;
+  }
+
+  static void push(vector<float> &v, const Vector3D &p) {
+    v.push_back(p.x);
+    v.push_back(p.y);
+    v.push_back(p.z);
+  }
+
+  static void to_float(vector<Vector3D> &from, vector<float> &to) {
+    to.clear();
+    for (const Vector3D &p : from) push(to, p);
+    from.clear();
+    from.shrink_to_fit();
+  }
+
+  static void to_double(vector<float> &from, vector<Vector3D> &to) {
+    to.clear();
+    for (size_t i = 0; i < from.size() / 3; i++) to.push_back(load(from, i));
+    from.clear();
+    from.shrink_to_fit();
+  }
+};
+
+#endif /* PARTICLE_STORE_H */
@@ -4,30 +4,36 @@
 #include "CGL/CGL.h"
 #include "CGL/misc.h"
 #include "CGL/vector3D.h"
+#include "particleStore.h"
 
 using namespace CGL;
 
 // Forward declarations
 class Halfedge;
 
+// Thin view onto a single particle of a ParticleStore, used by the mesh
+// (Triangle/Halfedge) to resolve its vertices.
 struct PointMass {
-  PointMass(Vector3D position, bool pinned)
-      : pinned(pinned), start_position(position), position(position),
-        last_position(position) {}
+  PointMass(ParticleStore *particles, int index)
+      : particles(particles), index(index), halfedge(nullptr) {}
 
   Vector3D normal();
   Vector3D velocity(double delta_t) {
-    return (position - last_position) / delta_t;
+    return (position() - last_position()) / delta_t;
   }
 
-  // static values
-  bool pinned;
-  Vector3D start_position;
+  Vector3D position() const { return particles->get_position(index); }
+  Vector3D last_position() const {
+    return particles->get_last_position(index);
+  }
+  const Vector3D &start_position() const {
+    return particles->start_position[index];
+  }
+  bool pinned() const { return particles->is_pinned(index); }
 
-  // dynamic values
-  Vector3D position;
-  Vector3D last_position;
-  Vector3D forces;
+  // particle reference
+  ParticleStore *particles;
+  int index;
 
   // mesh reference
   Halfedge *halfedge;
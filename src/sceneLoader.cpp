@@ -0,0 +1,571 @@
+#include <fstream>
+#include <iostream>
+#include <stdlib.h>
+#include <unordered_set>
+
+#include "collision/capsule.h"
+#include "collision/cylinder.h"
+#include "collision/kinematicObject.h"
+#include "collision/meshSDF.h"
+#include "collision/plane.h"
+#include "collision/sphere.h"
+#include "collision/triangleMesh.h"
+#include "json.hpp"
+#include "misc/obj_loader.h"
+#include "sceneLoader.h"
+
+using namespace std;
+
+using json = nlohmann::json;
+
+#define msg(s) cerr << "[ClothSim] " << s << endl;
+
+const string SPHERE = "sphere";
+const string PLANE = "plane";
+const string CLOTH = "cloth";
+const string MESH = "mesh";
+const string CAPSULE = "capsule";
+const string CYLINDER = "cylinder";
+const string TRIANGLE_MESH = "triangle_mesh";
+
+const unordered_set<string> VALID_KEYS = {SPHERE, PLANE, CLOTH, MESH, CAPSULE, CYLINDER,
+                                          TRIANGLE_MESH};
+
+static void incompleteObjectError(const char *object, const char *attribute) {
+  cout << "Incomplete " << object << " definition, missing " << attribute << endl;
+  exit(-1);
+}
+
+static Vector3D parseVector(const json &value) {
+  vector<double> vec = value;
+  return Vector3D(vec[0], vec[1], vec[2]);
+}
+
+// Reads the "motion" of a collision object: a pivot, keyframes of
+// translation and rotation (axis times angle, in radians) at given times,
+// whether the keyframes loop, and constant velocities added on top
+static Motion parseMotion(const json &object) {
+  Motion motion;
+
+  auto it_pivot = object.find("pivot");
+  if (it_pivot != object.end()) {
+    motion.pivot = parseVector(*it_pivot);
+  }
+
+  auto it_keyframes = object.find("keyframes");
+  if (it_keyframes != object.end()) {
+    for (const json &frame : *it_keyframes) {
+      Motion::Keyframe keyframe;
+
+      auto it_time = frame.find("time");
+      if (it_time != frame.end()) {
+        keyframe.time = *it_time;
+      } else {
+        incompleteObjectError("keyframe", "time");
+      }
+
+      auto it_translation = frame.find("translation");
+      if (it_translation != frame.end()) {
+        keyframe.translation = parseVector(*it_translation);
+      }
+
+      auto it_rotation = frame.find("rotation");
+      if (it_rotation != frame.end()) {
+        keyframe.rotation = parseVector(*it_rotation);
+      }
+
+      if (!motion.keyframes.empty() && keyframe.time < motion.keyframes.back().time) {
+        cout << "Motion keyframes must be sorted by time" << endl;
+        exit(-1);
+      }
+      motion.keyframes.push_back(keyframe);
+    }
+  }
+
+  auto it_loop = object.find("loop");
+  if (it_loop != object.end()) {
+    motion.loop = *it_loop;
+  }
+
+  auto it_velocity = object.find("velocity");
+  if (it_velocity != object.end()) {
+    motion.velocity = parseVector(*it_velocity);
+  }
+
+  auto it_angular_velocity = object.find("angular_velocity");
+  if (it_angular_velocity != object.end()) {
+    motion.angular_velocity = parseVector(*it_angular_velocity);
+  }
+
+  return motion;
+}
+
+bool loadObjectsFromFile(string filename, Cloth *cloth, ClothParameters *cp, vector<CollisionObject *>* objects, int sphere_num_lat, int sphere_num_lon) {
+  // Read JSON from file
+  ifstream i(filename);
+  if (!i.good()) {
+    return false;
+  }
+  json j;
+  i >> j;
+
+  // Loop over objects in scene
+  for (json::iterator it = j.begin(); it != j.end(); ++it) {
+    string key = it.key();
+
+    // Check that object is valid
+    unordered_set<string>::const_iterator query = VALID_KEYS.find(key);
+    if (query == VALID_KEYS.end()) {
+      cout << "Invalid scene object found: " << key << endl;
+      exit(-1);
+    }
+
+    // Retrieve objects: a single object, or an array of objects of this type
+    vector<json> entries;
+    if (it.value().is_array()) {
+      entries = it.value().get<vector<json>>();
+    } else {
+      entries.push_back(it.value());
+    }
+    if (key == CLOTH && entries.size() != 1) {
+      cout << "A scene holds exactly one cloth, found " << entries.size() << endl;
+      exit(-1);
+    }
+
+    for (const json &object : entries) {
+      // Parse object depending on type (cloth, sphere, plane, mesh, triangle mesh,
+      // capsule, or cylinder)
+      if (key == CLOTH) {
+        // Cloth
+        double width, height;
+        int num_width_points, num_height_points;
+        float thickness;
+        e_orientation orientation;
+        vector<vector<int>> pinned;
+
+        auto it_width = object.find("width");
+        if (it_width != object.end()) {
+          width = *it_width;
+        } else {
+          incompleteObjectError("cloth", "width");
+        }
+
+        auto it_height = object.find("height");
+        if (it_height != object.end()) {
+          height = *it_height;
+        } else {
+          incompleteObjectError("cloth", "height");
+        }
+
+        auto it_num_width_points = object.find("num_width_points");
+        if (it_num_width_points != object.end()) {
+          num_width_points = *it_num_width_points;
+        } else {
+          incompleteObjectError("cloth", "num_width_points");
+        }
+
+        auto it_num_height_points = object.find("num_height_points");
+        if (it_num_height_points != object.end()) {
+          num_height_points = *it_num_height_points;
+        } else {
+          incompleteObjectError("cloth", "num_height_points");
+        }
+
+        auto it_thickness = object.find("thickness");
+        if (it_thickness != object.end()) {
+          thickness = *it_thickness;
+        } else {
+          incompleteObjectError("cloth", "thickness");
+        }
+
+        auto it_orientation = object.find("orientation");
+        if (it_orientation != object.end()) {
+          orientation = *it_orientation;
+        } else {
+          incompleteObjectError("cloth", "orientation");
+        }
+
+        auto it_pinned = object.find("pinned");
+        if (it_pinned != object.end()) {
+          vector<json> points = *it_pinned;
+          for (auto pt : points) {
+            vector<int> point = pt;
+            pinned.push_back(point);
+          }
+        }
+
+        cloth->width = width;
+        cloth->height = height;
+        cloth->num_width_points = num_width_points;
+        cloth->num_height_points = num_height_points;
+        cloth->thickness = thickness;
+        cloth->orientation = orientation;
+        cloth->pinned = pinned;
+
+        auto it_precision = object.find("precision");
+        if (it_precision != object.end()) {
+          string precision = *it_precision;
+          if (precision == "float") {
+            cloth->particles.set_precision(SINGLE_PRECISION);
+          } else if (precision != "double") {
+            cout << "Invalid cloth precision " << precision
+                 << ", expected \"float\" or \"double\"" << endl;
+            exit(-1);
+          }
+        }
+
+        // Cloth parameters
+        bool enable_structural_constraints, enable_shearing_constraints, enable_bending_constraints;
+        double damping, density, ks;
+
+        auto it_enable_structural = object.find("enable_structural");
+        if (it_enable_structural != object.end()) {
+          enable_structural_constraints = *it_enable_structural;
+        } else {
+          incompleteObjectError("cloth", "enable_structural");
+        }
+
+        auto it_enable_shearing = object.find("enable_shearing");
+        if (it_enable_shearing != object.end()) {
+          enable_shearing_constraints = *it_enable_shearing;
+        } else {
+          incompleteObjectError("cloth", "it_enable_shearing");
+        }
+
+        auto it_enable_bending = object.find("enable_bending");
+        if (it_enable_bending != object.end()) {
+          enable_bending_constraints = *it_enable_bending;
+        } else {
+          incompleteObjectError("cloth", "it_enable_bending");
+        }
+
+        auto it_damping = object.find("damping");
+        if (it_damping != object.end()) {
+          damping = *it_damping;
+        } else {
+          incompleteObjectError("cloth", "damping");
+        }
+
+        auto it_density = object.find("density");
+        if (it_density != object.end()) {
+          density = *it_density;
+        } else {
+          incompleteObjectError("cloth", "density");
+        }
+
+        auto it_ks = object.find("ks");
+        if (it_ks != object.end()) {
+          ks = *it_ks;
+        } else {
+          incompleteObjectError("cloth", "ks");
+        }
+
+        cp->enable_structural_constraints = enable_structural_constraints;
+        cp->enable_shearing_constraints = enable_shearing_constraints;
+        cp->enable_bending_constraints = enable_bending_constraints;
+        cp->density = density;
+        cp->damping = damping;
+        cp->ks = ks;
+
+        auto it_max_strain = object.find("max_strain");
+        if (it_max_strain != object.end()) {
+          cp->max_strain = *it_max_strain;
+        }
+
+        auto it_strain_limit_iterations = object.find("strain_limit_iterations");
+        if (it_strain_limit_iterations != object.end()) {
+          cp->strain_limit_iterations = *it_strain_limit_iterations;
+        }
+
+        auto it_num_threads = object.find("num_threads");
+        if (it_num_threads != object.end()) {
+          cp->num_threads = *it_num_threads;
+        }
+
+        auto it_integrator = object.find("integrator");
+        if (it_integrator != object.end()) {
+          string integrator = *it_integrator;
+          if (integrator == "verlet") {
+            cp->integrator = EXPLICIT_VERLET;
+          } else if (integrator == "implicit") {
+            cp->integrator = IMPLICIT_EULER;
+          } else if (integrator == "xpbd") {
+            cp->integrator = POSITION_BASED;
+          } else if (integrator == "projective") {
+            cp->integrator = PROJECTIVE_DYNAMICS;
+          } else {
+            cout << "Invalid cloth integrator " << integrator
+                 << ", expected \"verlet\", \"implicit\", \"xpbd\" or \"projective\"" << endl;
+            exit(-1);
+          }
+        }
+
+        auto it_cg_max_iterations = object.find("cg_max_iterations");
+        if (it_cg_max_iterations != object.end()) {
+          cp->cg_max_iterations = *it_cg_max_iterations;
+        }
+
+        auto it_cg_tolerance = object.find("cg_tolerance");
+        if (it_cg_tolerance != object.end()) {
+          cp->cg_tolerance = *it_cg_tolerance;
+        }
+
+        auto it_pd_iterations = object.find("pd_iterations");
+        if (it_pd_iterations != object.end()) {
+          cp->pd_iterations = *it_pd_iterations;
+        }
+
+        auto it_adaptive_substeps = object.find("adaptive_substeps");
+        if (it_adaptive_substeps != object.end()) {
+          cp->adaptive_substeps = *it_adaptive_substeps;
+        }
+
+        auto it_min_substeps = object.find("min_substeps");
+        if (it_min_substeps != object.end()) {
+          cp->min_substeps = *it_min_substeps;
+        }
+
+        auto it_max_substeps = object.find("max_substeps");
+        if (it_max_substeps != object.end()) {
+          cp->max_substeps = *it_max_substeps;
+        }
+
+        auto it_cfl = object.find("cfl");
+        if (it_cfl != object.end()) {
+          cp->cfl = *it_cfl;
+        }
+
+        auto it_max_strain_step = object.find("max_strain_step");
+        if (it_max_strain_step != object.end()) {
+          cp->max_strain_step = *it_max_strain_step;
+        }
+
+        auto it_continuous_collision = object.find("continuous_collision");
+        if (it_continuous_collision != object.end()) {
+          cp->continuous_collision = *it_continuous_collision;
+        }
+
+        auto it_ccd_iterations = object.find("ccd_iterations");
+        if (it_ccd_iterations != object.end()) {
+          cp->ccd_iterations = *it_ccd_iterations;
+        }
+      } else if (key == SPHERE) {
+        Vector3D origin;
+        double radius, friction;
+
+        auto it_origin = object.find("origin");
+        if (it_origin != object.end()) {
+          vector<double> vec_origin = *it_origin;
+          origin = Vector3D(vec_origin[0], vec_origin[1], vec_origin[2]);
+        } else {
+          incompleteObjectError("sphere", "origin");
+        }
+
+        auto it_radius = object.find("radius");
+        if (it_radius != object.end()) {
+          radius = *it_radius;
+        } else {
+          incompleteObjectError("sphere", "radius");
+        }
+
+        auto it_friction = object.find("friction");
+        if (it_friction != object.end()) {
+          friction = *it_friction;
+        } else {
+          incompleteObjectError("sphere", "friction");
+        }
+
+        Sphere *s = new Sphere(origin, radius, friction, sphere_num_lat, sphere_num_lon);
+        objects->push_back(s);
+      } else if (key == CAPSULE || key == CYLINDER) {
+        Vector3D a, b;
+        double radius, friction;
+
+        auto it_a = object.find("a");
+        if (it_a != object.end()) {
+          vector<double> vec_a = *it_a;
+          a = Vector3D(vec_a[0], vec_a[1], vec_a[2]);
+        } else {
+          incompleteObjectError(key.c_str(), "a");
+        }
+
+        auto it_b = object.find("b");
+        if (it_b != object.end()) {
+          vector<double> vec_b = *it_b;
+          b = Vector3D(vec_b[0], vec_b[1], vec_b[2]);
+        } else {
+          incompleteObjectError(key.c_str(), "b");
+        }
+
+        auto it_radius = object.find("radius");
+        if (it_radius != object.end()) {
+          radius = *it_radius;
+        } else {
+          incompleteObjectError(key.c_str(), "radius");
+        }
+
+        auto it_friction = object.find("friction");
+        if (it_friction != object.end()) {
+          friction = *it_friction;
+        } else {
+          incompleteObjectError(key.c_str(), "friction");
+        }
+
+        if (key == CAPSULE) {
+          objects->push_back(new Capsule(a, b, radius, friction, sphere_num_lat, sphere_num_lon));
+        } else {
+          objects->push_back(new Cylinder(a, b, radius, friction, sphere_num_lon));
+        }
+      } else if (key == TRIANGLE_MESH) {
+        string file;
+        Vector3D position;
+        double scale = 1, friction, thickness = 0.002;
+
+        auto it_file = object.find("file");
+        if (it_file != object.end()) {
+          file = *it_file;
+        } else {
+          incompleteObjectError("triangle_mesh", "file");
+        }
+
+        auto it_position = object.find("position");
+        if (it_position != object.end()) {
+          position = parseVector(*it_position);
+        }
+
+        auto it_scale = object.find("scale");
+        if (it_scale != object.end()) {
+          scale = *it_scale;
+        }
+
+        auto it_friction = object.find("friction");
+        if (it_friction != object.end()) {
+          friction = *it_friction;
+        } else {
+          incompleteObjectError("triangle_mesh", "friction");
+        }
+
+        auto it_thickness = object.find("thickness");
+        if (it_thickness != object.end()) {
+          thickness = *it_thickness;
+        }
+
+        // Mesh files are found relative to the scene file, and their
+        // hierarchies are cached next to them
+        size_t slash = filename.find_last_of("/\\");
+        if (slash != string::npos && file.size() > 0 && file[0] != '/') {
+          file = filename.substr(0, slash + 1) + file;
+        }
+
+        TriangleMesh *m = TriangleMesh::load(file, position, scale, friction, thickness);
+        if (!m) {
+          cout << "Unable to load mesh " << file << endl;
+          exit(-1);
+        }
+        msg((m->loaded_from_cache ? "Loaded" : "Built") << " hierarchy of " << file << ", "
+            << m->bvh.triangles.size() << " triangles");
+        objects->push_back(m);
+      } else if (key == MESH) {
+        string file;
+        Vector3D position;
+        double scale = 1, friction;
+        int resolution = 64, band = 3;
+
+        auto it_file = object.find("file");
+        if (it_file != object.end()) {
+          file = *it_file;
+        } else {
+          incompleteObjectError("mesh", "file");
+        }
+
+        auto it_position = object.find("position");
+        if (it_position != object.end()) {
+          vector<double> vec_position = *it_position;
+          position = Vector3D(vec_position[0], vec_position[1], vec_position[2]);
+        }
+
+        auto it_scale = object.find("scale");
+        if (it_scale != object.end()) {
+          scale = *it_scale;
+        }
+
+        auto it_friction = object.find("friction");
+        if (it_friction != object.end()) {
+          friction = *it_friction;
+        } else {
+          incompleteObjectError("mesh", "friction");
+        }
+
+        auto it_resolution = object.find("resolution");
+        if (it_resolution != object.end()) {
+          resolution = *it_resolution;
+        }
+
+        auto it_band = object.find("band");
+        if (it_band != object.end()) {
+          band = *it_band;
+        }
+
+        // Mesh files are found relative to the scene file, and their baked
+        // distance fields are cached next to them
+        size_t slash = filename.find_last_of("/\\");
+        if (slash != string::npos && file.size() > 0 && file[0] != '/') {
+          file = filename.substr(0, slash + 1) + file;
+        }
+
+        vector<Vector3D> vertices;
+        vector<int> triangles;
+        if (!ObjLoader::load_obj(file, vertices, triangles)) {
+          cout << "Unable to load mesh " << file << endl;
+          exit(-1);
+        }
+        for (Vector3D &v : vertices) {
+          v = position + scale * v;
+        }
+
+        MeshSDF *m = new MeshSDF(vertices, triangles, friction, resolution, band, file);
+        msg((m->loaded_from_cache ? "Loaded" : "Baked") << " signed distance field of " << file);
+        objects->push_back(m);
+      } else { // PLANE
+        Vector3D point, normal;
+        double friction;
+
+        auto it_point = object.find("point");
+        if (it_point != object.end()) {
+          vector<double> vec_point = *it_point;
+          point = Vector3D(vec_point[0], vec_point[1], vec_point[2]);
+        } else {
+          incompleteObjectError("plane", "point");
+        }
+
+        auto it_normal = object.find("normal");
+        if (it_normal != object.end()) {
+          vector<double> vec_normal = *it_normal;
+          normal = Vector3D(vec_normal[0], vec_normal[1], vec_normal[2]);
+        } else {
+          incompleteObjectError("plane", "normal");
+        }
+
+        auto it_friction = object.find("friction");
+        if (it_friction != object.end()) {
+          friction = *it_friction;
+        } else {
+          incompleteObjectError("plane", "friction");
+        }
+
+        Plane *p = new Plane(point, normal, friction);
+        objects->push_back(p);
+      }
+
+      // Any collision object may move along a scripted motion
+      auto it_motion = object.find("motion");
+      if (key != CLOTH && it_motion != object.end()) {
+        objects->back() = new KinematicObject(objects->back(), parseMotion(*it_motion));
+      }
+    }
+  }
+
+  i.close();
+  
+  return true;
+}
@@ -0,0 +1,21 @@
+#ifndef CLOTHSIM_SCENE_LOADER_H
+#define CLOTHSIM_SCENE_LOADER_H
+
+#include <string>
+#include <vector>
+
+#include "cloth.h"
+#include "collision/collisionObject.h"
+
+using namespace std;
+
+// Reads a scene JSON file: the cloth and its parameters, and any number of
+// spheres, planes, capsules, cylinders, meshes and triangle meshes, each
+// optionally moving along a "motion". Spheres and capsules are drawn with
+// sphere_num_lat by sphere_num_lon vertices. Returns false if the file
+// cannot be opened; an invalid scene exits with a message.
+bool loadObjectsFromFile(string filename, Cloth *cloth, ClothParameters *cp,
+                         vector<CollisionObject *> *objects, int sphere_num_lat,
+                         int sphere_num_lon);
+
+#endif // CLOTHSIM_SCENE_LOADER_H
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+
+#include "simulationThread.h"
+
+using namespace std;
+
+typedef SimulationThread::Clock Clock;
+
+void SimulationThread::start(Cloth *cloth, ClothParameters *cp,
+                             vector<CollisionObject *> *collision_objects) {
+  stop();
+  this->cloth = cloth;
+  this->cp = cp;
+  this->collision_objects = collision_objects;
+
+  for (Frame &frame : frames) { frame = Frame(); }
+  write_index = 0;
+  read_index = 1;
+  latest.store(2);
+  frames_simulated = 0;
+  stats = Frame();
+  substep_ms = 0;
+  step_requested = false;
+  commands.clear();
+
+  cloth->prepare(cp, settings.frames_per_sec, settings.simulation_steps);
+  // The viewer has a frame to draw from the start
+  publish();
+
+  running = true;
+  worker = thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+  if (!worker.joinable()) { return; }
+  {
+    lock_guard<mutex> lock(command_mutex);
+    running = false;
+  }
+  wakeup.notify_one();
+  worker.join();
+}
+
+void SimulationThread::post(const Command &command) {
+  {
+    lock_guard<mutex> lock(command_mutex);
+    commands.push_back(command);
+  }
+  wakeup.notify_one();
+}
+
+void SimulationThread::toggle_pause() {
+  post([this] { settings.paused = !settings.paused; });
+}
+
+void SimulationThread::step() {
+  post([this] { step_requested = settings.paused; });
+}
+
+void SimulationThread::reset() {
+  post([this] {
+    cloth->reset();
+    // Nothing to blend with until the next frame
+    stats.period = 0;
+  });
+}
+
+const SimulationThread::Frame &SimulationThread::latest_frame() {
+  // Only the simulation thread sets NEW_FRAME, so it is still set at the
+  // exchange, which may hand over an even newer frame than the one seen
+  if (latest.load(memory_order_acquire) & NEW_FRAME) {
+    read_index = latest.exchange(read_index, memory_order_acq_rel) & INDEX_MASK;
+  }
+  return frames[read_index];
+}
+
+void SimulationThread::run() {
+  Clock::time_point next_frame = Clock::now();
+  clock = next_frame;
+  vector<Command> pending;
+
+  while (true) {
+    {
+      // Sleep until the next frame is due, or for as long as it takes while
+      // paused, unless commands arrive first
+      unique_lock<mutex> lock(command_mutex);
+      auto woken = [this] { return !running || !commands.empty(); };
+      if (settings.paused && !step_requested) {
+        wakeup.wait(lock, woken);
+      } else {
+        wakeup.wait_until(lock, next_frame, woken);
+      }
+      if (!running) { return; }
+      pending.swap(commands);
+    }
+
+    bool changed = !pending.empty();
+    for (const Command &command : pending) { command(); }
+    pending.clear();
+    // Refactor for edited parameters now rather than inside the next frame
+    if (changed) { cloth->prepare(cp, settings.frames_per_sec, settings.simulation_steps); }
+
+    Clock::time_point now = Clock::now();
+    double period_sec = 1.0 / max(settings.frames_per_sec, 1);
+    Clock::duration period = chrono::duration_cast<Clock::duration>(
+        chrono::duration<double>(period_sec));
+    int simulated = 0;
+
+    if (settings.paused || settings.stepping == FIXED_RATE) {
+      if (settings.paused ? step_requested : now >= next_frame) {
+        simulate_frame(false);
+        simulated = 1;
+        stats.period = 0;
+        next_frame = max(next_frame + period, now);
+      }
+      step_requested = false;
+      // Clock-driven stepping resumes from here, without a backlog
+      clock = now;
+      if (settings.paused) { next_frame = now; }
+    } else {
+      // Consume the real time elapsed in whole frames
+      int limit = max(settings.max_catch_up, 1);
+      while (now - clock >= period && simulated < limit) {
+        simulate_frame(true);
+        clock += period;
+        simulated++;
+      }
+      if (now - clock >= period) {
+        stats.dropped_ms += chrono::duration<double, milli>(now - clock).count();
+        clock = now;
+      }
+      if (simulated > 0) {
+        stats.due = clock;
+        stats.period = period_sec;
+      }
+      next_frame = clock + period;
+    }
+
+    if (simulated > 0 || changed) { publish(); }
+  }
+}
+
+void SimulationThread::simulate_frame(bool keep_previous) {
+  const ParticleStore &particles = cloth->particles;
+  if (keep_previous) {
+    previous_positions.resize(particles.size());
+    for (size_t i = 0; i < particles.size(); i++) {
+      previous_positions[i] = particles.get_position(i);
+    }
+    previous_time = cloth->time;
+  }
+
+  Clock::time_point begin = Clock::now();
+
+  vector<Vector3D> external_accelerations = {settings.gravity};
+
+  // Shed the substeps that would not fit in the deadline at the recent cost
+  // of a substep, down to min_substeps, below which the cloth may not stay
+  // stable (and would get slower, not faster). The frame still covers the
+  // same simulated time, in longer substeps, and the substep controller
+  // rescales the Verlet velocities to them.
+  double deadline_ms = settings.deadline_ms > 0 ? settings.deadline_ms
+                                                : 1000.0 / max(settings.frames_per_sec, 1);
+  int affordable = INT_MAX;
+  if (settings.stepping == DEADLINE && substep_ms > 0) {
+    affordable = max(max(cp->min_substeps, 1), (int)min(deadline_ms / substep_ms, 1e6));
+  }
+  int steps = cloth->substep_controller.choose(cloth, cp, settings.frames_per_sec,
+                                               settings.simulation_steps, affordable);
+  stats.shed_substeps = cloth->substep_controller.capped;
+
+  for (int i = 0; i < steps; i++) {
+    cloth->simulate(settings.frames_per_sec, steps, cp, external_accelerations,
+                    collision_objects);
+  }
+
+  double step_ms = chrono::duration<double, milli>(Clock::now() - begin).count();
+  if (steps > 0) {
+    // Averaged over the last few frames, so that one slow frame does not
+    // shed most of the next
+    double cost = step_ms / steps;
+    substep_ms = substep_ms > 0 ? 0.5 * (substep_ms + cost) : cost;
+  }
+
+  frames_simulated++;
+  stats.substeps = steps;
+  stats.step_ms = step_ms;
+  stats.deficit_ms = settings.stepping == DEADLINE ? max(0.0, step_ms - deadline_ms) : 0;
+}
+
+void SimulationThread::publish() {
+  Frame &frame = frames[write_index];
+  const ParticleStore &particles = cloth->particles;
+  frame.positions.resize(particles.size());
+  for (size_t i = 0; i < particles.size(); i++) {
+    frame.positions[i] = particles.get_position(i);
+  }
+  frame.cp = *cp;
+  frame.time = cloth->time;
+  frame.number = frames_simulated;
+  frame.substeps = stats.substeps;
+  frame.step_ms = stats.step_ms;
+  frame.shed_substeps = stats.shed_substeps;
+  frame.deficit_ms = stats.deficit_ms;
+  frame.dropped_ms = stats.dropped_ms;
+
+  frame.period = stats.period;
+  frame.due = stats.due;
+  if (frame.period > 0) {
+    frame.previous_positions = previous_positions;
+    frame.previous_time = previous_time;
+  }
+
+  // Trade the written buffer for the one published before, or, if the
+  // viewer took that one in the meantime, for the one it gave up
+  write_index = latest.exchange(write_index | NEW_FRAME, memory_order_acq_rel) & INDEX_MASK;
+}
+
+double SimulationThread::Frame::blend(Clock::time_point now) const {
+  if (period <= 0) { return 1; }
+  double alpha = chrono::duration<double>(now - due).count() / period;
+  return min(max(alpha, 0.0), 1.0);
+}
+
+void SimulationThread::Frame::interpolate(double alpha, vector<Vector3D> &blended,
+                                          int num_threads) const {
+  long n = positions.size();
+  blended.resize(n);
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long i = 0; i < n; i++) {
+    blended[i] = previous_positions[i] + alpha * (positions[i] - previous_positions[i]);
+  }
+}
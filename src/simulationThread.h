@@ -0,0 +1,182 @@
+#ifndef SIMULATION_THREAD_H
+#define SIMULATION_THREAD_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CGL/vector3D.h"
+#include "cloth.h"
+#include "collision/collisionObject.h"
+
+using namespace CGL;
+using namespace std;
+
+// How simulated time follows real time.
+//
+// FIXED_RATE starts a frame every 1 / frames_per_sec seconds, or as soon as
+// the previous one is done if it ran long, so simulated time slows down
+// whenever a frame costs more than that.
+//
+// REAL_TIME keeps simulated time on the wall clock: the real time elapsed
+// is accumulated and consumed in frames of 1 / frames_per_sec simulated
+// seconds, so several frames run back to back after a slow one. At most
+// max_catch_up frames are run at a time; a backlog beyond that is dropped
+// (and reported) rather than left to grow as each round of catching up
+// takes longer than the last. The viewer draws the cloth one frame late,
+// blended between the last two frames for the real time it is drawn at.
+//
+// DEADLINE is REAL_TIME that also keeps each frame within deadline_ms (the
+// frame period by default) by taking fewer substeps than asked for, at the
+// rate the last frames cost per substep, and reports by how much frames
+// still miss it. Projective dynamics never sheds substeps, as its
+// factorization is only valid for the substep count it was built for.
+enum e_stepping { FIXED_RATE = 0, REAL_TIME = 1, DEADLINE = 2 };
+
+// Steps the cloth on its own thread at a fixed rate, so that the viewer
+// keeps drawing and handling input at its own rate however long a frame of
+// simulation takes.
+//
+// While it runs, the thread owns the cloth, its parameters, the collision
+// objects and the settings below. The viewer changes them only through
+// commands, which the simulation thread runs between two frames, and draws
+// the frames the simulation thread publishes. Frames go through three
+// buffers: the one being written, the one being drawn, and the latest
+// complete frame, which either side trades its own buffer for with a single
+// atomic exchange. Neither side ever waits for the other: the viewer draws
+// the same frame again until a newer one is complete, and skips the frames
+// it did not get to.
+class SimulationThread {
+public:
+  typedef chrono::steady_clock Clock;
+
+  // State of the simulation at the end of a frame
+  struct Frame {
+    // Point mass positions
+    vector<Vector3D> positions;
+    // Parameters the frame was simulated with
+    ClothParameters cp;
+    // Simulated time, which poses the moving colliders
+    double time = 0;
+    // Frames simulated since the thread started
+    long number = 0;
+    // Substeps the frame took, and the wall time they took in milliseconds
+    int substeps = 0;
+    double step_ms = 0;
+
+    // Clock-driven modes only: the positions and time one frame earlier,
+    // the wall time the frame stands for, and the frame period in seconds,
+    // which is 0 when the frame is to be drawn as is
+    vector<Vector3D> previous_positions;
+    double previous_time = 0;
+    Clock::time_point due;
+    double period = 0;
+
+    // DEADLINE: substeps left out of the frame, and by how many
+    // milliseconds it missed the deadline anyway
+    int shed_substeps = 0;
+    double deficit_ms = 0;
+    // Real time dropped by the catch-up limit since the start, in
+    // milliseconds
+    double dropped_ms = 0;
+
+    // Weight of this frame against the previous one for drawing at the
+    // given time, in [0, 1]
+    double blend(Clock::time_point now) const;
+    // Writes the positions blended with the given weight into blended
+    void interpolate(double alpha, vector<Vector3D> &blended, int num_threads) const;
+  };
+
+  struct Settings {
+    int frames_per_sec = 90;
+    // Substeps per frame, unless the cloth parameters ask for adaptive
+    // substepping
+    int simulation_steps = 30;
+    Vector3D gravity = Vector3D(0, -9.8, 0);
+    bool paused = true;
+
+    e_stepping stepping = FIXED_RATE;
+    int max_catch_up = 4;
+    // 0 uses the frame period
+    double deadline_ms = 0;
+  };
+
+  typedef function<void()> Command;
+
+  SimulationThread() {}
+  ~SimulationThread() { stop(); }
+
+  // Publishes the current state of the cloth and starts simulating it, as
+  // settings.stepping says, while not paused
+  void start(Cloth *cloth, ClothParameters *cp, vector<CollisionObject *> *collision_objects);
+
+  // Stops the thread after the frame in progress; commands not yet run are
+  // dropped
+  void stop();
+
+  // Queues command to run on the simulation thread before its next frame.
+  // Commands run in the order they were posted, and the state they leave is
+  // published even while paused.
+  void post(const Command &command);
+
+  void toggle_pause();
+  // Simulates a single frame if paused
+  void step();
+  void reset();
+
+  // The latest complete frame. It stays valid, and unchanged, until the
+  // next call; only one thread may call this.
+  const Frame &latest_frame();
+
+  // Only to be changed before start or from commands
+  Settings settings;
+
+private:
+  SimulationThread(const SimulationThread &) = delete;
+  SimulationThread &operator=(const SimulationThread &) = delete;
+
+  void run();
+  void simulate_frame(bool keep_previous);
+  void publish();
+
+  Cloth *cloth = nullptr;
+  ClothParameters *cp = nullptr;
+  vector<CollisionObject *> *collision_objects = nullptr;
+
+  thread worker;
+
+  // Commands posted since the thread last looked, and whether it should
+  // keep running; both guarded by command_mutex
+  mutex command_mutex;
+  condition_variable wakeup;
+  vector<Command> commands;
+  bool running = false;
+
+  // Simulation thread only
+  bool step_requested = false;
+  long frames_simulated = 0;
+  // Everything about the last frame simulated but the state itself, which
+  // publish() copies from the cloth
+  Frame stats;
+  // State before the last frame, for blending
+  vector<Vector3D> previous_positions;
+  double previous_time = 0;
+  // Wall time simulated up to, in the clock-driven modes
+  Clock::time_point clock;
+  // Recent cost of a substep in milliseconds, for DEADLINE
+  double substep_ms = 0;
+
+  // The three frame buffers. latest holds the index of the latest complete
+  // frame, with NEW_FRAME set until the viewer takes it.
+  enum { INDEX_MASK = 3, NEW_FRAME = 4 };
+  Frame frames[3];
+  atomic<int> latest{2};
+  int write_index = 0;
+  int read_index = 1;
+};
+
+#endif // SIMULATION_THREAD_H
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cmath>
+
+#include "implicitEuler.h"
+#include "../cloth.h"
+
+// Component-wise product, i.e. a diagonal matrix times a vector
+static inline Vector3D scale(const Vector3D &a, const Vector3D &b) {
+  return Vector3D(a.x * b.x, a.y * b.y, a.z * b.z);
+}
+
+void ImplicitEuler::build_jacobians(Cloth *cloth, ClothParameters *cp,
+                                    int num_threads) {
+  const ParticleStore &particles = cloth->particles;
+  const SpringBuffer &springs = cloth->springs;
+  long num_points = particles.size();
+
+  #pragma omp parallel num_threads(num_threads)
+  {
+    // Diagonal of the system matrix, inverted below
+    #pragma omp for schedule(static)
+    for (long i = 0; i < num_points; i++) {
+      inv_diagonal[i] = Vector3D(mass, mass, mass);
+    }
+
+    for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+      e_spring_type type = (e_spring_type)t;
+      if (!cp->is_enabled(type)) { continue; }
+      double ks = (type == BENDING) ? cp->ks * 0.2 : cp->ks;
+      for (int c = 0; c < springs.num_colors(type); c++) {
+        long begin = springs.color_begin(type, c);
+        long end = springs.color_end(type, c);
+        // A color shares no particle, so the diagonal can be scattered too
+        #pragma omp for schedule(static)
+        for (long k = begin; k < end; k++) {
+          const Spring &s = springs[k];
+          Vector3D u = particles.get_position(s.a) - particles.get_position(s.b);
+          double length = u.norm();
+          SpringJacobian &J = jacobians[k];
+          J.d = length > 0 ? u / length : Vector3D();
+          double stretch = length > 0 ? max(0.0, 1.0 - s.rest_length / length) : 0.0;
+          J.alpha = ks * stretch;
+          J.beta = ks * (1.0 - stretch);
+
+          Vector3D diagonal = h2 * (Vector3D(J.alpha, J.alpha, J.alpha) + J.beta * scale(J.d, J.d));
+          inv_diagonal[s.a] += diagonal;
+          inv_diagonal[s.b] += diagonal;
+        }
+      }
+    }
+
+    #pragma omp for schedule(static)
+    for (long i = 0; i < num_points; i++) {
+      Vector3D &d = inv_diagonal[i];
+      d = particles.is_pinned(i) ? Vector3D(1, 1, 1) : Vector3D(1.0 / d.x, 1.0 / d.y, 1.0 / d.z);
+    }
+  }
+}
+
+void ImplicitEuler::multiply(Cloth *cloth, ClothParameters *cp,
+                             const vector<Vector3D> &in, vector<Vector3D> &out,
+                             int num_threads) {
+  const ParticleStore &particles = cloth->particles;
+  const SpringBuffer &springs = cloth->springs;
+  long num_points = particles.size();
+
+  #pragma omp parallel num_threads(num_threads)
+  {
+    #pragma omp for schedule(static)
+    for (long i = 0; i < num_points; i++) {
+      out[i] = particles.is_pinned(i) ? in[i] : mass * in[i];
+    }
+
+    // Pinned entries of in are always zero, so only the pinned rows need
+    // to be skipped to keep them at the identity
+    for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+      e_spring_type type = (e_spring_type)t;
+      if (!cp->is_enabled(type)) { continue; }
+      for (int c = 0; c < springs.num_colors(type); c++) {
+        long begin = springs.color_begin(type, c);
+        long end = springs.color_end(type, c);
+        #pragma omp for schedule(static)
+        for (long k = begin; k < end; k++) {
+          const Spring &s = springs[k];
+          const SpringJacobian &J = jacobians[k];
+          Vector3D u = in[s.a] - in[s.b];
+          Vector3D Ku = h2 * (J.alpha * u + J.beta * CGL::dot(J.d, u) * J.d);
+          if (!particles.is_pinned(s.a)) { out[s.a] += Ku; }
+          if (!particles.is_pinned(s.b)) { out[s.b] -= Ku; }
+        }
+      }
+    }
+  }
+}
+
+double ImplicitEuler::inner(const vector<Vector3D> &a, const vector<Vector3D> &b,
+                            int num_threads) {
+  long n = a.size();
+  long num_blocks = (n + Kernels::BLOCK_SIZE - 1) / Kernels::BLOCK_SIZE;
+  partial_sums.resize(num_blocks);
+
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long block = 0; block < num_blocks; block++) {
+    long end = min(n, (block + 1) * Kernels::BLOCK_SIZE);
+    double sum = 0;
+    for (long i = block * Kernels::BLOCK_SIZE; i < end; i++) {
+      sum += CGL::dot(a[i], b[i]);
+    }
+    partial_sums[block] = sum;
+  }
+
+  double sum = 0;
+  for (double s : partial_sums) { sum += s; }
+  return sum;
+}
+
+void ImplicitEuler::step(Cloth *cloth, ClothParameters *cp, double delta_t,
+                         int num_threads) {
+  ParticleStore &particles = cloth->particles;
+  long num_points = particles.size();
+  double h = delta_t;
+  double damping = 1.0 - (cp->damping / 100.0);
+  mass = particles.mass;
+  h2 = h * h;
+
+  jacobians.resize(cloth->springs.size());
+  inv_diagonal.resize(num_points);
+  v.resize(num_points);
+  b.resize(num_points);
+  r.resize(num_points);
+  z.resize(num_points);
+  p.resize(num_points);
+  q.resize(num_points);
+
+  build_jacobians(cloth, cp, num_threads);
+
+  // The damped Verlet velocity is both the initial guess and the momentum
+  // term of the right-hand side; pinned particles stay at zero velocity
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long i = 0; i < num_points; i++) {
+    if (particles.is_pinned(i)) {
+      v[i] = b[i] = Vector3D();
+      continue;
+    }
+    v[i] = damping * (particles.get_position(i) - particles.get_last_position(i)) / h;
+    b[i] = mass * v[i] + h * particles.get_forces(i);
+  }
+
+  // Jacobi-preconditioned conjugate gradient
+  multiply(cloth, cp, v, q, num_threads);
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long i = 0; i < num_points; i++) {
+    r[i] = b[i] - q[i];
+    z[i] = scale(inv_diagonal[i], r[i]);
+    p[i] = z[i];
+  }
+  double rz = inner(r, z, num_threads);
+  double b_norm = sqrt(inner(b, b, num_threads));
+  double r_norm = sqrt(inner(r, r, num_threads));
+  double tolerance = cp->cg_tolerance * b_norm;
+
+  iterations = 0;
+  while (iterations < cp->cg_max_iterations && r_norm > tolerance) {
+    multiply(cloth, cp, p, q, num_threads);
+    double alpha = rz / inner(p, q, num_threads);
+
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (long i = 0; i < num_points; i++) {
+      v[i] += alpha * p[i];
+      r[i] -= alpha * q[i];
+      z[i] = scale(inv_diagonal[i], r[i]);
+    }
+    double rz_next = inner(r, z, num_threads);
+    r_norm = sqrt(inner(r, r, num_threads));
+    iterations++;
+
+    double beta = rz_next / rz;
+    rz = rz_next;
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (long i = 0; i < num_points; i++) {
+      p[i] = z[i] + beta * p[i];
+    }
+  }
+  residual = b_norm > 0 ? r_norm / b_norm : 0;
+
+  // x' = x + h v', keeping the Verlet state (x, x - h v') consistent so that
+  // the integrators can be switched between steps
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long i = 0; i < num_points; i++) {
+    if (particles.is_pinned(i)) { continue; }
+    Vector3D x = particles.get_position(i);
+    particles.set_position(i, x + h * v[i]);
+    particles.set_last_position(i, x);
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef IMPLICIT_EULER_H
+#define IMPLICIT_EULER_H
+
+#include <vector>
+
+#include "CGL/CGL.h"
+#include "CGL/vector3D.h"
+
+using namespace CGL;
+using namespace std;
+
+struct Cloth;
+struct ClothParameters;
+
+// Linearized backward Euler step for the mass-spring system [Baraff and
+// Witkin 1998]. Each step solves
+//
+//   (M - h^2 K) v' = M v + h f
+//
+// for the new velocities with a Jacobi-preconditioned conjugate gradient,
+// where K is the spring force Jacobian at the current positions. The matrix
+// is never assembled: every spring keeps its 3x3 Jacobian block and products
+// with the system matrix are scattered over the spring colors, like the
+// force pass.
+struct ImplicitEuler {
+  // Advances the cloth by delta_t. Forces must already be accumulated.
+  void step(Cloth *cloth, ClothParameters *cp, double delta_t,
+            int num_threads);
+
+  // Conjugate gradient iterations and relative residual of the last step
+  int iterations = 0;
+  double residual = 0;
+
+private:
+  // Spring Jacobian in compact form, K v = alpha v + beta d (d . v), with the
+  // spring direction d. The (1 - rest / length) term is clamped at zero so
+  // compressed springs cannot make the system indefinite [Choi and Ko 2002].
+  struct SpringJacobian {
+    Vector3D d;
+    double alpha, beta;
+  };
+
+  void build_jacobians(Cloth *cloth, ClothParameters *cp, int num_threads);
+
+  // out = (M - h^2 K) in, identity on pinned particles
+  void multiply(Cloth *cloth, ClothParameters *cp, const vector<Vector3D> &in,
+                vector<Vector3D> &out, int num_threads);
+
+  // Blocked sum of a[i] . b[i]; blocks are added in order, so the result does
+  // not depend on the thread count
+  double inner(const vector<Vector3D> &a, const vector<Vector3D> &b,
+               int num_threads);
+
+  double mass, h2;
+  vector<SpringJacobian> jacobians;
+  vector<Vector3D> inv_diagonal;
+  vector<double> partial_sums;
+
+  // Solver vectors: velocities (the unknowns), right-hand side, residual,
+  // preconditioned residual, search direction and its product
+  vector<Vector3D> v, b, r, z, p, q;
+};
+
+#endif /* IMPLICIT_EULER_H */
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "projectiveDynamics.h"
+#include "../cloth.h"
+
+void ProjectiveDynamics::factor(Cloth *cloth, ClothParameters *cp,
+                                double delta_t) {
+  const ParticleStore &particles = cloth->particles;
+  double h2 = delta_t * delta_t;
+  const SpringBuffer &springs = cloth->springs;
+  double mass = particles.mass;
+
+  int enabled_types = 0;
+  for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+    if (cp->is_enabled((e_spring_type)t)) { enabled_types |= 1 << t; }
+  }
+
+  bool same_pattern = analyzed && enabled_types == this->enabled_types &&
+                      row.size() == particles.size();
+  if (same_pattern && factored && cp->ks == ks && mass == this->mass &&
+      h2 == this->h2) {
+    return;
+  }
+
+  if (!same_pattern) {
+    row.assign(particles.size(), -1);
+    free_points.clear();
+    for (int i = 0; i < (int)particles.size(); i++) {
+      if (particles.is_pinned(i)) { continue; }
+      row[i] = (int)free_points.size();
+      free_points.push_back(i);
+    }
+  }
+
+  // M / h^2 + sum over springs of k (e_a - e_b)(e_a - e_b)^T, restricted to
+  // the free particles; pinned endpoints move to the right-hand side
+  vector<Eigen::Triplet<double>> triplets;
+  triplets.reserve(free_points.size() + 4 * springs.size());
+  for (size_t r = 0; r < free_points.size(); r++) {
+    triplets.emplace_back(r, r, mass / h2);
+  }
+  for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+    e_spring_type type = (e_spring_type)t;
+    if (!cp->is_enabled(type)) { continue; }
+    double k = (type == BENDING) ? cp->ks * 0.2 : cp->ks;
+    for (size_t s = springs.begin(type); s < springs.end(type); s++) {
+      int ra = row[springs[s].a], rb = row[springs[s].b];
+      if (ra >= 0) { triplets.emplace_back(ra, ra, k); }
+      if (rb >= 0) { triplets.emplace_back(rb, rb, k); }
+      if (ra >= 0 && rb >= 0) {
+        triplets.emplace_back(ra, rb, -k);
+        triplets.emplace_back(rb, ra, -k);
+      }
+    }
+  }
+  SparseMatrix A(free_points.size(), free_points.size());
+  A.setFromTriplets(triplets.begin(), triplets.end());
+
+  // The symbolic analysis (fill-reducing ordering) only depends on the pattern
+  if (!same_pattern) { llt.analyzePattern(A); }
+  llt.factorize(A);
+  if (llt.info() != Eigen::Success) {
+    throw runtime_error("Projective dynamics system is not positive definite");
+  }
+
+  analyzed = factored = true;
+  this->enabled_types = enabled_types;
+  this->ks = cp->ks;
+  this->mass = mass;
+  this->h2 = h2;
+  factorizations++;
+}
+
+void ProjectiveDynamics::solve_global() {
+  // P A P^T = L L^T, so A x = b is solved as L L^T (P x) = P b. The x, y and
+  // z columns share the factor, so both substitutions handle all three at
+  // once and stream L from memory only once each, instead of once per
+  // coordinate as three separate Eigen solves would.
+  const SparseMatrix &L = llt.matrixL().nestedExpression();
+  const int *perm = llt.permutationP().indices().data();
+  const int *outer = L.outerIndexPtr();
+  const int *inner = L.innerIndexPtr();
+  const double *value = L.valuePtr();
+  long n = rhs.size();
+
+  for (long i = 0; i < n; i++) { permuted[perm[i]] = rhs[i]; }
+
+  // Forward substitution with L; the diagonal is the first entry of each
+  // column
+  for (long j = 0; j < n; j++) {
+    Vector3D zj = permuted[j] / value[outer[j]];
+    permuted[j] = zj;
+    for (int k = outer[j] + 1; k < outer[j + 1]; k++) {
+      permuted[inner[k]] -= value[k] * zj;
+    }
+  }
+
+  // Back substitution with L^T, whose rows are the columns of L
+  for (long j = n - 1; j >= 0; j--) {
+    Vector3D sum = permuted[j];
+    for (int k = outer[j] + 1; k < outer[j + 1]; k++) {
+      sum -= value[k] * permuted[inner[k]];
+    }
+    permuted[j] = sum / value[outer[j]];
+  }
+
+  for (long i = 0; i < n; i++) { rhs[i] = permuted[perm[i]]; }
+}
+
+void ProjectiveDynamics::solve(Cloth *cloth, ClothParameters *cp,
+                               double delta_t, int num_threads) {
+  ParticleStore &particles = cloth->particles;
+  const SpringBuffer &springs = cloth->springs;
+  double h2 = delta_t * delta_t;
+
+  factor(cloth, cp, delta_t);
+
+  long num_points = particles.size();
+  long num_rows = free_points.size();
+  double inertia = mass / h2;
+  x.resize(num_points);
+  y.resize(num_points);
+  rhs.resize(num_rows);
+  permuted.resize(num_rows);
+
+  // The Verlet prediction is both the inertial target and the initial guess
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long i = 0; i < num_points; i++) {
+    x[i] = y[i] = particles.get_position(i);
+  }
+
+  for (int iter = 0; iter < cp->pd_iterations; iter++) {
+    #pragma omp parallel num_threads(num_threads)
+    {
+      #pragma omp for schedule(static)
+      for (long r = 0; r < num_rows; r++) {
+        rhs[r] = inertia * y[free_points[r]];
+      }
+
+      // Local step: each spring is projected onto its rest length, d =
+      // rest * (x_a - x_b) / |x_a - x_b|, and k d (plus the position of a
+      // pinned endpoint) is scattered into the right-hand side. Springs of
+      // one color share no particle, so no two threads write the same row.
+      for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+        e_spring_type type = (e_spring_type)t;
+        if (!cp->is_enabled(type)) { continue; }
+        double k = (type == BENDING) ? cp->ks * 0.2 : cp->ks;
+        for (int c = 0; c < springs.num_colors(type); c++) {
+          long begin = springs.color_begin(type, c);
+          long end = springs.color_end(type, c);
+          #pragma omp for schedule(static)
+          for (long s = begin; s < end; s++) {
+            int a = springs[s].a, b = springs[s].b;
+            Vector3D u = x[a] - x[b];
+            double length = u.norm();
+            Vector3D d = length > 0 ? springs[s].rest_length / length * u : Vector3D();
+            int ra = row[a], rb = row[b];
+            if (ra >= 0) { rhs[ra] += k * (rb >= 0 ? d : d + x[b]); }
+            if (rb >= 0) { rhs[rb] += k * (ra >= 0 ? -d : x[a] - d); }
+          }
+        }
+      }
+    }
+
+    solve_global();
+
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (long r = 0; r < num_rows; r++) {
+      x[free_points[r]] = rhs[r];
+    }
+  }
+
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long r = 0; r < num_rows; r++) {
+    particles.set_position(free_points[r], x[free_points[r]]);
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef PROJECTIVE_DYNAMICS_H
+#define PROJECTIVE_DYNAMICS_H
+
+#include <vector>
+
+#include <Eigen/Sparse>
+
+#include "CGL/CGL.h"
+#include "CGL/vector3D.h"
+
+using namespace CGL;
+using namespace std;
+
+struct Cloth;
+struct ClothParameters;
+
+// Projective dynamics for the mass-spring system [Liu et al. 2013, Bouaziz et
+// al. 2014]. Positions are predicted by the Verlet step from external forces
+// only; each iteration then projects every spring onto its rest length (local
+// step, in parallel) and solves
+//
+//   (M / h^2 + L) x = M / h^2 y + J d
+//
+// for the free particles (global step). The system matrix only depends on the
+// topology, ks, the mass, the timestep and the pin set, and is the same for
+// the x, y and z coordinates, so one sparse Cholesky factorization is reused
+// across steps and refactored only when one of those changes.
+//
+// Cloth::buildGrid factors the system up front, and the simulation thread
+// refactors it between frames after the parameters are edited. To keep the
+// timestep fixed, the substep controller never changes the substep count
+// under projective dynamics (no adaptive substeps, no deadline shedding).
+struct ProjectiveDynamics {
+  // Moves the predicted positions of the cloth towards the implicit solution.
+  // Factors the system first if it was not factored for these parameters.
+  void solve(Cloth *cloth, ClothParameters *cp, double delta_t,
+             int num_threads);
+
+  // Builds the system matrix and (re)factors it for substeps of delta_t if
+  // anything it depends on changed since the last factorization
+  void factor(Cloth *cloth, ClothParameters *cp, double delta_t);
+
+  // Drops the factorization, e.g. after the grid or the pin set was rebuilt
+  void invalidate() { analyzed = factored = false; }
+
+  // Number of numeric factorizations so far
+  int factorizations = 0;
+
+private:
+  typedef Eigen::SparseMatrix<double> SparseMatrix;
+
+  // Solves the global system in place for the three coordinates of rhs
+  void solve_global();
+
+  // Parameters of the current factorization. The enabled spring types and
+  // the pin set fix the sparsity pattern; ks, mass and the timestep only
+  // change the values.
+  bool analyzed = false, factored = false;
+  int enabled_types = 0;
+  double ks = 0, mass = 0, h2 = 0;
+
+  // System row of each particle (-1 if pinned), and particle of each row
+  vector<int> row;
+  vector<int> free_points;
+
+  Eigen::SimplicialLLT<SparseMatrix> llt;
+  vector<Vector3D> x, y;
+  vector<Vector3D> rhs, permuted;
+};
+
+#endif /* PROJECTIVE_DYNAMICS_H */
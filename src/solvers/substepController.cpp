@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cmath>
+
+#include "substepController.h"
+#include "../cloth.h"
+#include "../misc/thread_utils.h"
+
+void SubstepController::measure(Cloth *cloth, ClothParameters *cp,
+                                double delta_t, int num_threads) {
+  const ParticleStore &particles = cloth->particles;
+  const SpringBuffer &springs = cloth->springs;
+  long num_points = particles.size();
+  long num_point_blocks = (num_points + Kernels::BLOCK_SIZE - 1) / Kernels::BLOCK_SIZE;
+  partial_velocity.assign(num_point_blocks, 0);
+
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long block = 0; block < num_point_blocks; block++) {
+    long end = min(num_points, (block + 1) * Kernels::BLOCK_SIZE);
+    double max_step = 0;
+    for (long i = block * Kernels::BLOCK_SIZE; i < end; i++) {
+      Vector3D step = particles.get_position(i) - particles.get_last_position(i);
+      max_step = max(max_step, step.norm());
+    }
+    partial_velocity[block] = max_step / delta_t;
+  }
+
+  // Strain rate of a spring, |l - l_last| / (rest h), over the enabled types
+  max_strain_rate = 0;
+  for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+    e_spring_type type = (e_spring_type)t;
+    if (!cp->is_enabled(type)) { continue; }
+    long begin = springs.begin(type);
+    long count = springs.count(type);
+    long num_blocks = (count + Kernels::BLOCK_SIZE - 1) / Kernels::BLOCK_SIZE;
+    partial_strain_rate.assign(num_blocks, 0);
+
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (long block = 0; block < num_blocks; block++) {
+      long end = begin + min(count, (block + 1) * Kernels::BLOCK_SIZE);
+      double max_rate = 0;
+      for (long k = begin + block * Kernels::BLOCK_SIZE; k < end; k++) {
+        const Spring &s = springs[k];
+        double length = (particles.get_position(s.a) - particles.get_position(s.b)).norm();
+        double last_length = (particles.get_last_position(s.a) -
+                              particles.get_last_position(s.b)).norm();
+        max_rate = max(max_rate, fabs(length - last_length) / s.rest_length);
+      }
+      partial_strain_rate[block] = max_rate / delta_t;
+    }
+
+    for (double rate : partial_strain_rate) { max_strain_rate = max(max_strain_rate, rate); }
+  }
+
+  max_velocity = 0;
+  for (double v : partial_velocity) { max_velocity = max(max_velocity, v); }
+}
+
+void SubstepController::rescale_velocities(Cloth *cloth, double ratio,
+                                           int num_threads) {
+  ParticleStore &particles = cloth->particles;
+  long num_points = particles.size();
+
+  #pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (long i = 0; i < num_points; i++) {
+    if (particles.is_pinned(i)) { continue; }
+    Vector3D x = particles.get_position(i);
+    particles.set_last_position(i, x - ratio * (x - particles.get_last_position(i)));
+  }
+}
+
+int SubstepController::choose(Cloth *cloth, ClothParameters *cp,
+                              double frames_per_sec, int simulation_steps,
+                              int max_steps) {
+  int num_threads = ThreadUtils::resolve_num_threads(cp->num_threads);
+  int last = substeps > 0 ? substeps : max(simulation_steps, 1);
+  int next = simulation_steps;
+
+  // Projective dynamics keeps the count it was factored for
+  if (cp->adaptive_substeps && cp->integrator != PROJECTIVE_DYNAMICS) {
+    double frame_dt = 1.0 / frames_per_sec;
+    measure(cloth, cp, frame_dt / last, num_threads);
+
+    double spacing = min(cloth->width / (cloth->num_width_points - 1),
+                         cloth->height / (cloth->num_height_points - 1));
+    double steps = max(frame_dt * max_velocity / (cp->cfl * spacing),
+                       frame_dt * max_strain_rate / cp->max_strain_step);
+
+    if (cp->integrator == EXPLICIT_VERLET) {
+      double stiffness = 0;
+      for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+        e_spring_type type = (e_spring_type)t;
+        if (!cp->is_enabled(type)) { continue; }
+        double ks = (type == BENDING) ? cp->ks * 0.2 : cp->ks;
+        stiffness += ks * cloth->springs.degree(type);
+      }
+      // Cloth::simulate may not have set the point mass yet
+      double omega = sqrt(2 * stiffness / cloth->point_mass(cp));
+      steps = max(steps, frame_dt * omega / (2 * 0.9));
+    }
+
+    next = max((int)ceil(min(steps, 1e6)), max(cp->min_substeps, last / 2));
+    next = max(min(next, cp->max_substeps), 1);
+  }
+
+  // The cap goes through the same rescale as any other change of count
+  capped = 0;
+  if (cp->integrator != PROJECTIVE_DYNAMICS && next > max(max_steps, 1)) {
+    capped = next - max(max_steps, 1);
+    next -= capped;
+  }
+
+  if (next <= 0) { return next; }
+  if (next != last) { rescale_velocities(cloth, (double)last / next, num_threads); }
+  substeps = next;
+  return next;
+}
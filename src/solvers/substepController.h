@@ -0,0 +1,57 @@
+#ifndef SUBSTEP_CONTROLLER_H
+#define SUBSTEP_CONTROLLER_H
+
+#include <climits>
+#include <vector>
+
+using namespace std;
+
+struct Cloth;
+struct ClothParameters;
+
+// Picks the number of substeps of each frame from the motion of the cloth.
+// The substep h is the largest one that keeps
+//
+//   - every particle within cfl grid spacings per substep,
+//   - every spring within max_strain_step of strain change per substep, and
+//   - for explicit Verlet, h below the stability limit 2 / sqrt(lambda_max / m),
+//     with lambda_max bounded by twice the spring stiffness meeting at a
+//     particle (Gershgorin),
+//
+// measured from the Verlet state at the start of the frame. The count is
+// clamped to [min_substeps, max_substeps] and may at most halve from one
+// frame to the next, so a gust raises it at once while a settling cloth
+// only gradually gives substeps back.
+//
+// The Verlet state stores the velocity as x - x_last = h v, so whenever the
+// count changes the last positions are rescaled to the new h.
+struct SubstepController {
+  // Returns the substep count of the next frame: the adaptive one if
+  // cp->adaptive_substeps is set, otherwise simulation_steps, but at most
+  // max_steps (e.g. to meet a deadline). Projective dynamics always takes
+  // simulation_steps, since every other count would need a factorization
+  // of its own.
+  int choose(Cloth *cloth, ClothParameters *cp, double frames_per_sec,
+             int simulation_steps, int max_steps = INT_MAX);
+
+  // Substep count of the last frame (0 before the first one), and how many
+  // substeps max_steps took off it
+  int substeps = 0;
+  int capped = 0;
+
+  // Largest particle speed and spring strain rate measured for it
+  double max_velocity = 0, max_strain_rate = 0;
+
+private:
+  // Measures max_velocity and max_strain_rate for a substep of delta_t
+  void measure(Cloth *cloth, ClothParameters *cp, double delta_t,
+               int num_threads);
+
+  // Rescales the Verlet velocities by ratio
+  void rescale_velocities(Cloth *cloth, double ratio, int num_threads);
+
+  // Per-block maxima, combined serially after each parallel pass
+  vector<double> partial_velocity, partial_strain_rate;
+};
+
+#endif /* SUBSTEP_CONTROLLER_H */
@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <cmath>
+
+#include "xpbd.h"
+#include "../cloth.h"
+
+// Distance constraint C = |pa - pb| - rest with alpha_tilde = compliance / h^2.
+// Starting from zero multipliers, one projection moves the endpoints by
+// w * dlambda along the constraint gradient, dlambda = -C / (wa + wb + alpha_tilde).
+template <typename Real>
+static void project_distance(const Spring *springs, long count,
+                             double alpha_tilde, const double *inv_mass,
+                             Real *position) {
+  Real alpha = (Real)alpha_tilde;
+  for (long k = 0; k < count; k++) {
+    uint32_t a = springs[k].a, b = springs[k].b;
+    Real *pa = position + 3 * a;
+    Real *pb = position + 3 * b;
+    Real dx = pa[0] - pb[0];
+    Real dy = pa[1] - pb[1];
+    Real dz = pa[2] - pb[2];
+    Real dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+    Real wa = (Real)inv_mass[a], wb = (Real)inv_mass[b];
+    Real w = wa + wb;
+    if (w == 0 || dist == 0) continue;
+    Real dlambda = ((Real)springs[k].rest_length - dist) / (w + alpha);
+    Real s = dlambda / dist;
+    Real cx = dx * s, cy = dy * s, cz = dz * s;
+    pa[0] += wa * cx; pa[1] += wa * cy; pa[2] += wa * cz;
+    pb[0] -= wb * cx; pb[1] -= wb * cy; pb[2] -= wb * cz;
+  }
+}
+
+template <typename Real>
+static void project_pass(const SpringBuffer &springs, ClothParameters *cp,
+                         double delta_t, const double *inv_mass,
+                         Real *position, int num_threads) {
+  double h2 = delta_t * delta_t;
+
+  // Springs of one color share no point mass, so each color is projected in
+  // parallel and the sweep matches a serial one whatever the thread count
+  #pragma omp parallel num_threads(num_threads)
+  for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+    e_spring_type type = (e_spring_type)t;
+    double ks = (type == BENDING) ? cp->ks * 0.2 : cp->ks;
+    if (!cp->is_enabled(type) || ks <= 0) { continue; }
+    double alpha_tilde = 1.0 / ks / h2;
+    for (int c = 0; c < springs.num_colors(type); c++) {
+      long begin = springs.color_begin(type, c);
+      long end = springs.color_end(type, c);
+      #pragma omp for schedule(static)
+      for (long k = begin; k < end; k += Kernels::BLOCK_SIZE) {
+        long count = min(Kernels::BLOCK_SIZE, end - k);
+        project_distance(&springs[k], count, alpha_tilde, inv_mass, position);
+      }
+    }
+  }
+}
+
+void XPBD::project(Cloth *cloth, ClothParameters *cp, double delta_t,
+                   int num_threads) {
+  ParticleStore &particles = cloth->particles;
+  const double *inv_mass = particles.inv_mass.data();
+  if (particles.precision == SINGLE_PRECISION) {
+    project_pass(cloth->springs, cp, delta_t, inv_mass,
+                 particles.position_f.data(), num_threads);
+  } else {
+    project_pass(cloth->springs, cp, delta_t, inv_mass,
+                 Kernels::coords(particles.position), num_threads);
+  }
+}
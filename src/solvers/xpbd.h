@@ -0,0 +1,24 @@
+#ifndef XPBD_H
+#define XPBD_H
+
+struct Cloth;
+struct ClothParameters;
+
+// Extended position-based dynamics [Macklin et al. 2016] on the spring
+// topology. Positions are predicted by the Verlet step from external forces
+// only; every spring is then a distance constraint with compliance 1 / ks
+// (1 / (0.2 ks) for bending springs, matching the force model), so the
+// stiffness does not depend on the timestep.
+//
+// Following "Small Steps in Physics Simulation" [Macklin et al. 2019], each
+// substep runs a single colored Gauss-Seidel sweep, and quality is traded
+// through the number of substeps rather than solver iterations. With one
+// sweep the Lagrange multipliers start at zero every substep and need not be
+// stored.
+struct XPBD {
+  // Projects the predicted positions of the cloth onto its constraints
+  void project(Cloth *cloth, ClothParameters *cp, double delta_t,
+               int num_threads);
+};
+
+#endif /* XPBD_H */
@@ -0,0 +1,134 @@
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "CGL/CGL.h"
+#include "CGL/vector3D.h"
+#include "particleStore.h"
+
+using namespace std;
+
+namespace CGL {
+
+// Flat spatial hash over the particles of a cloth, rebuilt by counting sort.
+// Space is split into cubic cells whose 64-bit keys pack the three signed
+// 21-bit cell coordinates. Every key is hashed to one of a power-of-two number
+// of buckets (at least twice the point count); the points of bucket b are
+// then
+//
+//   indices[offsets[b]] ... indices[offsets[b + 1] - 1]
+//
+// in increasing order, with their cell keys alongside in keys. Distinct cells
+// may share a bucket, so lookups compare the keys. The arrays are only
+// resized when the point count changes, so rebuilding every substep
+// allocates nothing.
+struct SpatialHash {
+  // Sorts the points of particles into cells of the given size
+  void build(const ParticleStore &particles, double cell_size) {
+    this->cell_size = cell_size;
+    inv_cell_size = 1.0 / cell_size;
+    size_t num_points = particles.size();
+
+    size_t num_buckets = 2;
+    shift = 63;
+    while (num_buckets < 2 * num_points) {
+      num_buckets <<= 1;
+      shift--;
+    }
+    mask = (uint32_t)num_buckets - 1;
+    offsets.resize(num_buckets + 1);
+    indices.resize(num_points);
+    keys.resize(num_points);
+    point_key.resize(num_points);
+
+    // Count the points per bucket, then turn the counts into bucket ends
+    fill(offsets.begin(), offsets.end(), 0);
+    for (size_t i = 0; i < num_points; i++) {
+      point_key[i] = key(particles.get_position(i));
+      offsets[bucket(point_key[i])]++;
+    }
+    uint32_t end = 0;
+    for (size_t b = 0; b < num_buckets; b++) {
+      end += offsets[b];
+      offsets[b] = end;
+    }
+    offsets[num_buckets] = end;
+
+    // Scattering backwards moves every end to the start of its bucket and
+    // keeps the points of a bucket in increasing order
+    for (size_t i = num_points; i-- > 0;) {
+      uint32_t slot = --offsets[bucket(point_key[i])];
+      indices[slot] = (int)i;
+      keys[slot] = point_key[i];
+    }
+  }
+
+  // Key of the cell containing p
+  uint64_t key(const Vector3D &p) const {
+    return pack(cell(p.x * inv_cell_size), cell(p.y * inv_cell_size),
+                cell(p.z * inv_cell_size));
+  }
+
+  // Bucket of a cell key. The y and z coordinates are scattered by Fibonacci
+  // hashing and x is added on top, so the three cells of a row of the
+  // neighborhood land in consecutive buckets and their offsets share a
+  // cache line.
+  uint32_t bucket(uint64_t key) const {
+    uint64_t yz = key >> 21, x = key & ((1ull << 21) - 1);
+    return (uint32_t)(((yz * 0x9E3779B97F4A7C15ull) >> shift) + x) & mask;
+  }
+
+  // Calls f(j) for every point j in the 3x3x3 cells around p, which covers
+  // every point within cell_size of p
+  template <typename F>
+  void for_each_neighbor(const Vector3D &p, F f) const {
+    int32_t x = cell(p.x * inv_cell_size);
+    int32_t y = cell(p.y * inv_cell_size);
+    int32_t z = cell(p.z * inv_cell_size);
+    for (int32_t dz = -1; dz <= 1; dz++) {
+      for (int32_t dy = -1; dy <= 1; dy++) {
+        for (int32_t dx = -1; dx <= 1; dx++) {
+          uint64_t k = pack(x + dx, y + dy, z + dz);
+          uint32_t b = bucket(k);
+          for (uint32_t s = offsets[b]; s < offsets[b + 1]; s++) {
+            if (keys[s] == k) { f(indices[s]); }
+          }
+        }
+      }
+    }
+  }
+
+  double cell_size = 1, inv_cell_size = 1;
+  int shift = 63;
+  uint32_t mask = 1;
+
+  vector<uint32_t> offsets;
+  vector<int> indices;
+  vector<uint64_t> keys;
+  vector<uint64_t> point_key;
+
+private:
+  // Cells are addressable within [-LIMIT, LIMIT] along each axis, which
+  // leaves room for the neighbors of the outermost cells
+  static const int32_t LIMIT = (1 << 20) - 2;
+
+  // Cell coordinate along one axis; NaN and infinite positions (e.g. from an
+  // exploded simulation) all land in cell 0, far away ones in the outermost
+  // cells
+  static int32_t cell(double x) {
+    if (isnan(x) || isinf(x)) { return 0; }
+    return (int32_t)max((double)-LIMIT, min((double)LIMIT, floor(x)));
+  }
+
+  static uint64_t pack(int32_t x, int32_t y, int32_t z) {
+    const uint64_t MASK = (1ull << 21) - 1;
+    return ((uint64_t)x & MASK) | (((uint64_t)y & MASK) << 21) |
+           (((uint64_t)z & MASK) << 42);
+  }
+}; // struct SpatialHash
+}
+#endif /* SPATIAL_HASH_H */
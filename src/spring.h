@@ -1,10 +1,12 @@
 #ifndef SPRING_H
 #define SPRING_H
 
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
 #include <vector>
 
 #include "CGL/CGL.h"
-#include "pointMass.h"
 
 using namespace std;
 
@@ -12,21 +14,110 @@ namespace CGL {
 
 enum e_spring_type { STRUCTURAL = 0, SHEARING = 1, BENDING = 2 };
 
+const int NUM_SPRING_TYPES = 3;
+
+// A spring between two particles of the cloth's ParticleStore.
 struct Spring {
-  Spring(PointMass *a, PointMass *b, e_spring_type spring_type)
-      : pm_a(a), pm_b(b), spring_type(spring_type) {
-    rest_length = (pm_a->position - pm_b->position).norm();
+  Spring(uint32_t a, uint32_t b, float rest_length)
+      : a(a), b(b), rest_length(rest_length) {}
+
+  uint32_t a;
+  uint32_t b;
+  float rest_length;
+}; // struct Spring
+
+// All springs of a cloth, stored as one contiguous range per spring type so
+// that a disabled type can be skipped as a whole. Each range is further split
+// into colors: no two springs of the same color share a particle, so a color
+// can be processed in parallel without write conflicts. Within a color springs
+// are ordered by their endpoints so that consecutive springs touch nearby
+// particles.
+struct SpringBuffer {
+  SpringBuffer() { clear(); }
+
+  void clear() {
+    springs.clear();
+    for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+      pending[t].clear();
+      colors[t].assign(1, 0);
+      max_degree[t] = 0;
+    }
+    fill(offsets, offsets + NUM_SPRING_TYPES + 1, 0);
+  }
+
+  // Queues a spring; it only becomes visible after the next build().
+  void add(uint32_t a, uint32_t b, float rest_length, e_spring_type type) {
+    if (a > b) swap(a, b);
+    pending[type].push_back(Spring(a, b, rest_length));
   }
 
-  Spring(PointMass *a, PointMass *b, double rest_length)
-      : pm_a(a), pm_b(b), rest_length(rest_length) {}
+  // Sorts and colors the queued springs and packs them into their type ranges.
+  void build(size_t num_particles) {
+    springs.clear();
+    vector<uint64_t> used(num_particles);
+    for (int t = 0; t < NUM_SPRING_TYPES; t++) {
+      vector<Spring> &range = pending[t];
+      sort(range.begin(), range.end(), [](const Spring &s, const Spring &r) {
+        return s.a != r.a ? s.a < r.a : s.b < r.b;
+      });
 
-  double rest_length;
+      // Greedy edge coloring; a particle touches at most a handful of
+      // springs per type, so 64 colors is plenty.
+      fill(used.begin(), used.end(), 0);
+      vector<int> color(range.size());
+      int num_colors = 0;
+      vector<int> degree(num_particles);
+      for (size_t i = 0; i < range.size(); i++) {
+        uint64_t taken = used[range[i].a] | used[range[i].b];
+        if (taken == ~0ull) {
+          throw std::runtime_error("SpringBuffer: too many spring colors");
+        }
+        int c = 0;
+        while (taken & (1ull << c)) c++;
+        used[range[i].a] |= 1ull << c;
+        used[range[i].b] |= 1ull << c;
+        color[i] = c;
+        num_colors = max(num_colors, c + 1);
+        max_degree[t] = max(max_degree[t], max(++degree[range[i].a], ++degree[range[i].b]));
+      }
 
-  e_spring_type spring_type;
+      offsets[t] = springs.size();
+      colors[t].clear();
+      for (int c = 0; c < num_colors; c++) {
+        colors[t].push_back(springs.size());
+        for (size_t i = 0; i < range.size(); i++) {
+          if (color[i] == c) springs.push_back(range[i]);
+        }
+      }
+      colors[t].push_back(springs.size());
 
-  PointMass *pm_a;
-  PointMass *pm_b;
-}; // struct Spring
+      range.clear();
+      range.shrink_to_fit();
+    }
+    offsets[NUM_SPRING_TYPES] = springs.size();
+  }
+
+  size_t begin(e_spring_type type) const { return offsets[type]; }
+  size_t end(e_spring_type type) const { return offsets[type + 1]; }
+  size_t count(e_spring_type type) const { return end(type) - begin(type); }
+
+  int num_colors(e_spring_type type) const { return (int)colors[type].size() - 1; }
+  size_t color_begin(e_spring_type type, int c) const { return colors[type][c]; }
+  size_t color_end(e_spring_type type, int c) const { return colors[type][c + 1]; }
+
+  // Largest number of springs of one type meeting at a single particle
+  int degree(e_spring_type type) const { return max_degree[type]; }
+
+  size_t size() const { return springs.size(); }
+  const Spring &operator[](size_t i) const { return springs[i]; }
+
+  vector<Spring> springs;
+  size_t offsets[NUM_SPRING_TYPES + 1];
+  vector<size_t> colors[NUM_SPRING_TYPES];
+  int max_degree[NUM_SPRING_TYPES];
+
+private:
+  vector<Spring> pending[NUM_SPRING_TYPES];
+}; // struct SpringBuffer
 }
 #endif /* SPRING_H */
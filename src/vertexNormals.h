@@ -0,0 +1,99 @@
+#ifndef VERTEX_NORMALS_H
+#define VERTEX_NORMALS_H
+
+#include <cmath>
+#include <vector>
+
+#include "CGL/CGL.h"
+#include "CGL/vector3D.h"
+#include "clothMesh.h"
+#include "particleStore.h"
+
+using namespace std;
+
+namespace CGL {
+
+// Unit vertex normals of the cloth mesh, the sum of the area-weighted normals
+// of the triangles around each vertex, as PointMass::normal() computes by
+// walking the halfedge fan. Here every face normal is computed once per
+// update, from a flat array of triangle indices, and every vertex then sums
+// those of its triangles through a vertex-to-triangle table:
+//
+//   vertex_triangles[offsets[v]] ... vertex_triangles[offsets[v + 1] - 1]
+//
+// Both sweeps write disjoint entries, so they run in parallel without
+// synchronization and give the same normals for any thread count.
+struct VertexNormals {
+  // Sets up the index arrays for the triangles of mesh, whose point masses
+  // are vertices 0 to num_vertices - 1
+  void build(const ClothMesh *mesh, int num_vertices) {
+    int num_triangles = mesh->triangles.size();
+    triangles.resize(3 * num_triangles);
+    offsets.assign(num_vertices + 1, 0);
+    for (int t = 0; t < num_triangles; t++) {
+      const Triangle *tri = mesh->triangles[t];
+      triangles[3 * t] = tri->pm1->index;
+      triangles[3 * t + 1] = tri->pm2->index;
+      triangles[3 * t + 2] = tri->pm3->index;
+      for (int k = 0; k < 3; k++) { offsets[triangles[3 * t + k] + 1]++; }
+    }
+    for (int v = 0; v < num_vertices; v++) { offsets[v + 1] += offsets[v]; }
+
+    vector<int> next(offsets.begin(), offsets.end() - 1);
+    vertex_triangles.resize(3 * num_triangles);
+    for (int t = 0; t < num_triangles; t++) {
+      for (int k = 0; k < 3; k++) { vertex_triangles[next[triangles[3 * t + k]]++] = t; }
+    }
+
+    face_normals.resize(num_triangles);
+    normals.assign(num_vertices, Vector3D());
+  }
+
+  // Recomputes the normals from the current positions
+  void update(const ParticleStore &particles, int num_threads) {
+    sweep([&](int i) { return particles.get_position(i); }, num_threads);
+  }
+
+  // Same, from a copy of the positions such as a published frame
+  void update(const vector<Vector3D> &positions, int num_threads) {
+    sweep([&](int i) { return positions[i]; }, num_threads);
+  }
+
+  vector<Vector3D> normals;
+
+private:
+  template <typename Position>
+  void sweep(const Position &position, int num_threads) {
+    long num_triangles = face_normals.size();
+    long num_vertices = normals.size();
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+      #pragma omp for schedule(static)
+      for (long t = 0; t < num_triangles; t++) {
+        Vector3D a = position(triangles[3 * t]);
+        Vector3D b = position(triangles[3 * t + 1]);
+        Vector3D c = position(triangles[3 * t + 2]);
+        face_normals[t] = cross(b - a, c - a);
+      }
+
+      #pragma omp for schedule(static)
+      for (long v = 0; v < num_vertices; v++) {
+        Vector3D n;
+        for (int i = offsets[v]; i < offsets[v + 1]; i++) { n += face_normals[vertex_triangles[i]]; }
+        double norm2 = n.norm2();
+        normals[v] = norm2 > 0 ? n / sqrt(norm2) : n;
+      }
+    }
+  }
+
+  // Three vertex indices per triangle
+  vector<int> triangles;
+  vector<int> offsets;
+  vector<int> vertex_triangles;
+  vector<Vector3D> face_normals;
+};
+
+} // namespace CGL
+
+#endif // VERTEX_NORMALS_H